@@ -2,7 +2,7 @@
  *
  * @note Based on https://addons.mozilla.org/de/firefox/addon/screengrab-fix-version/
  */
-function grab(size, region, req_id, sections)
+function grab(size, region, req_id, sections, format)
 {
   var canvas =
     document.createElementNS("http://www.w3.org/1999/xhtml", "html:canvas");
@@ -42,15 +42,42 @@ function grab(size, region, req_id, sections)
     context.restore();
   }
 
+  if( format == 'png' )
+    return encodePng(canvas, req_id);
+
   var image_data = context.getImageData(0, 0, canvas.width, canvas.height).data;
   var len = image_data.length;
   var bytearray = new Uint8Array(len + 2);
   
   bytearray[0] = 1;      // type
-  bytearray[1] = req_id; // id
+  bytearray[1] = req_id; // id (lowest 8 bits)
 
   for( var i = 0; i < len; ++i )
     bytearray[i + 2] = image_data[i];
 
   return bytearray.buffer;
 }
+
+/**
+ * Compressed tile message: type, format, reserved (uint16), id, width, height,
+ * stride (all uint32 little endian) followed by the PNG image.
+ */
+function encodePng(canvas, req_id)
+{
+  var png = atob(canvas.toDataURL("image/png").split(',')[1]);
+  var header_size = 20;
+  var bytearray = new Uint8Array(header_size + png.length);
+  var header = new DataView(bytearray.buffer);
+
+  bytearray[0] = 2;      // type (compressed)
+  bytearray[1] = 1;      // format (PNG)
+  header.setUint32(4, req_id, true);
+  header.setUint32(8, canvas.width, true);
+  header.setUint32(12, canvas.height, true);
+  header.setUint32(16, 0, true);
+
+  for( var i = 0; i < png.length; ++i )
+    bytearray[header_size + i] = png.charCodeAt(i);
+
+  return bytearray.buffer;
+}
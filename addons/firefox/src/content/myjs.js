@@ -19,6 +19,7 @@ var timeout = null;
 var routing = null;
 var cfg = new Object();
 var tile_requests = null;
+var tile_requests_cancelled = {};
 var tile_timeout = false;
 var do_report = true;
 
@@ -864,6 +865,7 @@ function reportVisLinks(id, found)
   var msg = {
     'task': (found ? 'FOUND' : 'INITIATE'),
     'title': document.title,
+    'url': document.location.href,
     'scroll-region': [reg.x, reg.y, reg.width, reg.height],
     'id': id,
     'stamp': last_stamp,
@@ -999,14 +1001,16 @@ function register(match_title = false, src_id = 0)
 
     try
     {
-      tile_requests = new Stack(); //Queue();
+      // Requests are already sent in order of priority
+      tile_requests = new Queue();
+      tile_requests_cancelled = {};
 
       links_socket = new WebSocket('ws://localhost:4487', 'VLP');
       links_socket.binaryType = "arraybuffer";
       links_socket.onopen = function(event)
       {
         setStatus('active');
-        var cmds = ['open-url'];
+        var cmds = ['open-url', 'tile-png'];
         if( src_id )
           cmds.push('scroll');
         var msg = {
@@ -1130,6 +1134,11 @@ function register(match_title = false, src_id = 0)
           else
             Application.console.warn("Unknown GET request: " + event.data);
         }
+        else if( msg.task == 'CANCEL' )
+        {
+          if( msg.id == 'preview-tile' )
+            tile_requests_cancelled[msg.req_id] = true;
+        }
         else if( msg.task == 'SET' )
         {
           if( msg.id == 'scroll-y' )
@@ -1184,8 +1193,15 @@ function handleTileRequest()
   var t_start = performance.now();
 
   var req = tile_requests.dequeue();
+  if( tile_requests_cancelled[req.req_id] )
+  {
+    // Tile is not visible anymore
+    delete tile_requests_cancelled[req.req_id];
+    handleTileRequest();
+    return;
+  }
   var mapping = [req.sections_src, req.sections_dest];
-  links_socket.send( grab(req.size, req.src, req.req_id, mapping) );
+  links_socket.send( grab(req.size, req.src, req.req_id, mapping, req.format) );
 
   var t_end = performance.now();
   console.log("Handling tile request took " + (t_end - t_start) + " milliseconds.");
@@ -1235,6 +1251,7 @@ function resize()
   {
     var msg = {
       'task': 'UPDATE',
+      'url': document.location.href,
       'scroll-region': [reg.x, reg.y, reg.width, reg.height],
       'id': route_id,
       'stamp': active_routes[route_id].stamp,
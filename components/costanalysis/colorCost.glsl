@@ -0,0 +1,33 @@
+uniform sampler2D input0;
+// Link colors in CIELab (L shifted by -50 as in featureMap.glsl)
+uniform vec3 colors[16];
+uniform int numColors;
+// Color distance (delta E) above which there is no penalty
+uniform float maxDistance;
+uniform float weight;
+
+float penalty(vec3 lab, int i)
+{
+  if( i >= numColors )
+    return 0.0;
+  return weight * max(0.0, 1.0 - distance(lab, colors[i]) / maxDistance);
+}
+
+vec4 penalties(vec3 lab, int first)
+{
+  return vec4( penalty(lab, first),
+               penalty(lab, first + 1),
+               penalty(lab, first + 2),
+               penalty(lab, first + 3) );
+}
+
+void main()
+{
+  vec3 lab = texture2D(input0, gl_TexCoord[0].xy).rgb;
+
+  // Four colors per draw buffer (unused buffers are not attached)
+  gl_FragData[0] = penalties(lab, 0);
+  gl_FragData[1] = penalties(lab, 4);
+  gl_FragData[2] = penalties(lab, 8);
+  gl_FragData[3] = penalties(lab, 12);
+}
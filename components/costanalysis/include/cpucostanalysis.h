@@ -0,0 +1,162 @@
+#ifndef LR_CPUCOSTANALYSIS
+#define LR_CPUCOSTANALYSIS
+
+#include "costanalysis.h"
+#include "common/componentarguments.h"
+#include "threadpool.h"
+
+#include "slots.hpp"
+#include "slotdata/damage.hpp"
+#include "slotdata/image.hpp"
+#include "slotdata/image_pyramid.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace LinksRouting
+{
+  /**
+   * Cost analysis without OpenGL. Implements the same pipeline as
+   * GlCostAnalysis (downSample.glsl, featureMap.glsl, saliencyFilter.glsl) on
+   * the CPU, using separable (SIMD) convolutions on tiles distributed over a
+   * thread pool.
+   *
+   * Requires "/desktop" to be an ImageRGBA8 image in main memory and publishes
+   * "/costmap" as ImageGray32F (used as penalty by Dijkstra::CPURouting). Pixels are expected with bytes in R, G, B, A
+   * order and without row padding (eg. QImage::Format_RGBA8888, but not
+   * Format_ARGB32 which is B, G, R, A on little endian machines).
+   *
+   * Only tiles affected by changes of the desktop are recomputed. Changes are
+   * taken from "/desktop/damage" and detected by comparing with the previous
+   * frame ("FrameDiff"). "/costmap/revision" is incremented every time the
+   * costmap changes. "/costmap/pyramid" holds the costmap reduced down to
+   * "DownsamplePyramid" (relative to the desktop).
+   */
+  class CPUCostAnalysis:
+    public CostAnalysis,
+    public ComponentArguments
+  {
+    public:
+
+      CPUCostAnalysis();
+      virtual ~CPUCostAnalysis();
+
+      void publishSlots(SlotCollector& slots);
+      void subscribeSlots(SlotSubscriber& slot_subscriber);
+
+      bool startup(Core* core, unsigned int type);
+      void init();
+      void shutdown();
+      bool supports(unsigned int type) const
+      {
+        return (type & Component::Costanalysis);
+      }
+
+      uint32_t process(unsigned int type) override;
+
+    protected:
+
+      /** Planar float image (one plane per channel) */
+      struct PlanarImage
+      {
+        size_t width, height, channels;
+        std::vector<float> data;
+
+        PlanarImage(): width(0), height(0), channels(0) {}
+        void resize(size_t w, size_t h, size_t c);
+
+        float* row(size_t channel, size_t y)
+        {
+          return &data[(channel * height + y) * width];
+        }
+        const float* row(size_t channel, size_t y) const
+        {
+          return &data[(channel * height + y) * width];
+        }
+      };
+
+      /** Tile (or region inside a tile) in saliency map coordinates */
+      struct Tile
+      {
+        size_t x, y, width, height;
+
+        bool empty() const { return !width || !height; }
+
+        /** Extend to the bounding box of this and @a rhs */
+        void unite(const Tile& rhs);
+        Tile intersected(const Tile& rhs) const;
+      };
+
+      int _downsampleSaliency;
+      int _downsampleCost;
+      int _downsampleSaliencyToCost;
+      int _numThreads;
+      int _tileSize;
+      bool _frameDiff;
+      std::string _pyramidReduction;
+      int _pyramidMaxDownsample;
+
+      slot_t<SlotType::Image>::type _slot_costmap;
+      slot_t<uint32_t>::type        _slot_costmap_revision;
+      slot_t<SlotType::ImagePyramid>::type _slot_costmap_pyramid;
+      slot_t<SlotType::Image>::type _subscribe_desktop;
+      slot_t<SlotType::Damage>::type _subscribe_desktop_damage;
+
+      std::unique_ptr<ThreadPool> _pool;
+      std::vector<Tile>           _tiles;
+      std::vector<Tile>           _dirty_input,   ///< Changed input per tile
+                                  _dirty_output;  ///< Padded by filter radius
+
+      /** Previous desktop image (for detecting changes) */
+      std::vector<unsigned char>  _last_desktop;
+
+      PlanarImage   _feature_map,     ///< CIELab (L shifted by -50)
+                    _filter_a,        ///< Horizontal pass of narrow gauss
+                    _filter_b,        ///< Horizontal pass of wide gauss
+                    _saliency_map,
+                    _cost_map;
+      std::vector<PlanarImage> _pyramid;  ///< All but the first level
+
+      /** @return Whether the buffers have been reallocated */
+      bool resize(size_t width, size_t height);
+
+      /** Mark damaged regions (given in desktop coordinates) */
+      void addDamage(const std::vector<Rect>& rects);
+
+      /** Compare tile with previous frame and mark changed rows */
+      void diffFrame(size_t tile_index, const SlotType::Image& desktop);
+
+      /** Downsample desktop and convert to CIELab (featureMap.glsl) */
+      void computeFeatureMap(const Tile& tile, const SlotType::Image& desktop);
+
+      /** First (horizontal) pass of saliencyFilter.glsl */
+      void filterRows(const Tile& tile);
+
+      /** Second (vertical) pass of saliencyFilter.glsl */
+      void filterColumns(const Tile& tile);
+
+      /** Box downsample saliency map to cost map resolution */
+      void computeCostMap(const Tile& tile);
+
+      /** Create pyramid levels for the current cost map */
+      void initPyramid();
+
+      /** Update all but the first level of "/costmap/pyramid" */
+      void reducePyramid();
+
+      /** Run @a func for every non-empty region using the thread pool */
+      template<class Func>
+      void forEachRegion(const std::vector<Tile>& regions, const Func& func)
+      {
+        std::vector<const Tile*> work;
+        for(size_t i = 0; i < regions.size(); ++i)
+          if( !regions[i].empty() )
+            work.push_back(&regions[i]);
+
+        _pool->run(work.size(), [&](size_t i){ func(*work[i]); });
+      }
+  };
+
+} // namespace LinksRouting
+
+#endif //LR_CPUCOSTANALYSIS
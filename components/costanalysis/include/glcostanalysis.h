@@ -6,10 +6,16 @@
 
 #include "glsl/glsl.h"
 #include "fbo.h"
+#include "linkdescription.h"
 #include "slots.hpp"
+#include "slotdata/color_costmap.hpp"
+#include "slotdata/damage.hpp"
 #include "slotdata/image.hpp"
+#include "slotdata/image_pyramid.hpp"
 
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace LinksRouting
 {
@@ -22,6 +28,11 @@ namespace LinksRouting
       int _downsampleSaliency;
       int _downsampleCost;
       int _downsampleSaliencyToCost;
+      std::string _pyramidReduction;
+      int _pyramidMaxDownsample;
+      bool _colorCost;
+      double _colorCostWeight;
+      double _colorCostDistance;
 
     public:
 
@@ -44,26 +55,88 @@ namespace LinksRouting
 
 //      bool setSceneInput(const Component::MapData& inputmap);
 //      bool setCostreductionInput(const Component::MapData& inputmap);
+
+      /**
+       * Enable computing color dependent costs ("/costmap/colors") on behalf
+       * of the given routing component (eg. Dijkstra::CPURouting, which adds
+       * the layer of each link to its costs).
+       */
       void connect(LinksRouting::Routing* routing);
 
+      /**
+       * Ensure a color dependent cost layer for @a c is available in
+       * "/costmap/colors" (in addition to the colors of all active links).
+       * Requires a current OpenGL context.
+       */
       void computeColorCostMap(const Color& c);
 
     private:
 
+      /** Region of a render target in pixels (rows from the texture origin) */
+      struct Region
+      {
+        int l, t, r, b;
+      };
+      typedef std::vector<Region> Regions;
+
       slot_t<SlotType::Image>::type _slot_costmap;
+      slot_t<uint32_t>::type        _slot_costmap_revision;
+      slot_t<SlotType::ImagePyramid>::type _slot_costmap_pyramid;
+      slot_t<SlotType::ColorCostMaps>::type _slot_color_costmaps;
       slot_t<SlotType::Image>::type _slot_featuremap;
       slot_t<SlotType::Image>::type _slot_downsampledinput;
       slot_t<SlotType::Image>::type _subscribe_desktop;
+      slot_t<SlotType::Damage>::type _subscribe_desktop_damage;
+      slot_t<LinkDescription::LinkList>::type _subscribe_links;
+      slot_t<std::vector<Color>>::type _subscribe_link_colors;
 
       gl::FBO   _feature_map_fbo;
       gl::FBO   _saliency_map_fbo;
       gl::FBO   _cost_map_fbo;
       gl::FBO   _downsampled_input_fbo;
+      std::vector<std::unique_ptr<gl::FBO>> _pyramid_fbos;
+      gl::FBO   _color_cost_fbo;
+
+      /** Desktop texture the current costmap has been computed from */
+      GLuint        _desktop_id;
+      unsigned int  _desktop_width,
+                    _desktop_height;
+
+      /** Colors requested with computeColorCostMap */
+      std::vector<Color>  _color_cost_requested;
+
+      /** Colors and costmap revision of the current color cost layers */
+      std::vector<Color>  _color_cost_colors;
+      uint32_t            _color_cost_revision;
 
       cwc::glShaderManager  _shader_manager;
       cwc::glShader*    _feature_map_shader;
       cwc::glShader*    _saliency_map_shader;
       cwc::glShader*    _downsample_shader;
+      cwc::glShader*    _pyramid_shader;
+      cwc::glShader*    _color_cost_shader;
+
+      /**
+       * Create levels of "/costmap/pyramid" (reduced by 2 each) until
+       * DownsamplePyramid is reached.
+       */
+      void initPyramid();
+
+      /**
+       * Update all but the first level of "/costmap/pyramid"
+       *
+       * @param dirty   Changed regions of the first level
+       */
+      void reducePyramid(const Regions& dirty);
+
+      /**
+       * Update "/costmap/colors" for all requested and active link colors if
+       * they or the costmap have changed since the last update.
+       *
+       * @param dirty   Regions of the costmap changed by the last update (empty
+       *                if unknown)
+       */
+      void updateColorCostMaps(const Regions& dirty = Regions());
 
   };
 } // namespace LinksRouting
@@ -0,0 +1,56 @@
+#ifndef LR_SALIENCYFILTER
+#define LR_SALIENCYFILTER
+
+#include <cstddef>
+
+namespace LinksRouting
+{
+  /**
+   * Separable filters from saliencyFilter.glsl ("default trimmed") used by
+   * CPUCostAnalysis. The default versions use SSE2 if available and the
+   * scalar versions for the remaining elements. The scalar versions are also
+   * the reference for testing the SIMD code.
+   */
+
+  /** Number of filter weights per side (including the center) */
+  static const int FILTER_SAMPLES = 7;
+  static const float SALIENCY_SCALE = 15.0f * 0.333333333f * 0.005f;
+
+  /**
+   * Horizontal pass with both filters. @a src needs FILTER_SAMPLES - 1 valid
+   * elements before and after [0, n).
+   */
+  void convolveRow( const float* src,
+                    float* dst_a,
+                    float* dst_b,
+                    size_t n );
+
+  /** Scalar convolveRow for the elements [x, n) */
+  void convolveRowScalar( const float* src,
+                          float* dst_a,
+                          float* dst_b,
+                          size_t x,
+                          size_t n );
+
+  /**
+   * Vertical pass of both filters for one channel, accumulating the absolute
+   * difference into @a dst. @a rows_a and @a rows_b point to the center row
+   * and need to be valid for [-(FILTER_SAMPLES - 1), FILTER_SAMPLES - 1].
+   */
+  void convolveColumnsAbsDiff( const float* const* rows_a,
+                               const float* const* rows_b,
+                               size_t offset,
+                               float* dst,
+                               size_t n );
+
+  /** Scalar convolveColumnsAbsDiff for the elements [x, n) */
+  void convolveColumnsAbsDiffScalar( const float* const* rows_a,
+                                     const float* const* rows_b,
+                                     size_t offset,
+                                     float* dst,
+                                     size_t x,
+                                     size_t n );
+
+} // namespace LinksRouting
+
+#endif /* LR_SALIENCYFILTER */
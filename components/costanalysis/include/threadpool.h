@@ -0,0 +1,63 @@
+#ifndef LR_THREADPOOL
+#define LR_THREADPOOL
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LinksRouting
+{
+  /**
+   * Fixed set of worker threads for processing independent tasks (eg. image
+   * tiles) in parallel. The calling thread takes part in processing, so a pool
+   * with zero workers runs everything sequentially.
+   */
+  class ThreadPool
+  {
+    public:
+
+      typedef std::function<void (size_t)> Task;
+
+      /**
+       * @param num_threads   Total number of threads including the calling
+       *                      thread (0 = number of hardware threads)
+       */
+      explicit ThreadPool(size_t num_threads = 0);
+      ~ThreadPool();
+
+      size_t numThreads() const { return _workers.size() + 1; }
+
+      /**
+       * Run @a task for every index in [0, @a num_tasks) and wait until all
+       * tasks have finished.
+       */
+      void run(size_t num_tasks, const Task& task);
+
+    private:
+
+      ThreadPool(const ThreadPool&);
+      ThreadPool& operator=(const ThreadPool&);
+
+      void workerLoop();
+
+      /** Process tasks of the current job until there are none left */
+      void work(std::unique_lock<std::mutex>& lock);
+
+      std::vector<std::thread>  _workers;
+      std::mutex                _mutex;
+      std::condition_variable   _cond_work,
+                                _cond_done;
+
+      Task    _task;
+      size_t  _num_tasks,
+              _next_task,
+              _num_done;
+      size_t  _job;       ///< Incremented for every call to run
+      bool    _quit;
+  };
+
+} // namespace LinksRouting
+
+#endif //LR_THREADPOOL
@@ -0,0 +1,20 @@
+uniform sampler2D input0;
+uniform vec2 texincrease;
+// 1 = maximum, 0 = mean of 2x2 block
+uniform int reduceMax;
+
+void main()
+{
+  // Odd sizes are rounded up, so the last block is clamped to the edge
+  vec2 coord = (floor(gl_FragCoord.xy) * 2.0 + 0.5) * texincrease;
+
+  float c00 = texture2D(input0, coord).r;
+  float c10 = texture2D(input0, coord + vec2(texincrease.x, 0)).r;
+  float c01 = texture2D(input0, coord + vec2(0, texincrease.y)).r;
+  float c11 = texture2D(input0, coord + texincrease).r;
+
+  if( reduceMax > 0 )
+    gl_FragColor = vec4(max(max(c00, c10), max(c01, c11)));
+  else
+    gl_FragColor = vec4(0.25 * (c00 + c10 + c01 + c11));
+}
@@ -0,0 +1,606 @@
+#include "cpucostanalysis.h"
+#include "saliencyfilter.h"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace LinksRouting
+{
+  //----------------------------------------------------------------------------
+  /** sRGB (8bit) to linear RGB (scaled by 100) as in featureMap.glsl */
+  struct SRGBToLinearTable
+  {
+    float values[256];
+
+    SRGBToLinearTable()
+    {
+      for(int i = 0; i < 256; ++i)
+      {
+        float c = i / 255.f;
+        if( c > 0.04045f )
+          c = std::pow(c * 0.94786729857819905f + 0.05213270142180095f, 2.4f);
+        else
+          c = c * 0.07739938080495356f;
+        values[i] = c * 100.f;
+      }
+    }
+  };
+  static const SRGBToLinearTable SRGB_TO_LINEAR;
+
+  //----------------------------------------------------------------------------
+  static inline float labF(float t)
+  {
+    return t > 0.008856f ? std::pow(t, 0.33333333f)
+                         : 7.787f * t + 0.13793103448275862f;
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::PlanarImage::resize(size_t w, size_t h, size_t c)
+  {
+    width = w;
+    height = h;
+    channels = c;
+    data.assign(w * h * c, 0.f);
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::Tile::unite(const Tile& rhs)
+  {
+    if( rhs.empty() )
+      return;
+    if( empty() )
+    {
+      *this = rhs;
+      return;
+    }
+
+    size_t x_end = std::max(x + width, rhs.x + rhs.width),
+           y_end = std::max(y + height, rhs.y + rhs.height);
+    x = std::min(x, rhs.x);
+    y = std::min(y, rhs.y);
+    width = x_end - x;
+    height = y_end - y;
+  }
+
+  //----------------------------------------------------------------------------
+  CPUCostAnalysis::Tile
+  CPUCostAnalysis::Tile::intersected(const Tile& rhs) const
+  {
+    size_t x0 = std::max(x, rhs.x),
+           y0 = std::max(y, rhs.y),
+           x1 = std::min(x + width, rhs.x + rhs.width),
+           y1 = std::min(y + height, rhs.y + rhs.height);
+
+    Tile ret = {x0, y0, 0, 0};
+    if( x1 > x0 && y1 > y0 )
+    {
+      ret.width = x1 - x0;
+      ret.height = y1 - y0;
+    }
+    return ret;
+  }
+
+  //----------------------------------------------------------------------------
+  CPUCostAnalysis::CPUCostAnalysis():
+    Configurable("CPUCostAnalysis"),
+    _downsampleSaliencyToCost(1)
+  {
+    registerArg("DownsampleSaliency", _downsampleSaliency = 2);
+    registerArg("DownsampleCost", _downsampleCost = 4);
+    registerArg("NumThreads", _numThreads = 0);
+    registerArg("TileSize", _tileSize = 64);
+    registerArg("FrameDiff", _frameDiff = true);
+    registerArg("PyramidReduction", _pyramidReduction = "max");
+    registerArg("DownsamplePyramid", _pyramidMaxDownsample = 64);
+  }
+
+  //----------------------------------------------------------------------------
+  CPUCostAnalysis::~CPUCostAnalysis()
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::publishSlots(SlotCollector& slots)
+  {
+    _slot_costmap = slots.create<SlotType::Image>("/costmap");
+    _slot_costmap_revision = slots.create<uint32_t>("/costmap/revision");
+    *_slot_costmap_revision->_data = 0;
+    _slot_costmap_pyramid =
+      slots.create<SlotType::ImagePyramid>("/costmap/pyramid");
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::subscribeSlots(SlotSubscriber& slot_subscriber)
+  {
+    _subscribe_desktop =
+      slot_subscriber.getSlot<SlotType::Image>("/desktop");
+    _subscribe_desktop_damage =
+      slot_subscriber.getSlot<SlotType::Damage>("/desktop/damage");
+  }
+
+  //----------------------------------------------------------------------------
+  bool CPUCostAnalysis::startup(Core* core, unsigned int type)
+  {
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::init()
+  {
+    _pool.reset( new ThreadPool(std::max(0, _numThreads)) );
+    LOG_INFO("Using " << _pool->numThreads() << " threads.");
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::shutdown()
+  {
+    _pool.reset();
+  }
+
+  //----------------------------------------------------------------------------
+  uint32_t CPUCostAnalysis::process(unsigned int type)
+  {
+    _slot_costmap->setValid(false);
+    _slot_costmap_pyramid->setValid(false);
+
+    if( !_subscribe_desktop->isValid() )
+      return 0;
+
+    const SlotType::Image& desktop = *_subscribe_desktop->_data;
+    if( desktop.type != SlotType::Image::ImageRGBA8 || !desktop.pdata )
+    {
+      LOG_DEBUG("Desktop is not available in main memory.");
+      return 0;
+    }
+
+    if( !_pool )
+      init();
+
+    const size_t downsample = std::max(1, _downsampleSaliency);
+    bool all_dirty =
+      resize(desktop.width / downsample, desktop.height / downsample);
+
+    if( _tiles.empty() )
+      return 0;
+
+    std::vector<Rect> damage;
+    if( _subscribe_desktop_damage->_data->take(damage) )
+      all_dirty = true;
+
+    const size_t desktop_size = desktop.width * desktop.height * 4;
+    if( _frameDiff && _last_desktop.size() != desktop_size )
+      all_dirty = true;
+
+    if( all_dirty )
+    {
+      _dirty_input = _tiles;
+      if( _frameDiff )
+        _last_desktop.assign(desktop.pdata, desktop.pdata + desktop_size);
+    }
+    else
+    {
+      _dirty_input.assign(_tiles.size(), Tile());
+      addDamage(damage);
+
+      if( _frameDiff )
+        _pool->run(_tiles.size(), [&](size_t i){ diffFrame(i, desktop); });
+    }
+
+    // Filters spread changes by their radius, also into neighbouring tiles
+    const size_t radius = FILTER_SAMPLES - 1,
+                 ratio = _downsampleSaliencyToCost;
+    _dirty_output.assign(_tiles.size(), Tile());
+    bool dirty = false;
+    for(size_t i = 0; i < _dirty_input.size(); ++i)
+    {
+      const Tile& in = _dirty_input[i];
+      if( in.empty() )
+        continue;
+
+      // Aligned to cost map pixels to allow downsampling each region
+      size_t x0 = in.x > radius ? in.x - radius : 0,
+             y0 = in.y > radius ? in.y - radius : 0;
+      Tile padded = {
+        x0 / ratio * ratio,
+        y0 / ratio * ratio,
+        0, 0
+      };
+      padded.width = (in.x + in.width + radius + ratio - 1) / ratio * ratio
+                   - padded.x;
+      padded.height = (in.y + in.height + radius + ratio - 1) / ratio * ratio
+                    - padded.y;
+
+      for(size_t j = 0; j < _tiles.size(); ++j)
+        _dirty_output[j].unite( _tiles[j].intersected(padded) );
+      dirty = true;
+    }
+
+    if( dirty )
+    {
+      forEachRegion(_dirty_input, [&](const Tile& region)
+      {
+        computeFeatureMap(region, desktop);
+      });
+      forEachRegion(_dirty_output, [&](const Tile& region)
+      {
+        filterRows(region);
+      });
+      forEachRegion(_dirty_output, [&](const Tile& region)
+      {
+        filterColumns(region);
+      });
+      if( ratio > 1 )
+        forEachRegion(_dirty_output, [&](const Tile& region)
+        {
+          computeCostMap(region);
+        });
+      reducePyramid();
+
+      *_slot_costmap_revision->_data += 1;
+      _slot_costmap_revision->setValid(true);
+    }
+
+    _slot_costmap->setValid(true);
+    _slot_costmap_pyramid->setValid(true);
+    return 0;
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::addDamage(const std::vector<Rect>& rects)
+  {
+    const float ds = static_cast<float>(std::max(1, _downsampleSaliency));
+    const float width = static_cast<float>(_saliency_map.width),
+                height = static_cast<float>(_saliency_map.height);
+
+    for(size_t i = 0; i < rects.size(); ++i)
+    {
+      const Rect& r = rects[i];
+      float x0 = std::max(0.f, std::floor(r.l() / ds)),
+            y0 = std::max(0.f, std::floor(r.t() / ds)),
+            x1 = std::min(width, std::ceil(r.r() / ds)),
+            y1 = std::min(height, std::ceil(r.b() / ds));
+      if( x1 <= x0 || y1 <= y0 )
+        continue;
+
+      Tile region = {
+        static_cast<size_t>(x0),
+        static_cast<size_t>(y0),
+        static_cast<size_t>(x1 - x0),
+        static_cast<size_t>(y1 - y0)
+      };
+      for(size_t j = 0; j < _tiles.size(); ++j)
+        _dirty_input[j].unite( _tiles[j].intersected(region) );
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::diffFrame( size_t tile_index,
+                                   const SlotType::Image& desktop )
+  {
+    const Tile& tile = _tiles[tile_index];
+    Tile& dirty = _dirty_input[tile_index];
+
+    const size_t ds = std::max(1, _downsampleSaliency),
+                 stride = desktop.width * 4,
+                 offset = tile.x * ds * 4,
+                 num_bytes = tile.width * ds * 4;
+
+    for(size_t y = tile.y; y < tile.y + tile.height; ++y)
+    {
+      bool changed = false;
+      for(size_t sy = y * ds; sy < (y + 1) * ds; ++sy)
+      {
+        const unsigned char* cur = desktop.pdata + sy * stride + offset;
+        unsigned char* last = &_last_desktop[sy * stride + offset];
+        if( std::memcmp(cur, last, num_bytes) )
+        {
+          std::memcpy(last, cur, num_bytes);
+          changed = true;
+        }
+      }
+
+      if( changed )
+      {
+        Tile row = {tile.x, y, tile.width, 1};
+        dirty.unite(row);
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  bool CPUCostAnalysis::resize(size_t width, size_t height)
+  {
+    const int ratio_cost =
+      std::max(1, _downsampleCost / std::max(1, _downsampleSaliency));
+
+    if(    width == _saliency_map.width
+        && height == _saliency_map.height
+        && ratio_cost == _downsampleSaliencyToCost
+        && !_tiles.empty() )
+      return false;
+
+    _downsampleSaliencyToCost = ratio_cost;
+
+    _feature_map.resize(width, height, 3);
+    _filter_a.resize(width, height, 3);
+    _filter_b.resize(width, height, 3);
+    _saliency_map.resize(width, height, 1);
+
+    PlanarImage* cost_map = &_saliency_map;
+    if( _downsampleSaliencyToCost > 1 )
+    {
+      _cost_map.resize( width / _downsampleSaliencyToCost,
+                        height / _downsampleSaliencyToCost,
+                        1 );
+      cost_map = &_cost_map;
+    }
+    else
+      _cost_map = PlanarImage();
+
+    *_slot_costmap->_data = SlotType::Image
+    (
+      cost_map->width,
+      cost_map->height,
+      reinterpret_cast<unsigned char*>(cost_map->data.data()),
+      SlotType::Image::ImageGray32F
+    );
+
+    // Tiles are aligned to the cost map pixels, so each tile can be
+    // downsampled independently.
+    size_t ratio = _downsampleSaliencyToCost,
+           tile_size = std::max<size_t>(_tileSize, FILTER_SAMPLES);
+    tile_size = (tile_size + ratio - 1) / ratio * ratio;
+
+    _tiles.clear();
+    for(size_t y = 0; y < height; y += tile_size)
+      for(size_t x = 0; x < width; x += tile_size)
+      {
+        Tile tile = {
+          x, y,
+          std::min(tile_size, width - x),
+          std::min(tile_size, height - y)
+        };
+        _tiles.push_back(tile);
+      }
+
+    initPyramid();
+
+    LOG_INFO("Costmap " << cost_map->width << "x" << cost_map->height
+             << " (saliency " << width << "x" << height
+             << ", " << _tiles.size() << " tiles, "
+             << _pyramid.size() + 1 << " pyramid levels)");
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::initPyramid()
+  {
+    SlotType::ImagePyramid& pyramid = *_slot_costmap_pyramid->_data;
+    pyramid.reduction =
+      SlotType::ImagePyramid::reductionFromString(_pyramidReduction);
+    pyramid.base_scale = std::max(1, _downsampleSaliency)
+                       * _downsampleSaliencyToCost;
+    pyramid.levels.assign(1, *_slot_costmap->_data);
+
+    _pyramid.clear();
+    size_t width = pyramid.levels[0].width,
+           height = pyramid.levels[0].height;
+    while(    pyramid.scale(_pyramid.size() + 1)
+                <= static_cast<unsigned int>(_pyramidMaxDownsample)
+           && (width > 1 || height > 1) )
+    {
+      width = (width + 1) / 2;
+      height = (height + 1) / 2;
+
+      _pyramid.push_back(PlanarImage());
+      _pyramid.back().resize(width, height, 1);
+    }
+
+    // Only reference the data after all levels have been allocated
+    for(size_t i = 0; i < _pyramid.size(); ++i)
+      pyramid.levels.push_back
+      (
+        SlotType::Image
+        (
+          _pyramid[i].width,
+          _pyramid[i].height,
+          reinterpret_cast<unsigned char*>(_pyramid[i].data.data()),
+          SlotType::Image::ImageGray32F
+        )
+      );
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::reducePyramid()
+  {
+    const bool reduce_max = _slot_costmap_pyramid->_data->reduction
+                         == SlotType::ImagePyramid::Max;
+    const SlotType::Image& base = _slot_costmap_pyramid->_data->levels[0];
+
+    size_t src_width = base.width,
+           src_height = base.height;
+    const float* src = reinterpret_cast<const float*>(base.pdata);
+
+    for(size_t i = 0; i < _pyramid.size(); ++i)
+    {
+      PlanarImage& dst = _pyramid[i];
+      for(size_t y = 0; y < dst.height; ++y)
+      {
+        // Odd sizes are rounded up, so the last block is clamped to the edge
+        const float* row0 = src + 2 * y * src_width,
+                   * row1 = src + std::min(2 * y + 1, src_height - 1) * src_width;
+        float* out = dst.row(0, y);
+
+        for(size_t x = 0; x < dst.width; ++x)
+        {
+          size_t x0 = 2 * x,
+                 x1 = std::min(x0 + 1, src_width - 1);
+          if( reduce_max )
+            out[x] = std::max( std::max(row0[x0], row0[x1]),
+                               std::max(row1[x0], row1[x1]) );
+          else
+            out[x] = 0.25f * (row0[x0] + row0[x1] + row1[x0] + row1[x1]);
+        }
+      }
+
+      src = dst.data.data();
+      src_width = dst.width;
+      src_height = dst.height;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::computeFeatureMap( const Tile& tile,
+                                           const SlotType::Image& desktop )
+  {
+    static const float ref_white[3] = {95.047f, 100.000f, 108.883f};
+    const float* srgb_to_linear = SRGB_TO_LINEAR.values;
+
+    const size_t ds = std::max(1, _downsampleSaliency),
+                 num_samples = ds * ds,
+                 stride = desktop.width * 4;
+
+    for(size_t y = tile.y; y < tile.y + tile.height; ++y)
+    {
+      float* lab_l = _feature_map.row(0, y),
+           * lab_a = _feature_map.row(1, y),
+           * lab_b = _feature_map.row(2, y);
+
+      // Desktops contain large areas of the same color, so remember the last
+      // conversion to avoid the expensive pow calls.
+      unsigned int last_rgb = 0xffffffff;
+      float last_lab[3] = {0, 0, 0};
+
+      for(size_t x = tile.x; x < tile.x + tile.width; ++x)
+      {
+        // Box downsampling (downSample.glsl), result is stored as 8bit
+        unsigned int sum[3] = {0, 0, 0};
+        const unsigned char* src = desktop.pdata + y * ds * stride + x * ds * 4;
+        for(size_t sy = 0; sy < ds; ++sy, src += stride)
+          for(size_t sx = 0; sx < ds; ++sx)
+          {
+            sum[0] += src[sx * 4];
+            sum[1] += src[sx * 4 + 1];
+            sum[2] += src[sx * 4 + 2];
+          }
+
+        unsigned int rgb[3];
+        for(int c = 0; c < 3; ++c)
+          rgb[c] = (sum[c] + num_samples / 2) / num_samples;
+
+        unsigned int key = rgb[0] | (rgb[1] << 8) | (rgb[2] << 16);
+        if( key != last_rgb )
+        {
+          // RGB to XYZ to CIELab (featureMap.glsl)
+          float r = srgb_to_linear[ rgb[0] ],
+                g = srgb_to_linear[ rgb[1] ],
+                b = srgb_to_linear[ rgb[2] ];
+
+          float fx = labF((0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / ref_white[0]),
+                fy = labF((0.2126729f * r + 0.7151522f * g + 0.0721750f * b) / ref_white[1]),
+                fz = labF((0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / ref_white[2]);
+
+          last_lab[0] = 116.f * fy - 16.f - 50.f; // gray is neutral
+          last_lab[1] = 500.f * (fx - fy);
+          last_lab[2] = 200.f * (fy - fz);
+          last_rgb = key;
+        }
+
+        lab_l[x] = last_lab[0];
+        lab_a[x] = last_lab[1];
+        lab_b[x] = last_lab[2];
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::filterRows(const Tile& tile)
+  {
+    const int radius = FILTER_SAMPLES - 1;
+    const int width = static_cast<int>(_feature_map.width);
+
+    // Row with border clamped to edge (GL_CLAMP)
+    std::vector<float> padded(tile.width + 2 * radius);
+
+    for(size_t c = 0; c < _feature_map.channels; ++c)
+      for(size_t y = tile.y; y < tile.y + tile.height; ++y)
+      {
+        const float* src = _feature_map.row(c, y);
+        for(int i = 0; i < static_cast<int>(padded.size()); ++i)
+        {
+          int x = static_cast<int>(tile.x) + i - radius;
+          padded[i] = src[ std::min(std::max(x, 0), width - 1) ];
+        }
+
+        convolveRow( &padded[radius],
+                     _filter_a.row(c, y) + tile.x,
+                     _filter_b.row(c, y) + tile.x,
+                     tile.width );
+      }
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::filterColumns(const Tile& tile)
+  {
+    const int radius = FILTER_SAMPLES - 1;
+    const int height = static_cast<int>(_saliency_map.height);
+
+    const float* rows_a[2 * FILTER_SAMPLES - 1];
+    const float* rows_b[2 * FILTER_SAMPLES - 1];
+
+    for(size_t y = tile.y; y < tile.y + tile.height; ++y)
+    {
+      float* dst = _saliency_map.row(0, y) + tile.x;
+      std::fill(dst, dst + tile.width, 0.f);
+
+      for(size_t c = 0; c < _feature_map.channels; ++c)
+      {
+        for(int k = -radius; k <= radius; ++k)
+        {
+          int row = std::min(std::max(static_cast<int>(y) + k, 0), height - 1);
+          rows_a[k + radius] = _filter_a.row(c, row);
+          rows_b[k + radius] = _filter_b.row(c, row);
+        }
+
+        convolveColumnsAbsDiff( &rows_a[radius],
+                                &rows_b[radius],
+                                tile.x,
+                                dst,
+                                tile.width );
+      }
+
+      for(size_t x = 0; x < tile.width; ++x)
+        dst[x] *= SALIENCY_SCALE;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void CPUCostAnalysis::computeCostMap(const Tile& tile)
+  {
+    const size_t ratio = _downsampleSaliencyToCost;
+    const float norm = 1.f / (ratio * ratio);
+
+    const size_t x_end = std::min(_cost_map.width, (tile.x + tile.width) / ratio),
+                 y_end = std::min(_cost_map.height, (tile.y + tile.height) / ratio);
+
+    for(size_t cy = tile.y / ratio; cy < y_end; ++cy)
+    {
+      float* dst = _cost_map.row(0, cy);
+      for(size_t cx = tile.x / ratio; cx < x_end; ++cx)
+      {
+        float sum = 0;
+        for(size_t sy = 0; sy < ratio; ++sy)
+        {
+          const float* src = _saliency_map.row(0, cy * ratio + sy) + cx * ratio;
+          for(size_t sx = 0; sx < ratio; ++sx)
+            sum += src[sx];
+        }
+        dst[cx] = sum * norm;
+      }
+    }
+  }
+
+} // namespace LinksRouting
@@ -1,18 +1,112 @@
 #include "glcostanalysis.h"
 #include "slotdata/image.hpp"
 
+#include "log.hpp"
+
 #include <algorithm>
+#include <cmath>
 #include <stdexcept>
 
 namespace LinksRouting
 {
+  /** Maximum number of color cost layers (4 draw buffers * 4 channels) */
+  static const size_t MAX_COLOR_COST_LAYERS = 16;
+
+  /** Radius of the filters in saliencyFilter.glsl (samples - 1) */
+  static const int SALIENCY_FILTER_RADIUS = 6;
+
+  /** Above this number of damaged regions only their bounding box is used */
+  static const size_t MAX_DIRTY_REGIONS = 8;
+
+  //----------------------------------------------------------------------------
+  /**
+   * Scale regions down by @a factor (rounding outwards) after extending them
+   * by @a border, and clip them to [0, width) x [0, height).
+   */
+  template<class Regions>
+  static Regions scaleRegions( const Regions& regions,
+                               int border,
+                               int factor,
+                               int width,
+                               int height )
+  {
+    Regions ret;
+    for(auto const& region: regions)
+    {
+      auto r = region;
+      r.l = std::max(0, (r.l - border) / factor);
+      r.t = std::max(0, (r.t - border) / factor);
+      r.r = std::min(width, (r.r + border + factor - 1) / factor);
+      r.b = std::min(height, (r.b + border + factor - 1) / factor);
+      if( r.l < r.r && r.t < r.b )
+        ret.push_back(r);
+    }
+    return ret;
+  }
+
+  //----------------------------------------------------------------------------
+  /**
+   * Draw only inside the given regions of the currently bound render target
+   * (by calling @a draw for every region).
+   */
+  template<class Regions, class Func>
+  static void drawRegions(const Regions& regions, const Func& draw)
+  {
+    glEnable(GL_SCISSOR_TEST);
+    for(auto const& r: regions)
+    {
+      glScissor(r.l, r.t, r.r - r.l, r.b - r.t);
+      draw();
+    }
+    glDisable(GL_SCISSOR_TEST);
+  }
+
+  //----------------------------------------------------------------------------
+  /**
+   * Convert color to CIELab with L shifted by -50 (same as featureMap.glsl)
+   */
+  static void colorToLab(const Color& c, float lab[3])
+  {
+    float rgb[3] = {c.r, c.g, c.b};
+    for(int i = 0; i < 3; ++i)
+    {
+      if( rgb[i] > 0.04045f )
+        rgb[i] = std::pow(rgb[i] * 0.94786729857819905f + 0.05213270142180095f, 2.4f);
+      else
+        rgb[i] = rgb[i] * 0.07739938080495356f;
+      rgb[i] *= 100.f;
+    }
+
+    float xyz[3] = {
+      (0.4124564f * rgb[0] + 0.3575761f * rgb[1] + 0.1804375f * rgb[2]) / 95.047f,
+      (0.2126729f * rgb[0] + 0.7151522f * rgb[1] + 0.0721750f * rgb[2]) / 100.000f,
+      (0.0193339f * rgb[0] + 0.1191920f * rgb[1] + 0.9503041f * rgb[2]) / 108.883f
+    };
+    for(int i = 0; i < 3; ++i)
+      xyz[i] = xyz[i] > 0.008856f ? std::pow(xyz[i], 0.33333333f)
+                                  : 7.787f * xyz[i] + 0.13793103448275862f;
+
+    lab[0] = 116.f * xyz[1] - 16.f - 50.f;
+    lab[1] = 500.f * (xyz[0] - xyz[1]);
+    lab[2] = 200.f * (xyz[1] - xyz[2]);
+  }
 
   //----------------------------------------------------------------------------
   GlCostAnalysis::GlCostAnalysis():
-    Configurable("GLCostAnalysis")
+    Configurable("GLCostAnalysis"),
+    _desktop_id(0),
+    _desktop_width(0),
+    _desktop_height(0),
+    _color_cost_revision(0),
+    _color_cost_shader(0)
   {
     registerArg("DownsampleSaliency", _downsampleSaliency = 2);
     registerArg("DownsampleCost", _downsampleCost = 4);
+    registerArg("PyramidReduction", _pyramidReduction = "max");
+    registerArg("DownsamplePyramid", _pyramidMaxDownsample = 64);
+    registerArg("ColorCost", _colorCost = false);
+    registerArg("ColorCostWeight", _colorCostWeight = 1.0);
+    registerArg("ColorCostDistance", _colorCostDistance = 25.0);
   }
 
   //----------------------------------------------------------------------------
@@ -25,6 +119,12 @@ namespace LinksRouting
   void GlCostAnalysis::publishSlots(SlotCollector& slots)
   {
     _slot_costmap = slots.create<SlotType::Image>("/costmap");
+    _slot_costmap_revision = slots.create<uint32_t>("/costmap/revision");
+    *_slot_costmap_revision->_data = 0;
+    _slot_costmap_pyramid =
+      slots.create<SlotType::ImagePyramid>("/costmap/pyramid");
+    _slot_color_costmaps =
+      slots.create<SlotType::ColorCostMaps>("/costmap/colors");
     _slot_featuremap = slots.create<SlotType::Image>("/featuremap");
     _slot_downsampledinput = slots.create<SlotType::Image>("/downsampled_desktop");
   }
@@ -34,6 +134,12 @@ namespace LinksRouting
   {
     _subscribe_desktop =
       slot_subscriber.getSlot<LinksRouting::SlotType::Image>("/desktop");
+    _subscribe_desktop_damage =
+      slot_subscriber.getSlot<SlotType::Damage>("/desktop/damage");
+    _subscribe_links =
+      slot_subscriber.getSlot<LinkDescription::LinkList>("/links");
+    _subscribe_link_colors =
+      slot_subscriber.getSlot<std::vector<Color>>("/link-colors");
   }
 
   //----------------------------------------------------------------------------
@@ -60,6 +166,7 @@ namespace LinksRouting
     if(_downsampleSaliencyToCost > 1)
       _cost_map_fbo.init(widthCost, heightCost, GL_R32F, 1, false, GL_NEAREST);
     _downsampled_input_fbo.init(widthSaliency, heightSaliency, GL_RGBA8, 1, false, GL_NEAREST);
+    _color_cost_fbo.init(widthCost, heightCost, GL_RGBA32F, MAX_COLOR_COST_LAYERS / 4, false, GL_NEAREST);
 
     // TODO
     if(_downsampleSaliencyToCost > 1)
@@ -72,10 +179,186 @@ namespace LinksRouting
     _feature_map_shader = _shader_manager.loadfromFile(0, "featureMap.glsl");
     _saliency_map_shader = _shader_manager.loadfromFile(0, "saliencyFilter.glsl");
     _downsample_shader = _shader_manager.loadfromFile(0, "downSample.glsl");
-    
+    _pyramid_shader = _shader_manager.loadfromFile(0, "reducePyramid.glsl");
+    _color_cost_shader = _shader_manager.loadfromFile(0, "colorCost.glsl");
+
+    initPyramid();
+
     return true;
   }
 
+  //----------------------------------------------------------------------------
+  void GlCostAnalysis::initPyramid()
+  {
+    SlotType::ImagePyramid& pyramid = *_slot_costmap_pyramid->_data;
+    pyramid.reduction =
+      SlotType::ImagePyramid::reductionFromString(_pyramidReduction);
+    pyramid.base_scale = _downsampleSaliency * _downsampleSaliencyToCost;
+    pyramid.levels.assign(1, *_slot_costmap->_data);
+
+    _pyramid_fbos.clear();
+    unsigned int width = pyramid.levels[0].width,
+                 height = pyramid.levels[0].height;
+    while(    pyramid.scale(pyramid.levels.size())
+                <= static_cast<unsigned int>(_pyramidMaxDownsample)
+           && (width > 1 || height > 1) )
+    {
+      width = (width + 1) / 2;
+      height = (height + 1) / 2;
+
+      _pyramid_fbos.push_back(std::unique_ptr<gl::FBO>(new gl::FBO));
+      _pyramid_fbos.back()->init(width, height, GL_R32F, 1, false, GL_NEAREST);
+      pyramid.levels.push_back
+      (
+        SlotType::Image(width, height, _pyramid_fbos.back()->colorBuffers.at(0))
+      );
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void GlCostAnalysis::reducePyramid(const Regions& dirty)
+  {
+    SlotType::ImagePyramid& pyramid = *_slot_costmap_pyramid->_data;
+    if( _pyramid_fbos.empty() )
+      return;
+
+    if( !_pyramid_shader )
+      throw std::runtime_error("Pyramid shader not loaded.");
+
+    _pyramid_shader->begin();
+    _pyramid_shader->setUniform1i("input0", 0);
+    _pyramid_shader->setUniform1i
+    (
+      "reduceMax",
+      pyramid.reduction == SlotType::ImagePyramid::Max
+    );
+
+    Regions level_dirty = dirty;
+
+    glEnable(GL_TEXTURE_2D);
+    for(size_t i = 0; i < _pyramid_fbos.size(); ++i)
+    {
+      const SlotType::Image& src = pyramid.levels[i];
+      gl::FBO& fbo = *_pyramid_fbos[i];
+
+      level_dirty = scaleRegions(level_dirty, 0, 2, fbo.width, fbo.height);
+      if( level_dirty.empty() )
+        break;
+
+      fbo.bind();
+      _pyramid_shader->setUniform2f("texincrease", 1.0f/src.width, 1.0f/src.height);
+      glBindTexture(GL_TEXTURE_2D, src.id);
+
+      glColor3f(1,1,1);
+      drawRegions(level_dirty, [&]()
+      {
+        fbo.draw(fbo.width, fbo.height, 0,0, -1, true, true);
+      });
+      fbo.unbind();
+    }
+    glDisable(GL_TEXTURE_2D);
+
+    _pyramid_shader->end();
+  }
+
+  //----------------------------------------------------------------------------
+  void GlCostAnalysis::updateColorCostMaps(const Regions& dirty)
+  {
+    std::vector<Color> colors = _color_cost_requested;
+    if(    _colorCost
+        && _subscribe_links->isValid()
+        && _subscribe_link_colors->isValid()
+        && !_subscribe_link_colors->_data->empty() )
+    {
+      const std::vector<Color>& link_colors = *_subscribe_link_colors->_data;
+      const LinkDescription::LinkList& links = *_subscribe_links->_data;
+      for(auto link = links.begin(); link != links.end(); ++link)
+      {
+        const Color& c = link_colors[ link->_color_id % link_colors.size() ];
+        if( std::find(colors.begin(), colors.end(), c) == colors.end() )
+          colors.push_back(c);
+      }
+    }
+
+    if( colors.size() > MAX_COLOR_COST_LAYERS )
+    {
+      LOG_WARN("Too many colors (" << colors.size() << "), only using the first "
+                                   << MAX_COLOR_COST_LAYERS);
+      colors.resize(MAX_COLOR_COST_LAYERS);
+    }
+
+    // Layers only depend on the desktop (costmap) and the colors
+    const uint32_t revision = *_slot_costmap_revision->_data;
+    const bool colors_changed = colors != _color_cost_colors;
+    if( !colors_changed && _color_cost_revision == revision )
+      return;
+
+    // Only redraw the changed parts if the layers are up to date with the
+    // previous costmap
+    Regions regions = dirty;
+    if( colors_changed || _color_cost_revision + 1 != revision )
+      regions.clear();
+    if( regions.empty() )
+      regions.push_back(Region{ 0, 0,
+                                static_cast<int>(_color_cost_fbo.width),
+                                static_cast<int>(_color_cost_fbo.height) });
+
+    _color_cost_colors = colors;
+    _color_cost_revision = *_slot_costmap_revision->_data;
+
+    SlotType::ColorCostMaps& maps = *_slot_color_costmaps->_data;
+    maps.layers.clear();
+    _slot_color_costmaps->setValid(false);
+
+    if( colors.empty() )
+      return;
+
+    if( !_color_cost_shader )
+      throw std::runtime_error("Color cost shader not loaded.");
+
+    float lab[MAX_COLOR_COST_LAYERS][3];
+    for(size_t i = 0; i < colors.size(); ++i)
+    {
+      colorToLab(colors[i], lab[i]);
+
+      SlotType::ColorCostMaps::Layer layer;
+      layer.color = colors[i];
+      layer.image = SlotType::Image( _color_cost_fbo.width,
+                                     _color_cost_fbo.height,
+                                     _color_cost_fbo.colorBuffers.at(i / 4) );
+      layer.channel = i % 4;
+      maps.layers.push_back(layer);
+    }
+
+    // All colors at once, four per draw buffer
+    _color_cost_fbo.bind();
+    _color_cost_fbo.activateDrawBuffer((colors.size() + 3) / 4);
+    _color_cost_shader->begin();
+    _color_cost_shader->setUniform1i("input0", 0);
+    _color_cost_shader->setUniform3fv("colors", colors.size(), &lab[0][0]);
+    _color_cost_shader->setUniform1i("numColors", colors.size());
+    _color_cost_shader->setUniform1f("maxDistance", _colorCostDistance);
+    _color_cost_shader->setUniform1f("weight", _colorCostWeight);
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, _feature_map_fbo.colorBuffers.at(0));
+
+    glColor3f(1,1,1);
+    drawRegions(regions, [&]()
+    {
+      _color_cost_fbo.draw( _color_cost_fbo.width, _color_cost_fbo.height,
+                            0,0, -1, true, true );
+    });
+
+    glDisable(GL_TEXTURE_2D);
+
+    _color_cost_shader->end();
+    _color_cost_fbo.activateDrawBuffer(1);
+    _color_cost_fbo.unbind();
+
+    _slot_color_costmaps->setValid(true);
+  }
+
   void GlCostAnalysis::shutdown()
   {
 
@@ -84,12 +367,86 @@ namespace LinksRouting
   //----------------------------------------------------------------------------
   uint32_t GlCostAnalysis::process(unsigned int type)
   {
+    const SlotType::Image& desktop = *_subscribe_desktop->_data;
+
+    // Nothing to analyse until a desktop texture has been published
+    if(    !_subscribe_desktop->isValid()
+        || desktop.type != SlotType::Image::OpenGLTexture
+        || !desktop.id
+        || !desktop.width
+        || !desktop.height )
+      return 0;
+
+    // Without a source for content changes the damage only covers moved and
+    // resized windows, so analyse the whole desktop in that case.
+    SlotType::Damage& desktop_damage = *_subscribe_desktop_damage->_data;
+    std::vector<Rect> damage;
+    bool all_dirty = desktop_damage.take(damage)
+                  || !desktop_damage.tracksContent();
+    if(    desktop.id != _desktop_id
+        || desktop.width != _desktop_width
+        || desktop.height != _desktop_height )
+    {
+      all_dirty = true;
+      _desktop_id = desktop.id;
+      _desktop_width = desktop.width;
+      _desktop_height = desktop.height;
+    }
+
+    // Changed regions of the desktop (damage is given in desktop image
+    // coordinates, which are also the texture rows).
+    Regions dirty;
+    if( all_dirty )
+      dirty.push_back(Region{ 0, 0,
+                              static_cast<int>(desktop.width),
+                              static_cast<int>(desktop.height) });
+    else
+      for(auto const& rect: damage)
+        dirty.push_back(Region{ static_cast<int>(std::floor(rect.l())),
+                                static_cast<int>(std::floor(rect.t())),
+                                static_cast<int>(std::ceil(rect.r())),
+                                static_cast<int>(std::ceil(rect.b())) });
+
+    if( dirty.size() > MAX_DIRTY_REGIONS )
+    {
+      Region bb = dirty.front();
+      for(auto const& r: dirty)
+      {
+        bb.l = std::min(bb.l, r.l);
+        bb.t = std::min(bb.t, r.t);
+        bb.r = std::max(bb.r, r.r);
+        bb.b = std::max(bb.b, r.b);
+      }
+      dirty.assign(1, bb);
+    }
+
+    if( dirty.empty() )
+    {
+      // Desktop has not changed, so keep the costmap (and its revision)
+      updateColorCostMaps();
+      return 0;
+    }
+
     _slot_costmap->setValid(false);
+    _slot_costmap_pyramid->setValid(false);
 
-    GLuint inputtex = _subscribe_desktop->_data->id;
+    GLuint inputtex = desktop.id;
     size_t width = _downsampled_input_fbo.width,
            height = _downsampled_input_fbo.height;
 
+    // Regions to update in saliency map resolution. The filters spread
+    // changes by their radius (twice for the first pass, as the second pass
+    // reads its results in the neighbourhood).
+    const Regions input = scaleRegions( dirty, 0,
+                                        std::max(1, _downsampleSaliency),
+                                        width, height ),
+                  filter_first = scaleRegions( input,
+                                               2 * SALIENCY_FILTER_RADIUS, 1,
+                                               width, height ),
+                  filter_second = scaleRegions( input,
+                                                SALIENCY_FILTER_RADIUS, 1,
+                                                width, height );
+
     //---------------------------------
     // downsample
     //---------------------------------
@@ -103,13 +460,16 @@ namespace LinksRouting
       _downsample_shader->begin();
       _downsample_shader->setUniform1i("input0", 0);
       _downsample_shader->setUniform1i("samples", _downsampleSaliency);
-      _downsample_shader->setUniform2f("texincrease", 1.0f/_subscribe_desktop->_data->width, 1.0f/_subscribe_desktop->_data->height);
+      _downsample_shader->setUniform2f("texincrease", 1.0f/desktop.width, 1.0f/desktop.height);
 
       glEnable(GL_TEXTURE_2D);
       glBindTexture(GL_TEXTURE_2D, inputtex);
 
       glColor3f(1,1,1);
-      _downsampled_input_fbo.draw(width, height, 0,0, -1, true, true);
+      drawRegions(input, [&]()
+      {
+        _downsampled_input_fbo.draw(width, height, 0,0, -1, true, true);
+      });
 
        glDisable(GL_TEXTURE_2D);
 
@@ -136,7 +496,10 @@ namespace LinksRouting
     glBindTexture(GL_TEXTURE_2D, inputtex);
 
     glColor3f(1,1,1);
-    _feature_map_fbo.draw(width, height, 0,0, -1, true, true);
+    drawRegions(input, [&]()
+    {
+      _feature_map_fbo.draw(width, height, 0,0, -1, true, true);
+    });
 
     glDisable(GL_TEXTURE_2D);
 
@@ -165,7 +528,10 @@ namespace LinksRouting
 
 
      glColor3f(1,1,1);
-     _feature_map_fbo.draw(width, height, 0,0, 0, true, true);
+     drawRegions(filter_first, [&]()
+     {
+       _feature_map_fbo.draw(width, height, 0,0, 0, true, true);
+     });
 
     //------------
     // second pass
@@ -180,7 +546,10 @@ namespace LinksRouting
     _saliency_map_shader->setUniform1i("step", 1);
 
     glColor3f(1,1,1);
-    _feature_map_fbo.draw(width, height, 0,0, -1, true, true);
+    drawRegions(filter_second, [&]()
+    {
+      _feature_map_fbo.draw(width, height, 0,0, -1, true, true);
+    });
 
     glDisable(GL_TEXTURE_2D);
 
@@ -190,11 +559,15 @@ namespace LinksRouting
     _saliency_map_shader->end();
     _saliency_map_fbo.unbind();
 
+    Regions cost = filter_second;
     if(_downsampleSaliencyToCost > 1)
     {
       if( !_downsample_shader )
         throw std::runtime_error("Downsample shader not loaded.");
 
+      cost = scaleRegions( filter_second, 0, _downsampleSaliencyToCost,
+                           _cost_map_fbo.width, _cost_map_fbo.height );
+
       _cost_map_fbo.bind();
       _downsample_shader->begin();
       _downsample_shader->setUniform1i("input0", 0);
@@ -206,7 +579,10 @@ namespace LinksRouting
 
       glColor3f(1,1,1);
 
-      _cost_map_fbo.draw(_cost_map_fbo.width, _cost_map_fbo.height, 0,0, -1, true, true);
+      drawRegions(cost, [&]()
+      {
+        _cost_map_fbo.draw(_cost_map_fbo.width, _cost_map_fbo.height, 0,0, -1, true, true);
+      });
 
       glDisable(GL_TEXTURE_2D);
 
@@ -214,18 +590,36 @@ namespace LinksRouting
       _cost_map_fbo.unbind();
     }
 
+    reducePyramid(cost);
+
+    *_slot_costmap_revision->_data += 1;
+    _slot_costmap_revision->setValid(true);
+
+    updateColorCostMaps(cost);
 
     _slot_costmap->setValid(true);
+    _slot_costmap_pyramid->setValid(true);
     return 0;
   }
 
+  //----------------------------------------------------------------------------
   void GlCostAnalysis::connect(LinksRouting::Routing* routing)
   {
-
+    // Only make sure the layers are computed. Adding them to the routing
+    // costs is left to the router.
+    if( routing )
+      _colorCost = true;
   }
 
+  //----------------------------------------------------------------------------
   void GlCostAnalysis::computeColorCostMap(const Color& c)
   {
+    if(    std::find( _color_cost_requested.begin(),
+                      _color_cost_requested.end(),
+                      c ) == _color_cost_requested.end() )
+      _color_cost_requested.push_back(c);
 
+    if( _slot_costmap->isValid() )
+      updateColorCostMaps();
   }
 };
@@ -0,0 +1,131 @@
+#include "saliencyfilter.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define LR_USE_SSE 1
+# include <emmintrin.h>
+#endif
+
+namespace LinksRouting
+{
+  static const float GAUSS_A[FILTER_SAMPLES] = {
+    0.71999999999999997000f, 0.07588744168454231200f, 0.00008885505894240928f,
+    0.00000000115576419973f, 0.00000000000000016701f, 0.0f, 0.0f
+  };
+  static const float GAUSS_B[FILTER_SAMPLES] = {
+    0.08555807038943835700f, 0.08391941157579190000f, 0.07918934964643750700f,
+    0.07189091646601346300f, 0.06278908601128568900f, 0.05275907832970361900f,
+    0.04264942067529771400f
+  };
+  // Remaining weights of GAUSS_A are below float precision relative to the
+  // center weight, so skip them.
+  static const int FILTER_A_SAMPLES = 3;
+
+  //----------------------------------------------------------------------------
+  void convolveRowScalar( const float* src,
+                          float* dst_a,
+                          float* dst_b,
+                          size_t x,
+                          size_t n )
+  {
+    for(; x < n; ++x)
+    {
+      float a = GAUSS_A[0] * src[x],
+            b = GAUSS_B[0] * src[x];
+      for(int k = 1; k < FILTER_SAMPLES; ++k)
+      {
+        float s = src[x - k] + src[x + k];
+        if( k < FILTER_A_SAMPLES )
+          a += GAUSS_A[k] * s;
+        b += GAUSS_B[k] * s;
+      }
+      dst_a[x] = a;
+      dst_b[x] = b;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void convolveRow( const float* src,
+                    float* dst_a,
+                    float* dst_b,
+                    size_t n )
+  {
+    size_t x = 0;
+#if LR_USE_SSE
+    for(; x + 4 <= n; x += 4)
+    {
+      __m128 c = _mm_loadu_ps(src + x);
+      __m128 a = _mm_mul_ps(c, _mm_set1_ps(GAUSS_A[0]));
+      __m128 b = _mm_mul_ps(c, _mm_set1_ps(GAUSS_B[0]));
+      for(int k = 1; k < FILTER_SAMPLES; ++k)
+      {
+        __m128 s = _mm_add_ps( _mm_loadu_ps(src + x - k),
+                               _mm_loadu_ps(src + x + k) );
+        if( k < FILTER_A_SAMPLES )
+          a = _mm_add_ps(a, _mm_mul_ps(s, _mm_set1_ps(GAUSS_A[k])));
+        b = _mm_add_ps(b, _mm_mul_ps(s, _mm_set1_ps(GAUSS_B[k])));
+      }
+      _mm_storeu_ps(dst_a + x, a);
+      _mm_storeu_ps(dst_b + x, b);
+    }
+#endif
+    convolveRowScalar(src, dst_a, dst_b, x, n);
+  }
+
+  //----------------------------------------------------------------------------
+  void convolveColumnsAbsDiffScalar( const float* const* rows_a,
+                                     const float* const* rows_b,
+                                     size_t offset,
+                                     float* dst,
+                                     size_t x,
+                                     size_t n )
+  {
+    for(; x < n; ++x)
+    {
+      size_t i = offset + x;
+      float a = GAUSS_A[0] * rows_a[0][i],
+            b = GAUSS_B[0] * rows_b[0][i];
+      for(int k = 1; k < FILTER_A_SAMPLES; ++k)
+        a += GAUSS_A[k] * (rows_a[-k][i] + rows_a[k][i]);
+      for(int k = 1; k < FILTER_SAMPLES; ++k)
+        b += GAUSS_B[k] * (rows_b[-k][i] + rows_b[k][i]);
+      dst[x] += std::fabs(a - b);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void convolveColumnsAbsDiff( const float* const* rows_a,
+                               const float* const* rows_b,
+                               size_t offset,
+                               float* dst,
+                               size_t n )
+  {
+    size_t x = 0;
+#if LR_USE_SSE
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for(; x + 4 <= n; x += 4)
+    {
+      size_t i = offset + x;
+      __m128 a = _mm_mul_ps(_mm_loadu_ps(rows_a[0] + i), _mm_set1_ps(GAUSS_A[0]));
+      __m128 b = _mm_mul_ps(_mm_loadu_ps(rows_b[0] + i), _mm_set1_ps(GAUSS_B[0]));
+      for(int k = 1; k < FILTER_A_SAMPLES; ++k)
+      {
+        __m128 sa = _mm_add_ps( _mm_loadu_ps(rows_a[-k] + i),
+                                _mm_loadu_ps(rows_a[ k] + i) );
+        a = _mm_add_ps(a, _mm_mul_ps(sa, _mm_set1_ps(GAUSS_A[k])));
+      }
+      for(int k = 1; k < FILTER_SAMPLES; ++k)
+      {
+        __m128 sb = _mm_add_ps( _mm_loadu_ps(rows_b[-k] + i),
+                                _mm_loadu_ps(rows_b[ k] + i) );
+        b = _mm_add_ps(b, _mm_mul_ps(sb, _mm_set1_ps(GAUSS_B[k])));
+      }
+      __m128 diff = _mm_and_ps(_mm_sub_ps(a, b), abs_mask);
+      _mm_storeu_ps(dst + x, _mm_add_ps(_mm_loadu_ps(dst + x), diff));
+    }
+#endif
+    convolveColumnsAbsDiffScalar(rows_a, rows_b, offset, dst, x, n);
+  }
+
+} // namespace LinksRouting
@@ -0,0 +1,89 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+namespace LinksRouting
+{
+
+  //----------------------------------------------------------------------------
+  ThreadPool::ThreadPool(size_t num_threads):
+    _num_tasks(0),
+    _next_task(0),
+    _num_done(0),
+    _job(0),
+    _quit(false)
+  {
+    if( !num_threads )
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for(size_t i = 1; i < num_threads; ++i)
+      _workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+  }
+
+  //----------------------------------------------------------------------------
+  ThreadPool::~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _quit = true;
+    }
+    _cond_work.notify_all();
+
+    for(size_t i = 0; i < _workers.size(); ++i)
+      _workers[i].join();
+  }
+
+  //----------------------------------------------------------------------------
+  void ThreadPool::run(size_t num_tasks, const Task& task)
+  {
+    if( !num_tasks )
+      return;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _task = task;
+    _num_tasks = num_tasks;
+    _next_task = 0;
+    _num_done = 0;
+    _job += 1;
+    _cond_work.notify_all();
+
+    work(lock);
+    _cond_done.wait(lock, [this]{ return _num_done == _num_tasks; });
+
+    _task = Task();
+  }
+
+  //----------------------------------------------------------------------------
+  void ThreadPool::workerLoop()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    size_t last_job = _job;
+
+    for(;;)
+    {
+      _cond_work.wait(lock, [&]{ return _quit || _job != last_job; });
+      if( _quit )
+        return;
+
+      last_job = _job;
+      work(lock);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void ThreadPool::work(std::unique_lock<std::mutex>& lock)
+  {
+    while( _next_task < _num_tasks )
+    {
+      size_t index = _next_task++;
+
+      lock.unlock();
+      _task(index);
+      lock.lock();
+
+      if( ++_num_done == _num_tasks )
+        _cond_done.notify_all();
+    }
+  }
+
+} // namespace LinksRouting
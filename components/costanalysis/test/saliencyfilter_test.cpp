@@ -0,0 +1,119 @@
+/**
+ * Compare the (SIMD) saliency filters with their scalar reference.
+ */
+
+#include "saliencyfilter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace LinksRouting;
+
+static const size_t RADIUS = FILTER_SAMPLES - 1,
+                    NUM_ROWS = 2 * FILTER_SAMPLES - 1;
+
+//------------------------------------------------------------------------------
+/** Pattern with edges of the given period and pseudo random noise */
+static std::vector<float> makeImage( size_t width,
+                                     size_t height,
+                                     size_t period,
+                                     unsigned int seed )
+{
+  std::vector<float> img(width * height);
+  for(size_t i = 0; i < img.size(); ++i)
+  {
+    seed = seed * 1103515245 + 12345;
+    const size_t x = i % width,
+                 y = i / width;
+    img[i] = ((x / period + y / period) % 2 ? 40.f : -25.f)
+           + (seed >> 16) % 100 * 0.1f;
+  }
+  return img;
+}
+
+//------------------------------------------------------------------------------
+static bool equal(const std::vector<float>& val, const std::vector<float>& ref)
+{
+  for(size_t i = 0; i < val.size(); ++i)
+    if( std::fabs(val[i] - ref[i]) > 1e-4f * std::max(1.f, std::fabs(ref[i])) )
+    {
+      std::cerr << "mismatch at " << i << ": " << val[i]
+                << " (expected " << ref[i] << ")" << std::endl;
+      return false;
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+static bool testRow(size_t n)
+{
+  const std::vector<float> src = makeImage(n + 2 * RADIUS, 1, 5, 4711 + n);
+
+  std::vector<float> a(n), b(n), ref_a(n), ref_b(n);
+  convolveRow(&src[RADIUS], &a[0], &b[0], n);
+  convolveRowScalar(&src[RADIUS], &ref_a[0], &ref_b[0], 0, n);
+
+  return equal(a, ref_a) && equal(b, ref_b);
+}
+
+//------------------------------------------------------------------------------
+static bool testColumns(size_t n, size_t offset)
+{
+  // Different images for both filters, so that the difference is not zero
+  const size_t width = offset + n;
+  const std::vector<float> img_a = makeImage(width, NUM_ROWS, 3, 17),
+                           img_b = makeImage(width, NUM_ROWS, 7, 42);
+
+  const float* rows_a[NUM_ROWS];
+  const float* rows_b[NUM_ROWS];
+  for(size_t k = 0; k < NUM_ROWS; ++k)
+  {
+    rows_a[k] = &img_a[k * width];
+    rows_b[k] = &img_b[k * width];
+  }
+
+  // Accumulates into the destination, so start with non zero values
+  std::vector<float> diff(n, 1.f), ref_diff(n, 1.f);
+  convolveColumnsAbsDiff(&rows_a[RADIUS], &rows_b[RADIUS], offset, &diff[0], n);
+  convolveColumnsAbsDiffScalar( &rows_a[RADIUS], &rows_b[RADIUS], offset,
+                                &ref_diff[0], 0, n );
+
+  if( !equal(diff, ref_diff) )
+    return false;
+
+  // Make sure the test actually covers differences
+  for(size_t i = 0; i < n; ++i)
+    if( ref_diff[i] > 1.5f )
+      return true;
+
+  std::cerr << "no difference between test images" << std::endl;
+  return false;
+}
+
+//------------------------------------------------------------------------------
+int main()
+{
+  int failed = 0;
+
+  // Lengths with and without remainder of the vector size
+  for(size_t n = 1; n <= 37; ++n)
+  {
+    if( !testRow(n) )
+    {
+      std::cerr << "convolveRow failed for n=" << n << std::endl;
+      ++failed;
+    }
+
+    for(size_t offset = 0; offset < 3; ++offset)
+      if( !testColumns(n, offset) )
+      {
+        std::cerr << "convolveColumnsAbsDiff failed for n=" << n
+                  << " offset=" << offset << std::endl;
+        ++failed;
+      }
+  }
+
+  return failed ? 1 : 0;
+}
@@ -38,6 +38,9 @@ namespace LinksRouting
     /** Size of whole preview region */
     QSize   preview_size;
 
+    /** Document URL (empty if unknown) */
+    QString url;
+
     HierarchicTileMapPtr tile_map,
                          tile_map_uncompressed;
 
@@ -162,6 +165,11 @@ namespace LinksRouting
       Outlines                      _outlines;
       float                         _avg_region_height;
 
+      /** Number of scroll regions received for the current url. Only the
+       *  first one is matched with the disk cache, as the content might have
+       *  changed for later ones (eg. FOUND, UPDATE). */
+      unsigned int                  _num_url_reports;
+
       float2 getPreviewSize() const;
       void createPopup( const float2& pos,
                         const float2& normal,
@@ -0,0 +1,131 @@
+/*
+ * TileDecoder.hpp
+ *
+ *  Created on: 19.10.2026
+ */
+
+#ifndef TILE_DECODER_HPP_
+#define TILE_DECODER_HPP_
+
+#include "HierarchicTileMap.hpp"
+
+#include <QByteArray>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <cstdint>
+#include <deque>
+
+class QWebSocket;
+
+namespace LinksRouting
+{
+
+  /**
+   * Validates and decodes preview tiles received from clients on a separate
+   * thread, to keep the GUI thread responsive while lots of tiles arrive.
+   * The decoded data can be passed to the TileStore without further copying
+   * (uncompressed tiles even reuse the buffer of the received message).
+   *
+   * Compressed tile messages have the following layout (all integers little
+   * endian):
+   *
+   *   uint8  type    (TILE_COMPRESSED)
+   *   uint8  format  (FORMAT_PNG or FORMAT_DEFLATE)
+   *   uint16 reserved
+   *   uint32 req_id  (of the tile request)
+   *   uint32 width
+   *   uint32 height
+   *   uint32 stride  (bytes per row of the uncompressed RGBA data, only used
+   *                   for FORMAT_DEFLATE)
+   *   ...    payload (PNG image or zlib stream)
+   *
+   * Uncompressed tiles (TILE_RAW) only have the type and the lowest 8 bits of
+   * the req_id followed by tightly packed RGBA data.
+   */
+  class TileDecoder:
+    public QThread
+  {
+    Q_OBJECT
+
+    public:
+
+      enum MessageType
+      {
+        TILE_RAW = 1,
+        TILE_COMPRESSED = 2
+      };
+
+      enum Format
+      {
+        FORMAT_PNG = 1,
+        FORMAT_DEFLATE = 2
+      };
+
+      static const size_t HEADER_SIZE = 20;
+
+      struct Result
+      {
+        QWebSocket* socket;   ///< Sender of the tile
+        uint32_t    req_id;
+        bool        short_id; ///< Only lowest 8 bits of req_id known
+        TileDataPtr data;     ///< Tightly packed RGBA (nullptr on error)
+        size_t      size;
+      };
+
+      explicit TileDecoder(QObject* parent = 0);
+      virtual ~TileDecoder();
+
+      /**
+       * Queue a tile message received from the given socket for decoding.
+       *
+       * @param max_width   Maximum width of compressed tiles (the requested
+       *                    tile size), to limit the memory used for decoding
+       * @param max_height  Maximum height of compressed tiles
+       */
+      void decode( const QByteArray& msg,
+                   QWebSocket* socket,
+                   uint32_t max_width,
+                   uint32_t max_height );
+
+      /**
+       * Get the request id of a compressed tile message (eg. to look up the
+       * requested tile size before decoding).
+       *
+       * @return false if not a (complete) TILE_COMPRESSED message
+       */
+      static bool getRequestId(const QByteArray& msg, uint32_t& req_id);
+
+      /** Get all tiles decoded since the last call */
+      std::deque<Result> takeResults();
+
+    signals:
+
+      /** Emitted (from the decoder thread) if new results are available */
+      void decoded();
+
+    protected:
+
+      struct Job
+      {
+        QByteArray  msg;
+        QWebSocket* socket;
+        uint32_t    max_width,
+                    max_height;
+      };
+
+      QMutex                _mutex;
+      QWaitCondition        _cond_work;
+      std::deque<Job>       _jobs;
+      std::deque<Result>    _results;
+      bool                  _quit;
+
+      void run();
+      static bool decodeMessage(const Job& job, Result& result);
+      static bool decodeCompressed(const Job& job, Result& result);
+  };
+
+} // namespace LinksRouting
+
+#endif /* TILE_DECODER_HPP_ */
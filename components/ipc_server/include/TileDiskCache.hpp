@@ -0,0 +1,139 @@
+/*
+ * TileDiskCache.hpp
+ *
+ *  Created on: 19.10.2026
+ */
+
+#ifndef TILE_DISK_CACHE_HPP_
+#define TILE_DISK_CACHE_HPP_
+
+#include "HierarchicTileMap.hpp"
+
+#include <QFile>
+#include <QString>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+namespace LinksRouting
+{
+
+  /**
+   * Persistent cache for preview tiles, to fill previews of already visited
+   * documents without requesting all tiles from the client again.
+   *
+   * Tiles are appended to fixed size segment files, which are memory mapped.
+   * The files are preallocated, so that a full disk is detected when creating
+   * a segment instead of while writing to the mapping. If the size limit is
+   * reached the oldest segment is deleted. Every record
+   * is protected by a checksum for its header and its data, so incomplete or
+   * corrupted records are ignored.
+   *
+   * Tiles are identified by the HierarchicTileMap::persistent_id of their
+   * map, which needs to change whenever the content of the map changes (eg.
+   * hash of document URL, size and partitions).
+   */
+  class TileDiskCache
+  {
+    public:
+
+      struct Key
+      {
+        uint64_t map_id;
+        uint32_t level,
+                 x,
+                 y;
+
+        bool operator==(const Key& rhs) const
+        {
+          return map_id == rhs.map_id
+              && level == rhs.level
+              && x == rhs.x
+              && y == rhs.y;
+        }
+
+        struct Hash
+        {
+          size_t operator()(const Key& key) const
+          {
+            size_t h = static_cast<size_t>(key.map_id ^ (key.map_id >> 32));
+            h = h * 31 + key.level;
+            h = h * 31 + key.x;
+            h = h * 31 + key.y;
+            return h;
+          }
+        };
+      };
+
+      static const size_t MIN_SEGMENT_SIZE = 4 * 1024 * 1024,
+                          MAX_SEGMENT_SIZE = 64 * 1024 * 1024;
+
+      TileDiskCache();
+      ~TileDiskCache();
+
+      /**
+       * Open (or create) the cache in the given directory.
+       *
+       * @param max_size  Maximum size of all segments (in bytes). At least
+       *                  two segments are used, so the cache never uses less
+       *                  than 2 * MIN_SEGMENT_SIZE. Segments of a different
+       *                  size (from a previous max_size) are removed.
+       */
+      bool open(const QString& path, size_t max_size);
+      bool isOpen() const { return !_path.isEmpty(); }
+
+      /**
+       * Get a copy of the tile data.
+       *
+       * @return nullptr if not available (or corrupted)
+       */
+      TileDataPtr get(const Key& key, size_t size);
+
+      /** Store tile data (replacing older data of the same tile) */
+      void put(const Key& key, const uint8_t* data, size_t size);
+
+      /** FNV-1a hash (stable across sessions, for building map ids) */
+      static uint64_t hash( const void* data,
+                            size_t size,
+                            uint64_t h = 14695981039346656037ULL );
+
+    protected:
+
+      struct Segment
+      {
+        std::unique_ptr<QFile> file;
+        uchar                 *data;
+        uint64_t               seq;
+        size_t                 used;
+      };
+      typedef std::unique_ptr<Segment> SegmentPtr;
+
+      struct Location
+      {
+        const Segment* segment;
+        size_t         offset;    ///< Offset of the record header
+        uint32_t       size;
+      };
+      typedef std::unordered_map<Key, Location, Key::Hash> Index;
+
+      QString                 _path;
+      size_t                  _segment_size,
+                              _max_segments;
+      std::deque<SegmentPtr>  _segments; ///< Oldest first
+      Index                   _index;
+
+      SegmentPtr openSegment(const QString& file_name, uint64_t seq);
+      void scanSegment(const Segment& segment);
+      Segment* addSegment();
+      void removeOldestSegment();
+
+    private:
+      TileDiskCache(const TileDiskCache&); // = delete
+      TileDiskCache& operator=(const TileDiskCache&); // = delete
+  };
+
+} // namespace LinksRouting
+
+#endif /* TILE_DISK_CACHE_HPP_ */
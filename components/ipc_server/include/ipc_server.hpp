@@ -18,7 +18,9 @@
 #include "config.h"
 #include "linkdescription.h"
 #include "slotdata/component_selection.hpp"
+#include "slotdata/damage.hpp"
 #include "slotdata/image.hpp"
+#include "slotdata/metrics.hpp"
 #include "slotdata/mouse_event.hpp"
 #include "slotdata/polygon.hpp"
 #include "slotdata/Preview.hpp"
@@ -27,6 +29,7 @@
 #include "window_monitor.hpp"
 
 #include "datatypes.h"
+#include <memory>
 #include <stdint.h>
 
 class QMutex;
@@ -35,6 +38,8 @@ class JSONParser;
 namespace LinksRouting
 {
   struct ClientInfo;
+  class TileDecoder;
+  class TileDiskCache;
 
   class IPCServer:
     public QObject,
@@ -95,11 +100,21 @@ namespace LinksRouting
 
       bool routingActive() const;
 
+    signals:
+
+      /**
+       * Emitted if something changed which requires processing of the given
+       * flags (LINKS_DIRTY, RENDER_DIRTY, ...)
+       */
+      void dirty(uint32_t flags);
+
     private slots:
 
       void onClientConnection();
       void onTextReceived(QString data);
       void onBinaryReceived(QByteArray data);
+      void onTilesDecoded();
+      void onTileStoreResults();
       void onClientDisconnection();
 
     protected:
@@ -138,8 +153,15 @@ namespace LinksRouting
                                   ClientInfo& )> preview_callback_t;
       bool foreachPreview(const preview_callback_t& cb);
 
+      /**
+       * Format to request tiles in from the given client ("raw" if the client
+       * does not support compressed tiles).
+       */
+      QString getTileFormat(QWebSocket* socket) const;
+
       void dirtyLinks();
       void dirtyRender();
+      void dirtyProcess();
 
     private:
 
@@ -166,9 +188,18 @@ namespace LinksRouting
       /* Permanent configuration changeable at runtime */
       slot_t<LinksRouting::Config*>::type _subscribe_user_config;
 
+      /* Runtime statistics of all components */
+      slot_t<SlotType::Metrics>::type _subscribe_metrics;
+
       /* Drawable desktop region */
       slot_t<Rect>::type _subscribe_desktop_rect;
 
+      /* Changed regions of the desktop (for incremental cost analysis) */
+      slot_t<SlotType::Damage>::type _subscribe_desktop_damage;
+
+      /* Window regions at the last change (to detect damaged regions) */
+      std::map<WId, QRect> _damage_windows;
+
       /* Slot for registering mouse callback */
       slot_t<SlotType::MouseEvent>::type  _subscribe_mouse;
       slot_t<SlotType::TextPopup>::type   _subscribe_popups;
@@ -195,15 +226,29 @@ namespace LinksRouting
       void abortAll();
 
       std::string   _debug_regions,
-                    _debug_full_preview_path;
+                    _debug_full_preview_path,
+                    _tile_format,
+                    _tile_disk_cache_path;
       QImage        _full_preview_img;
       int           _preview_width,
                     _preview_height;
       bool          _preview_auto_width,
                     _outside_see_through;
+      int           _tile_memory,
+                    _tile_compression,
+                    _tile_hot_memory,
+                    _tile_requests_per_client,
+                    _tile_request_timeout,
+                    _tile_prefetch_memory,
+                    _tile_disk_cache_size;
 
       class TileHandler;
       TileHandler  *_tile_handler;
+      TileDecoder  *_tile_decoder;
+      std::unique_ptr<TileDiskCache> _tile_disk_cache;
+
+      /* Fires once the oldest tile request in flight times out */
+      QTimer        _tile_timeout_timer;
   };
 
 } // namespace LinksRouting
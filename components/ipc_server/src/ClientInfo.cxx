@@ -9,6 +9,7 @@
 #include <QRect>
 #include "ClientInfo.hxx"
 #include "ipc_server.hpp"
+#include "TileDiskCache.hpp"
 
 #include <cassert>
 
@@ -17,6 +18,35 @@ namespace LinksRouting
 
   static ClientInfo* a300_client = 0;
 
+  //----------------------------------------------------------------------------
+  static uint64_t persistentMapId( const QString& url,
+                                   const HierarchicTileMap& map,
+                                   uint64_t tag )
+  {
+    if( url.isEmpty() )
+      return 0;
+
+    const QByteArray url_utf8 = url.toUtf8();
+    uint64_t h = TileDiskCache::hash(url_utf8.constData(), url_utf8.size());
+
+    const uint32_t dims[] = {
+      static_cast<uint32_t>(map.getWidth()),
+      static_cast<uint32_t>(map.getHeight()),
+      static_cast<uint32_t>(map.getTileWidth()),
+      static_cast<uint32_t>(map.getTileHeight())
+    };
+    h = TileDiskCache::hash(dims, sizeof(dims), h);
+    h = TileDiskCache::hash(&tag, sizeof(tag), h);
+
+    for(auto const& part: map.partitions_src)
+      h = TileDiskCache::hash(&part, sizeof(part), h);
+    for(auto const& part: map.partitions_dest)
+      h = TileDiskCache::hash(&part, sizeof(part), h);
+
+    // 0 is reserved for "unknown"
+    return h ? h : 1;
+  }
+
   //----------------------------------------------------------------------------
   ClientInfo::ClientInfo(IPCServer* ipc_server, WId wid):
     _dirty(~0),
@@ -24,7 +54,8 @@ namespace LinksRouting
     _window_info(wid),
     _minimized_icon(std::make_shared<LinkDescription::Node>()),
     _covered_outline(std::make_shared<LinkDescription::Node>()),
-    _avg_region_height(0)
+    _avg_region_height(0),
+    _num_url_reports(0)
   {
     _minimized_icon->set("filled", true);
     _minimized_icon->set("show-in-preview", false);
@@ -84,6 +115,14 @@ namespace LinksRouting
       // accessible
       scroll_region = QRect(QPoint(0,0), viewport.size());
 
+    const QString new_url = json.getValue<QString>("url", "");
+    if( new_url != url )
+    {
+      url = new_url;
+      _num_url_reports = 0;
+    }
+    _num_url_reports += 1;
+
     preview_size = scroll_region.size();
     _dirty |= SCROLL_POS | SCROLL_SIZE;
   }
@@ -436,9 +475,7 @@ namespace LinksRouting
     clear();
     if( true ) //_dirty & WINDOW )
     {
-      LinkDescription::points_t& icon = _minimized_icon->getVertices();
-      icon.clear();
-
+      LinkDescription::points_t icon;
       if(    create_hidden_vis
           && _window_info.minimized
           && !_window_info.title.contains("Airbus A300 - Wikipedia") )
@@ -455,6 +492,7 @@ namespace LinksRouting
         icon.push_back( pos );
         icon.push_back( pos + QPoint(ICON_SIZE, ICON_SIZE) );
         icon.push_back( pos + QPoint(ICON_SIZE,-ICON_SIZE) );
+        _minimized_icon->setVertices(icon);
 
         LinkDescription::points_t link_points(1);
         link_points[0] = pos += QPoint(0.7 * ICON_SIZE, 0);
@@ -473,6 +511,8 @@ namespace LinksRouting
             _nodes.front()->getParent()->get<std::string>("link-id")
           );
       }
+      else
+        _minimized_icon->setVertices(icon);
     }
 
     auto first_above = windows.find(_window_info.id);
@@ -677,9 +717,7 @@ namespace LinksRouting
       }
     }
 
-    LinkDescription::points_t& outline = _covered_outline->getVertices();
-    outline.clear();
-
+    LinkDescription::points_t outline;
     if(    create_hidden_vis
         && (_window_info.covered || num_covered)
         && !_window_info.minimized )
@@ -695,6 +733,7 @@ namespace LinksRouting
       outline.push_back(reg_title.topRight());
       outline.push_back(reg_title.bottomRight());
       outline.push_back(reg_title.bottomLeft());
+      _covered_outline->setVertices(outline);
 
 //        for(auto& node: _nodes)
 //          node->set("hidden", true);
@@ -713,6 +752,8 @@ namespace LinksRouting
         _outlines.back()->preview_valid = true;
       }
     }
+    else
+      _covered_outline->setVertices(outline);
 
     if( modified )
       _dirty |= VISIBLITY;
@@ -931,6 +972,13 @@ namespace LinksRouting
     tile_map->partitions_dest = partitions_dest;
     tile_map->margin_left = margin_left;
     tile_map->margin_right = margin_right;
+    // Clients do not report a content version, so tiles from the disk cache
+    // are only used for the first content seen for an url (in this or a
+    // previous session). Content reported again might have changed since then
+    // (and cached tiles would be outdated).
+    const bool use_disk_cache = _num_url_reports <= 1;
+    tile_map->persistent_id =
+      use_disk_cache ? persistentMapId(url, *tile_map, 0) : 0;
 
     for(auto& popup: _popups)
     {
@@ -948,6 +996,8 @@ namespace LinksRouting
       .push_back(float2(0, scroll_region.height()));
     tile_map_uncompressed->partitions_dest =
       tile_map_uncompressed->partitions_src;
+    tile_map_uncompressed->persistent_id =
+      use_disk_cache ? persistentMapId(url, *tile_map_uncompressed, 1) : 0;
 
     for(auto& preview: _xray_previews)
       preview->tile_map = tile_map_uncompressed;
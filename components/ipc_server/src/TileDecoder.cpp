@@ -0,0 +1,283 @@
+/*
+ * TileDecoder.cpp
+ *
+ *  Created on: 19.10.2026
+ */
+
+#include "TileDecoder.hpp"
+#include "log.hpp"
+#include "qt_helper.hxx"
+
+#include <QBuffer>
+#include <QImage>
+#include <QImageReader>
+#include <QMutexLocker>
+
+#include <zlib.h>
+
+#include <cstring>
+
+namespace LinksRouting
+{
+
+  //----------------------------------------------------------------------------
+  static uint32_t readUInt32(const QByteArray& msg, size_t pos)
+  {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(msg.constData()) + pos;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+  }
+
+  //----------------------------------------------------------------------------
+  TileDecoder::TileDecoder(QObject* parent):
+    QThread(parent),
+    _quit(false)
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  TileDecoder::~TileDecoder()
+  {
+    {
+      QMutexLocker lock(&_mutex);
+      _quit = true;
+    }
+    _cond_work.wakeAll();
+    wait();
+  }
+
+  //----------------------------------------------------------------------------
+  void TileDecoder::decode( const QByteArray& msg,
+                            QWebSocket* socket,
+                            uint32_t max_width,
+                            uint32_t max_height )
+  {
+    {
+      QMutexLocker lock(&_mutex);
+      _jobs.push_back(Job{msg, socket, max_width, max_height});
+    }
+    _cond_work.wakeOne();
+  }
+
+  //----------------------------------------------------------------------------
+  bool TileDecoder::getRequestId(const QByteArray& msg, uint32_t& req_id)
+  {
+    if(    static_cast<size_t>(msg.size()) < HEADER_SIZE
+        || static_cast<uint8_t>(msg.at(0)) != TILE_COMPRESSED )
+      return false;
+
+    req_id = readUInt32(msg, 4);
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  std::deque<TileDecoder::Result> TileDecoder::takeResults()
+  {
+    std::deque<Result> results;
+
+    QMutexLocker lock(&_mutex);
+    results.swap(_results);
+
+    return results;
+  }
+
+  //----------------------------------------------------------------------------
+  void TileDecoder::run()
+  {
+    QMutexLocker lock(&_mutex);
+    for(;;)
+    {
+      while( !_quit && _jobs.empty() )
+        _cond_work.wait(&_mutex);
+      if( _quit )
+        return;
+
+      Job job = _jobs.front();
+      _jobs.pop_front();
+
+      lock.unlock();
+
+      Result result = {job.socket, 0, false, nullptr, 0};
+      if( !decodeMessage(job, result) )
+        result.data.reset();
+      job.msg.clear();
+
+      lock.relock();
+      _results.push_back(std::move(result));
+
+      // Only notify once for a batch of tiles (the receiver takes all
+      // available results at once)
+      if( _jobs.empty() )
+        emit decoded();
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  bool TileDecoder::decodeMessage(const Job& job, Result& result)
+  {
+    const QByteArray& msg = job.msg;
+    if( msg.size() < 3 )
+      return false;
+
+    const uint8_t type = msg.at(0);
+    if( type == TILE_COMPRESSED )
+      return decodeCompressed(job, result);
+
+    if( type != TILE_RAW )
+    {
+      LOG_WARN("Invalid binary data!");
+      return false;
+    }
+
+    result.req_id = static_cast<uint8_t>(msg.at(1));
+    result.short_id = true;
+
+    if( (msg.size() - 2) % 4 )
+    {
+      LOG_WARN("Invalid size of raw tile (" << msg.size() << "byte)");
+      return false;
+    }
+
+    // Already RGBA, so just keep the message alive as long as the data is
+    // used. The data is never modified, so the message will not detach.
+    result.data = TileDataPtr(
+      reinterpret_cast<uint8_t*>(const_cast<char*>(msg.constData() + 2)),
+      [msg](uint8_t*){}
+    );
+    result.size = msg.size() - 2;
+
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool TileDecoder::decodeCompressed(const Job& job, Result& result)
+  {
+    const QByteArray& msg = job.msg;
+    if( static_cast<size_t>(msg.size()) < HEADER_SIZE )
+    {
+      LOG_WARN("Compressed tile too small (" << msg.size() << "byte)");
+      return false;
+    }
+
+    result.req_id = readUInt32(msg, 4);
+
+    const uint8_t format = msg.at(1);
+    const uint32_t width = readUInt32(msg, 8),
+                   height = readUInt32(msg, 12),
+                   stride = readUInt32(msg, 16);
+    const char* payload = msg.constData() + HEADER_SIZE;
+    const size_t payload_size = msg.size() - HEADER_SIZE;
+
+    // Never allocate more than required for the requested tile
+    if( !width || !height || width > job.max_width || height > job.max_height )
+    {
+      LOG_WARN( "Invalid tile size: " << width << "x" << height
+                << " (requested " << job.max_width << "x" << job.max_height
+                << ")" );
+      return false;
+    }
+
+    const size_t row_size = 4 * width;
+    result.size = row_size * height;
+
+    if( format == FORMAT_PNG )
+    {
+      // Only the PNG header is read to get the size, so images larger than
+      // the requested tile are rejected before allocating memory for them
+      QByteArray png = QByteArray::fromRawData(payload, payload_size);
+      QBuffer buffer(&png);
+      buffer.open(QIODevice::ReadOnly);
+
+      QImageReader reader(&buffer, "PNG");
+      const QSize png_size = reader.size();
+      if( !png_size.isValid() )
+      {
+        LOG_WARN("Failed to read PNG tile header.");
+        return false;
+      }
+
+      if(    static_cast<uint32_t>(png_size.width()) > job.max_width
+          || static_cast<uint32_t>(png_size.height()) > job.max_height )
+      {
+        LOG_WARN( "PNG tile too large: " << png_size.width() << "x"
+                  << png_size.height() << " (requested " << job.max_width
+                  << "x" << job.max_height << ")" );
+        return false;
+      }
+
+      if(    static_cast<uint32_t>(png_size.width()) != width
+          || static_cast<uint32_t>(png_size.height()) != height )
+      {
+        LOG_WARN("PNG tile size does not match header.");
+        return false;
+      }
+
+      QImage img;
+      if( !reader.read(&img) )
+      {
+        LOG_WARN("Failed to decode PNG tile: " << reader.errorString());
+        return false;
+      }
+
+      img = img.convertToFormat(QImage::Format_RGBA8888);
+      if( static_cast<size_t>(img.bytesPerLine()) == row_size )
+      {
+        // Use the image memory directly
+        result.data = TileDataPtr(
+          const_cast<uint8_t*>(img.constBits()),
+          [img](uint8_t*){}
+        );
+      }
+      else
+      {
+        result.data = TileDataPtr( new uint8_t[result.size],
+                                   std::default_delete<uint8_t[]>() );
+        for(uint32_t row = 0; row < height; ++row)
+          memcpy( result.data.get() + row * row_size,
+                  img.constScanLine(row),
+                  row_size );
+      }
+    }
+    else if( format == FORMAT_DEFLATE )
+    {
+      if( stride < row_size || stride > 4 * job.max_width )
+      {
+        LOG_WARN("Invalid tile stride: " << stride);
+        return false;
+      }
+
+      // Inflate directly into the tile data if rows are tightly packed
+      TileDataPtr buf( new uint8_t[stride * height],
+                       std::default_delete<uint8_t[]>() );
+      uLongf len = stride * height;
+      if(    uncompress( buf.get(), &len,
+                         reinterpret_cast<const Bytef*>(payload),
+                         payload_size ) != Z_OK
+          || len != stride * height )
+      {
+        LOG_WARN("Failed to inflate tile.");
+        return false;
+      }
+
+      if( stride == row_size )
+        result.data = buf;
+      else
+      {
+        result.data = TileDataPtr( new uint8_t[result.size],
+                                   std::default_delete<uint8_t[]>() );
+        for(uint32_t row = 0; row < height; ++row)
+          memcpy( result.data.get() + row * row_size,
+                  buf.get() + row * stride,
+                  row_size );
+      }
+    }
+    else
+    {
+      LOG_WARN("Unknown tile format: " << (int)format);
+      return false;
+    }
+
+    return true;
+  }
+
+} // namespace LinksRouting
@@ -0,0 +1,352 @@
+/*
+ * TileDiskCache.cpp
+ *
+ *  Created on: 19.10.2026
+ */
+
+#include "TileDiskCache.hpp"
+#include "log.hpp"
+
+#include <QDir>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+# include <fcntl.h>
+#endif
+
+namespace LinksRouting
+{
+  static const uint32_t SEGMENT_MAGIC = 0x47455354, // "TSEG"
+                        SEGMENT_VERSION = 1,
+                        RECORD_MAGIC = 0x454c4954; // "TILE"
+
+  struct SegmentHeader
+  {
+    uint32_t magic,
+             version;
+    uint64_t seq;
+  };
+
+  struct RecordHeader
+  {
+    uint32_t magic,
+             size;
+    uint64_t map_id;
+    uint32_t level,
+             x,
+             y,
+             data_crc,
+             header_crc,  ///< Checksum of all previous fields
+             reserved;
+  };
+
+  //----------------------------------------------------------------------------
+  static uint32_t checksum(const void* data, size_t size)
+  {
+    return crc32( crc32(0, Z_NULL, 0),
+                  static_cast<const Bytef*>(data),
+                  size );
+  }
+
+  //----------------------------------------------------------------------------
+  static size_t recordSize(size_t data_size)
+  {
+    // Keep records 8 byte aligned
+    return (sizeof(RecordHeader) + data_size + 7) & ~static_cast<size_t>(7);
+  }
+
+  //----------------------------------------------------------------------------
+  static bool preallocate(QFile& file, size_t size)
+  {
+    // Writing to pages of a memory mapped file without allocated blocks (eg.
+    // if the disk is full) raises SIGBUS, so allocate all blocks up front
+#ifdef Q_OS_UNIX
+    return posix_fallocate(file.handle(), 0, size) == 0;
+#else
+    const QByteArray zeros(1024 * 1024, 0);
+    for(size_t pos = 0; pos < size; pos += zeros.size())
+    {
+      const qint64 len = std::min<size_t>(zeros.size(), size - pos);
+      if( file.write(zeros.constData(), len) != len )
+        return false;
+    }
+    return file.flush();
+#endif
+  }
+
+  //----------------------------------------------------------------------------
+  TileDiskCache::TileDiskCache():
+    _segment_size(MAX_SEGMENT_SIZE),
+    _max_segments(0)
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  TileDiskCache::~TileDiskCache()
+  {
+    for(auto const& segment: _segments)
+      segment->file->unmap(segment->data);
+  }
+
+  //----------------------------------------------------------------------------
+  bool TileDiskCache::open(const QString& path, size_t max_size)
+  {
+    QDir dir(path);
+    if( !dir.mkpath(".") )
+    {
+      LOG_WARN("Failed to create tile cache directory: " << path);
+      return false;
+    }
+
+    _path = dir.absolutePath();
+
+    // Smaller segments for small caches, as at least two segments are used
+    _segment_size = max_size / 2;
+    if( _segment_size > MAX_SEGMENT_SIZE )
+      _segment_size = MAX_SEGMENT_SIZE;
+    else if( _segment_size < MIN_SEGMENT_SIZE )
+      _segment_size = MIN_SEGMENT_SIZE;
+    _max_segments = std::max<size_t>(max_size / _segment_size, 2);
+
+    if( max_size < 2 * _segment_size )
+      LOG_WARN( "Tile cache size too small, using "
+                << ((2 * _segment_size) >> 20) << " MiB." );
+
+    // Segment names contain their (zero padded) sequence number, so sorting
+    // by name gives the oldest segments first
+    const QStringList files = dir.entryList( QStringList("*.tiles"),
+                                             QDir::Files,
+                                             QDir::Name );
+    for(auto const& file_name: files)
+    {
+      bool ok = false;
+      const uint64_t seq = file_name.section('.', 0, 0).toULongLong(&ok, 16);
+
+      SegmentPtr segment = ok ? openSegment(dir.filePath(file_name), seq)
+                              : nullptr;
+      if( !segment )
+      {
+        LOG_WARN("Removing invalid tile cache segment: " << file_name);
+        dir.remove(file_name);
+        continue;
+      }
+
+      scanSegment(*segment);
+      _segments.push_back(std::move(segment));
+    }
+
+    while( _segments.size() > _max_segments )
+      removeOldestSegment();
+
+    LOG_INFO( "Tile cache: " << _index.size() << " tiles in "
+                             << _segments.size() << " segments" );
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  TileDataPtr TileDiskCache::get(const Key& key, size_t size)
+  {
+    auto loc = _index.find(key);
+    if( loc == _index.end() )
+      return nullptr;
+
+    if( loc->second.size != size )
+    {
+      // Same document, but tile size has changed
+      _index.erase(loc);
+      return nullptr;
+    }
+
+    const uchar* record = loc->second.segment->data + loc->second.offset;
+    const RecordHeader* header = reinterpret_cast<const RecordHeader*>(record);
+    const uchar* data = record + sizeof(RecordHeader);
+
+    if( checksum(data, size) != header->data_crc )
+    {
+      LOG_WARN("Corrupted tile in cache.");
+      _index.erase(loc);
+      return nullptr;
+    }
+
+    TileDataPtr copy(new uint8_t[size], std::default_delete<uint8_t[]>());
+    memcpy(copy.get(), data, size);
+    return copy;
+  }
+
+  //----------------------------------------------------------------------------
+  void TileDiskCache::put(const Key& key, const uint8_t* data, size_t size)
+  {
+    if( !isOpen() )
+      return;
+
+    const size_t record_size = recordSize(size);
+    if( sizeof(SegmentHeader) + record_size > _segment_size )
+      return;
+
+    Segment* segment = _segments.empty() ? nullptr : _segments.back().get();
+    if( !segment || segment->used + record_size > _segment_size )
+      segment = addSegment();
+    if( !segment )
+      return;
+
+    uchar* record = segment->data + segment->used;
+
+    // Write the data before the header, so that a record is only valid once
+    // it has been written completely
+    memcpy(record + sizeof(RecordHeader), data, size);
+
+    RecordHeader header;
+    header.magic = RECORD_MAGIC;
+    header.size = size;
+    header.map_id = key.map_id;
+    header.level = key.level;
+    header.x = key.x;
+    header.y = key.y;
+    header.data_crc = checksum(data, size);
+    header.header_crc = checksum(&header, offsetof(RecordHeader, header_crc));
+    header.reserved = 0;
+    memcpy(record, &header, sizeof(RecordHeader));
+
+    Location& loc = _index[key];
+    loc.segment = segment;
+    loc.offset = segment->used;
+    loc.size = size;
+
+    segment->used += record_size;
+  }
+
+  //----------------------------------------------------------------------------
+  uint64_t TileDiskCache::hash(const void* data, size_t size, uint64_t h)
+  {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for(size_t i = 0; i < size; ++i)
+    {
+      h ^= bytes[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  //----------------------------------------------------------------------------
+  TileDiskCache::SegmentPtr
+  TileDiskCache::openSegment(const QString& file_name, uint64_t seq)
+  {
+    SegmentPtr segment(new Segment);
+    segment->file.reset(new QFile(file_name));
+    segment->seq = seq;
+    segment->used = sizeof(SegmentHeader);
+
+    const bool create = !segment->file->exists();
+    if( !segment->file->open(QIODevice::ReadWrite) )
+      return nullptr;
+
+    if( create && !preallocate(*segment->file, _segment_size) )
+    {
+      segment->file->remove();
+      return nullptr;
+    }
+
+    if( static_cast<size_t>(segment->file->size()) != _segment_size )
+      return nullptr;
+
+    segment->data = segment->file->map(0, _segment_size);
+    if( !segment->data )
+      return nullptr;
+
+    SegmentHeader* header = reinterpret_cast<SegmentHeader*>(segment->data);
+    if( create )
+    {
+      header->magic = SEGMENT_MAGIC;
+      header->version = SEGMENT_VERSION;
+      header->seq = seq;
+    }
+    else if(    header->magic != SEGMENT_MAGIC
+             || header->version != SEGMENT_VERSION
+             || header->seq != seq )
+    {
+      segment->file->unmap(segment->data);
+      return nullptr;
+    }
+
+    return segment;
+  }
+
+  //----------------------------------------------------------------------------
+  void TileDiskCache::scanSegment(const Segment& segment)
+  {
+    size_t offset = sizeof(SegmentHeader);
+    while( offset + sizeof(RecordHeader) <= _segment_size )
+    {
+      const RecordHeader* header =
+        reinterpret_cast<const RecordHeader*>(segment.data + offset);
+
+      // Stop at the end of the written records (or an incomplete record)
+      if(    header->magic != RECORD_MAGIC
+          || header->header_crc != checksum( header,
+                                             offsetof(RecordHeader, header_crc) )
+          || offset + recordSize(header->size) > _segment_size )
+        break;
+
+      // Newer records replace older ones. The data is only checked once it is
+      // actually used.
+      const Key key = {header->map_id, header->level, header->x, header->y};
+      Location& loc = _index[key];
+      loc.segment = &segment;
+      loc.offset = offset;
+      loc.size = header->size;
+
+      offset += recordSize(header->size);
+    }
+
+    // Append new records after the last valid one
+    const_cast<Segment&>(segment).used = offset;
+  }
+
+  //----------------------------------------------------------------------------
+  TileDiskCache::Segment* TileDiskCache::addSegment()
+  {
+    while( _segments.size() >= _max_segments )
+      removeOldestSegment();
+
+    const uint64_t seq = _segments.empty() ? 1 : _segments.back()->seq + 1;
+    const QString file_name =
+      QString("%1.tiles").arg(seq, 16, 16, QChar('0'));
+
+    SegmentPtr segment = openSegment(QDir(_path).filePath(file_name), seq);
+    if( !segment )
+    {
+      LOG_WARN("Failed to create tile cache segment: " << file_name);
+      return nullptr;
+    }
+
+    _segments.push_back(std::move(segment));
+    return _segments.back().get();
+  }
+
+  //----------------------------------------------------------------------------
+  void TileDiskCache::removeOldestSegment()
+  {
+    if( _segments.empty() )
+      return;
+
+    const Segment* oldest = _segments.front().get();
+    for(auto loc = _index.begin(); loc != _index.end();)
+    {
+      if( loc->second.segment == oldest )
+        loc = _index.erase(loc);
+      else
+        ++loc;
+    }
+
+    _segments.front()->file->unmap(_segments.front()->data);
+    _segments.front()->file->remove();
+    _segments.pop_front();
+  }
+
+} // namespace LinksRouting
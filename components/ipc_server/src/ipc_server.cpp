@@ -11,6 +11,9 @@
 #include "ClientInfo.hxx"
 #include "JSONParser.h"
 #include "common/PreviewWindow.hpp"
+#include "TileDecoder.hpp"
+#include "TileDiskCache.hpp"
+#include "TileStore.hpp"
 
 #include <QMutex>
 #include <QWebSocket>
@@ -19,6 +22,7 @@
 #include <map>
 #include <tuple>
 #include <limits>
+#include <unordered_map>
 
 namespace LinksRouting
 {
@@ -66,21 +70,111 @@ namespace LinksRouting
       {
         QWebSocket* socket;
         HierarchicTileMapWeakPtr tile_map;
+        TileKey key;
         int zoom;
         size_t x, y;
         float2 tile_size;
-        clock::time_point time_stamp;
+        float priority;   ///< Distance to the visible region (lower first)
+        size_t frame;     ///< Last frame the tile has been visible
+        bool prefetch;    ///< Not yet visible, but probably required soon
+        bool sent;
+        clock::time_point time_stamp; ///< Time of sending
       };
 
-      typedef std::map<uint8_t, TileRequest> TileRequests;
+      typedef std::unordered_map<uint32_t, TileRequest> TileRequests;
+      typedef std::unordered_map<TileKey, uint32_t, TileKey::Hash> RequestIndex;
       TileRequests  _tile_requests;
-      uint8_t       _tile_request_id;
-      int           _new_request;
+      RequestIndex  _request_index;   ///< Request id for every requested tile
+      uint32_t      _tile_request_id;
+      size_t        _frame;
+      size_t        _prefetch_bytes;  ///< Size of all prefetch requests
 
+      /** Recent scrolling and zooming of a popup (for predicting tiles) */
+      struct Motion
+      {
+        float2 pos;               ///< Last position of the source region
+        int zoom;
+        float2 velocity;          ///< Scroll speed (pixels per second)
+        int zoom_dir;             ///< Direction of the last zoom change
+        clock::time_point time;   ///< Time of the last change
+      };
+      typedef std::unordered_map<const void*, Motion> Motions;
+      Motions       _motions;
+
+      /**
+       * Request all missing tiles of the given region. Requests for tiles of
+       * regions which are no longer updated (or are not visible anymore) are
+       * cancelled by the next call to sendRequests.
+       *
+       * @return Whether new requests have been queued
+       */
       bool updateTileMap( const HierarchicTileMapPtr& tile_map,
                           QWebSocket* socket,
                           const Rect& rect,
                           int zoom );
+
+      /**
+       * Update scroll and zoom velocity of the given popup (call after every
+       * scroll or zoom step).
+       */
+      void trackMotion(const SlotType::TextPopup::Popup& popup);
+      void resetMotion(const SlotType::TextPopup::Popup& popup);
+
+      /**
+       * Request tiles which will probably be required soon with low priority:
+       * neighbouring tiles (more of them in scroll direction) and the tiles of
+       * the next layer in zoom direction. The size of all prefetch requests is
+       * limited by the TilePrefetchMemory budget.
+       */
+      void prefetch( const SlotType::TextPopup::Popup& popup,
+                     QWebSocket* socket );
+
+      /** Start a new frame (every visible region needs to be updated again) */
+      void nextFrame();
+
+      /**
+       * Cancel outdated and timed out requests, and send queued requests in
+       * order of their priority (limited by the number of requests in flight
+       * per client).
+       *
+       * @return Whether requests are left which could be sent now
+       */
+      bool sendRequests();
+
+      /**
+       * Store received tile data for the request with the given id (or the
+       * lowest 8 bits of the id for legacy clients).
+       */
+      void setTileData( QWebSocket* socket,
+                        uint32_t req_id,
+                        bool short_id,
+                        const TileDataPtr& data,
+                        size_t size );
+
+      /** Remove all requests to the given client (eg. on disconnect) */
+      void removeRequests(QWebSocket* socket);
+
+      bool requestTiles( const HierarchicTileMapPtr& tile_map,
+                         QWebSocket* socket,
+                         const Rect& rect,
+                         int zoom,
+                         bool prefetch );
+
+      /**
+       * Try to load a tile from the disk cache.
+       *
+       * @return Whether the tile has been loaded
+       */
+      bool loadCachedTile( HierarchicTileMap& tile_map,
+                           size_t x, size_t y,
+                           int zoom,
+                           size_t size );
+      TileRequests::iterator findRequest( QWebSocket* socket,
+                                          uint32_t req_id,
+                                          bool short_id );
+      TileRequests::iterator removeRequest( TileRequests::iterator req,
+                                            bool notify_client );
+      void sendRequest(uint32_t req_id, const TileRequest& req);
   };
 
   //----------------------------------------------------------------------------
@@ -90,7 +184,8 @@ namespace LinksRouting
     _window_monitor(std::bind(&IPCServer::regionsChanged, this, _1)),
     _mutex_slot_links(mutex),
     _cond_data_ready(cond_data),
-    _dirty_flags(0)
+    _dirty_flags(0),
+    _tile_decoder(0)
   {
     //assert(widget);
     registerArg("DebugRegions", _debug_regions);
@@ -99,12 +194,21 @@ namespace LinksRouting
     registerArg("PreviewHeight", _preview_height = 400);
     registerArg("PreviewAutoWidth", _preview_auto_width = true);
     registerArg("OutsideSeeThrough", _outside_see_through = true);
+    registerArg("TileMemory", _tile_memory = 512);
+    registerArg("TileCompression", _tile_compression = 1);
+    registerArg("TileHotMemory", _tile_hot_memory = 128);
+    registerArg("TileFormat", _tile_format = "png");
+    registerArg("TileRequestsPerClient", _tile_requests_per_client = 4);
+    registerArg("TileRequestTimeout", _tile_request_timeout = 5000);
+    registerArg("TilePrefetchMemory", _tile_prefetch_memory = 16);
+    registerArg("TileDiskCache", _tile_disk_cache_path);
+    registerArg("TileDiskCacheSize", _tile_disk_cache_size = 1024);
   }
 
   //----------------------------------------------------------------------------
   IPCServer::~IPCServer()
   {
-
+    TileStore::getInstance().setResultCallback(nullptr);
   }
 
   //----------------------------------------------------------------------------
@@ -131,9 +235,13 @@ namespace LinksRouting
     _subscribe_user_config =
       slot_subscriber.getSlot<LinksRouting::Config*>("/user-config");
     assert(_subscribe_user_config->_data.get());
+    _subscribe_metrics =
+      slot_subscriber.getSlot<SlotType::Metrics>("/metrics");
 
     _subscribe_desktop_rect =
       slot_subscriber.getSlot<Rect>("/desktop/rect");
+    _subscribe_desktop_damage =
+      slot_subscriber.getSlot<SlotType::Damage>("/desktop/damage");
 
     _subscribe_mouse =
       slot_subscriber.getSlot<LinksRouting::SlotType::MouseEvent>("/mouse");
@@ -170,6 +278,40 @@ namespace LinksRouting
   //----------------------------------------------------------------------------
   void IPCServer::init()
   {
+    TileStore& tile_store = TileStore::getInstance();
+    tile_store.setBudget( static_cast<size_t>(std::max(_tile_memory, 1)) << 20 );
+    tile_store.setCompression(
+      _tile_compression,
+      static_cast<size_t>(std::max(_tile_hot_memory, 0)) << 20
+    );
+
+    // (De)compressed tiles are applied with the next call to process
+    tile_store.setResultCallback([this]()
+    {
+      QMetaObject::invokeMethod( this,
+                                 "onTileStoreResults",
+                                 Qt::QueuedConnection );
+    });
+
+    _tile_decoder = new TileDecoder(this);
+    connect( _tile_decoder, &TileDecoder::decoded,
+             this, &IPCServer::onTilesDecoded );
+    _tile_decoder->start();
+
+    // Timed out requests are only detected while processing
+    _tile_timeout_timer.setSingleShot(true);
+    connect( &_tile_timeout_timer, &QTimer::timeout,
+             this, &IPCServer::dirtyProcess );
+
+    if( !_tile_disk_cache_path.empty() )
+    {
+      _tile_disk_cache.reset(new TileDiskCache);
+      if( !_tile_disk_cache->open(
+            QString::fromStdString(_tile_disk_cache_path),
+            static_cast<size_t>(std::max(_tile_disk_cache_size, 0)) << 20 ) )
+        _tile_disk_cache.reset();
+    }
+
     int port = 4487;
     _server = new QWebSocketServer(
       QStringLiteral("Hidden Content Server"),
@@ -213,59 +355,15 @@ namespace LinksRouting
       _debug_full_preview_path.clear();
     }
 
-    if( _tile_handler->_new_request > 0 )
-      --_tile_handler->_new_request;
-    else
-    {
-      int allowed_request = 6;
-      for(auto req =  _tile_handler->_tile_requests.rbegin();
-               req != _tile_handler->_tile_requests.rend();
-             ++req )
-      {
-        if( !req->second.socket )
-          continue;
-
-        HierarchicTileMapPtr tile_map = req->second.tile_map.lock();
-        if( !tile_map )
-        {
-          // TODO req = _tile_handler->_tile_requests.erase(req);
-          continue;
-        }
-
-        float scale = 1/tile_map->getLayerScale(req->second.zoom);
-        Rect src( float2( req->second.x * tile_map->getTileWidth(),
-                          req->second.y * tile_map->getTileHeight() ),
-                  req->second.tile_size );
-        src *= scale;
-        src.pos.x += tile_map->margin_left;
-
-        std::cout << "request tile " << src.toString(true) << std::endl;
-        req->second.socket->sendTextMessage(QString(
-        "{"
-          "\"task\": \"GET\","
-          "\"id\": \"preview-tile\","
-          "\"size\": [" + QString::number(req->second.tile_size.x)
-                  + "," + QString::number(req->second.tile_size.y)
-                  + "],"
-          "\"sections_src\":" + to_string(tile_map->partitions_src).c_str() + ","
-          "\"sections_dest\":" + to_string(tile_map->partitions_dest).c_str() + ","
-          "\"src\": " + src.toString(true).c_str() + ","
-          "\"req_id\": " + QString::number(req->first) +
-        "}"));
-
-        req->second.socket = 0;
-        if( --allowed_request <= 0 )
-          break;
-      }
-    }
-
     static clock::time_point last_time = clock::now();
     clock::time_point now = clock::now();
     auto dur_us = std::chrono::duration_cast<std::chrono::microseconds>
     (
       now - last_time
     ).count();
-    double dt = dur_us / 1000000.;
+    // Processing stops if nothing changes, so limit the time step to not skip
+    // animations started after an idle period.
+    double dt = std::min(dur_us / 1000000., 0.1);
     last_time = now;
 
     auto updatePopup = [&](SlotType::AnimatedPopup& popup) -> uint32_t
@@ -285,16 +383,27 @@ namespace LinksRouting
       return flags;
     };
 
+    // Apply finished (de)compressions, and update the tiles requested for all
+    // visible regions (including tiles evicted from the store)
+    TileStore::getInstance().update();
+    _tile_handler->nextFrame();
+
     foreachPopup
     (
-      [&](SlotType::TextPopup::Popup& popup, QWebSocket&, ClientInfo&) -> bool
+      [&]( SlotType::TextPopup::Popup& popup,
+           QWebSocket& socket,
+           ClientInfo& ) -> bool
       {
         if( popup.node )
         {
+          const bool was_visible = popup.region.isVisible();
           if( popup.node->get<bool>("hidden") )
             popup.region.hide();
           else if( !popup.text.empty() )
             popup.region.show();
+
+          if( popup.region.isVisible() != was_visible )
+            _dirty_flags |= RENDER_DIRTY | MASK_DIRTY;
         }
         _dirty_flags |= updatePopup(popup.hover_region);
 
@@ -303,10 +412,18 @@ namespace LinksRouting
           if( !popup.preview )
             popup.preview = _subscribe_previews->_data->getWindow(&popup);
 
+          _tile_handler->updateTileMap( popup.hover_region.tile_map.lock(),
+                                        &socket,
+                                        popup.hover_region.src_region,
+                                        popup.hover_region.zoom );
+          _tile_handler->prefetch(popup, &socket);
+
           popup.preview->update(dt);
         }
         else
         {
+          _tile_handler->resetMotion(popup);
+
           if( popup.preview )
           {
             popup.preview->release();
@@ -322,8 +439,9 @@ namespace LinksRouting
     Rect preview_region;
     foreachPreview
     (
-      [&](SlotType::XRayPopup::HoverRect& preview, QWebSocket&, ClientInfo&)
-         -> bool
+      [&]( SlotType::XRayPopup::HoverRect& preview,
+           QWebSocket& socket,
+           ClientInfo& ) -> bool
       {
         _dirty_flags |= updatePopup(preview);
         if( preview.getAlpha() > (preview.isFadeIn() ? 0.9 : 0.3) )
@@ -338,6 +456,11 @@ namespace LinksRouting
           if( !preview.preview )
             preview.preview = _subscribe_previews->_data->getWindow(&preview);
 
+          _tile_handler->updateTileMap( preview.tile_map.lock(),
+                                        &socket,
+                                        preview.source_region,
+                                        -1 );
+
           preview.preview->update(dt);
         }
         else
@@ -360,8 +483,15 @@ namespace LinksRouting
     if( changed )
       _dirty_flags |= LINKS_DIRTY;
 
+    const bool tiles_pending = _tile_handler->sendRequests();
+
     uint32_t flags = _dirty_flags;
     _dirty_flags = 0;
+
+    // Send remaining tile requests with the next call
+    if( tiles_pending )
+      flags |= PROCESS_DIRTY;
+
     return flags;
   }
 
@@ -659,6 +789,13 @@ namespace LinksRouting
               + QString::fromStdString(history).replace('"', "\\\"")
               + "\"";
         }
+        else if( id == "/metrics" || id.startsWith("/metrics/") )
+        {
+          val = QString::fromStdString
+          (
+            _subscribe_metrics->_data->toJSON( to_string(id.mid(9)) )
+          );
+        }
         else
         {
           std::string val_std;
@@ -824,59 +961,75 @@ namespace LinksRouting
       return;
     }
 
-    uint8_t type = data.at(0),
-            seq_id = data.at(1);
-
     std::cout << "Binary data received: "
               << ((data.size() / 1024) / 1024.f) << "MB"
-              << " type=" << (int)type
-              << " seq=" << (int)seq_id << std::endl;
+              << " type=" << (int)data.at(0) << std::endl;
 
-    QMutexLocker lock_links(_mutex_slot_links);
+    QWebSocket* socket = qobject_cast<QWebSocket*>(sender());
 
-    if( type != 1 )
+    // Compressed tiles can not be larger than the requested tile, so the
+    // decoder does not need to trust the size given in the message header
+    uint32_t req_id = 0,
+             max_width = 0,
+             max_height = 0;
+    if( TileDecoder::getRequestId(data, req_id) )
     {
-      LOG_WARN("Invalid binary data!");
-      return;
-    }
+      QMutexLocker lock_links(_mutex_slot_links);
+      auto request = _tile_handler->findRequest(socket, req_id, false);
+      if( request == _tile_handler->_tile_requests.end() )
+      {
+        LOG_WARN("Received unknown tile request #" << req_id);
+        return;
+      }
 
-    auto request = _tile_handler->_tile_requests.find(seq_id);
-    if( request == _tile_handler->_tile_requests.end() )
-    {
-      LOG_WARN("Received unknown tile request.");
-      return;
+      max_width = static_cast<uint32_t>(request->second.tile_size.x);
+      max_height = static_cast<uint32_t>(request->second.tile_size.y);
     }
 
-    auto req_ms =
-      std::chrono::duration_cast<std::chrono::milliseconds>
-      (
-        clock::now() - request->second.time_stamp
-      ).count();
+    // Validate and decode on the decoder thread and continue in
+    // onTilesDecoded
+    _tile_decoder->decode(data, socket, max_width, max_height);
+  }
 
-    std::cout << "request #" << (int)seq_id << " " << req_ms << "ms"
-              << std::endl;
+  //----------------------------------------------------------------------------
+  void IPCServer::onTilesDecoded()
+  {
+    std::deque<TileDecoder::Result> results = _tile_decoder->takeResults();
+    if( results.empty() )
+      return;
 
-    HierarchicTileMapPtr tile_map = request->second.tile_map.lock();
-    if( !tile_map )
+    // Only lock for publishing a single tile at once, so that rendering and
+    // input handling are not blocked by bursts of tiles
+    for(auto const& result: results)
     {
-      LOG_WARN("Received tile request for expired map.");
-      _tile_handler->_tile_requests.erase(request);
-      return;
+      QMutexLocker lock_links(_mutex_slot_links);
+      _tile_handler->setTileData( result.socket,
+                                  result.req_id,
+                                  result.short_id,
+                                  result.data,
+                                  result.size );
     }
+  }
 
-    tile_map->setTileData( request->second.x,
-                           request->second.y,
-                           request->second.zoom,
-                           data.constData() + 2,
-                           data.size() - 2 );
+  //----------------------------------------------------------------------------
+  void IPCServer::onTileStoreResults()
+  {
+    dirtyProcess();
+  }
 
-    QImage img( (const uchar*)data.constData() + 2,
-                request->second.tile_size.x,
-                request->second.tile_size.y,
-                QImage::Format_ARGB32 );
-    img.save( QString("tile-%1-%2").arg(request->second.x).arg(request->second.y));
+  //----------------------------------------------------------------------------
+  QString IPCServer::getTileFormat(QWebSocket* socket) const
+  {
+    const QString format = QString::fromStdString(_tile_format);
+    if( format == "raw" )
+      return format;
 
-    dirtyRender();
+    auto client = _clients.find(socket);
+    if(    client == _clients.end()
+        || !client->second->supportsCommand("tile-" + format) )
+      return "raw";
+
+    return format;
   }
 
   //----------------------------------------------------------------------------
@@ -886,6 +1039,11 @@ namespace LinksRouting
     if( !socket )
       return;
 
+    {
+      QMutexLocker lock_links(_mutex_slot_links);
+      _tile_handler->removeRequests(socket);
+    }
+
     _clients.erase(socket);
     socket->deleteLater();
 
@@ -976,6 +1134,39 @@ namespace LinksRouting
   void IPCServer::regionsChanged(const WindowRegions& regions)
   {
     _window_monitor.setDesktopRect( desktopRect().toQRect() );
+
+    // Report old and new region of every moved, resized, shown or hidden
+    // window as damaged.
+    std::map<WId, QRect> windows;
+    for(auto win = regions.begin(); win != regions.end(); ++win)
+      if( !win->minimized )
+        windows[ win->id ] = win->region;
+
+    const QPoint desktop_offset = desktopRect().toQRect().topLeft();
+    auto addDamage = [&](const QRect& region)
+    {
+      _subscribe_desktop_damage->_data->add(region.translated(-desktop_offset));
+    };
+
+    for(auto win = windows.begin(); win != windows.end(); ++win)
+    {
+      auto old_win = _damage_windows.find(win->first);
+      if( old_win == _damage_windows.end() )
+        addDamage(win->second);
+      else if( old_win->second != win->second )
+      {
+        addDamage(old_win->second);
+        addDamage(win->second);
+      }
+    }
+    for(auto old_win = _damage_windows.begin();
+             old_win != _damage_windows.end();
+           ++old_win )
+      if( windows.find(old_win->first) == windows.end() )
+        addDamage(old_win->second);
+
+    _damage_windows.swap(windows);
+
     _mutex_slot_links->lock();
 
     bool need_update = true; // TODO update checks to also detect eg. changes in
@@ -1471,7 +1662,11 @@ namespace LinksRouting
       else if( reg.isVisible() )
       {
         if( !popup.hover_region.isFadeOut() )
+        {
+          // Needs frames to run the timeout and fade out
           popup.hover_region.delayedFadeOut();
+          return true;
+        }
         else
           // timeout already started, so store to be able hiding if other
           // popup is shown before hiding this one.
@@ -1480,6 +1675,7 @@ namespace LinksRouting
       else if( reg.isFadeIn() )
       {
         reg.hide();
+        return true;
       }
 
       return false;
@@ -1514,11 +1710,15 @@ namespace LinksRouting
       else if( preview.isVisible() )
       {
         if( !preview.isFadeOut() && !preview_visible )
+        {
           preview.delayedFadeOut();
+          return true;
+        }
       }
       else if( preview.isFadeIn() )
       {
         preview.hide();
+        return true;
       }
 
       return false;
@@ -1554,6 +1754,7 @@ namespace LinksRouting
         popup.hover_region.src_region.pos.y -=
           delta / fabs(static_cast<float>(delta)) * 20 * step_y;
         changed |= _tile_handler->updateRegion(popup);
+        _tile_handler->trackMotion(popup);
       }
       else if( mod & SlotType::MouseEvent::ControlModifier )
       {
@@ -1561,6 +1762,7 @@ namespace LinksRouting
         popup.hover_region.src_region.pos.x -=
           delta / fabs(static_cast<float>(delta)) * 20 * step_x;
         changed |= _tile_handler->updateRegion(popup);
+        _tile_handler->trackMotion(popup);
       }
       else
       {
@@ -1587,6 +1789,7 @@ namespace LinksRouting
           if( old_region != popup.hover_region.region )
             _dirty_flags |= MASK_DIRTY;
 
+          _tile_handler->trackMotion(popup);
           changed = true;
         }
       }
@@ -1620,7 +1823,9 @@ namespace LinksRouting
       float step_x = step_y * preview_aspect;
       popup.hover_region.src_region.pos.x -= delta.x * step_x;
 
-      return _tile_handler->updateRegion(popup);
+      bool changed = _tile_handler->updateRegion(popup);
+      _tile_handler->trackMotion(popup);
+      return changed;
     }) )
       dirtyRender();
   }
@@ -1719,6 +1924,7 @@ namespace LinksRouting
   {
     _dirty_flags |= LINKS_DIRTY | RENDER_DIRTY | MASK_DIRTY;
     _cond_data_ready->wakeAll();
+    emit dirty(_dirty_flags);
   }
 
   //----------------------------------------------------------------------------
@@ -1726,6 +1932,13 @@ namespace LinksRouting
   {
     _dirty_flags |= RENDER_DIRTY;
     _cond_data_ready->wakeAll();
+    emit dirty(_dirty_flags);
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::dirtyProcess()
+  {
+    emit dirty(_dirty_flags | PROCESS_DIRTY);
   }
 
   //----------------------------------------------------------------------------
@@ -1761,7 +1974,8 @@ namespace LinksRouting
   IPCServer::TileHandler::TileHandler(IPCServer* ipc_server):
     _ipc_server(ipc_server),
     _tile_request_id(0),
-    _new_request(0)
+    _frame(0),
+    _prefetch_bytes(0)
   {
 
   }
@@ -1869,47 +2083,525 @@ namespace LinksRouting
       return false;
     }
 
-    bool sent = false;
-    MapRect rect = tile_map->requestRect(src, zoom);
-    rect.foreachTile([&](Tile& tile, size_t x, size_t y)
+    return requestTiles(tile_map, socket, src, zoom, false);
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::trackMotion(
+    const SlotType::TextPopup::Popup& popup
+  )
+  {
+    const clock::time_point now = clock::now();
+    const float2& pos = popup.hover_region.src_region.pos;
+    const int zoom = popup.hover_region.zoom;
+
+    auto motion = _motions.find(&popup);
+    if( motion == _motions.end() )
+    {
+      Motion m = {pos, zoom, float2(0, 0), 0, now};
+      _motions[&popup] = m;
+      return;
+    }
+
+    Motion& m = motion->second;
+    if( zoom != m.zoom )
     {
-      if( tile.type == Tile::NONE )
+      m.zoom_dir = zoom > m.zoom ? 1 : -1;
+      m.velocity = float2(0, 0);
+    }
+    else
+    {
+      const float dt = std::chrono::duration<float>(now - m.time).count();
+      if( dt > 0 )
       {
-        auto req = std::find_if
-        (
-          _tile_requests.begin(),
-          _tile_requests.end(),
-          //TODO VS FIX
-          [&](const std::map<uint8_t, TileRequest>::value_type& tile_req)
-          //[&](const TileRequests::value_type& tile_req)
-          {
-            return (tile_req.second.tile_map.lock() == tile_map)
-                && (tile_req.second.zoom == zoom)
-                && (tile_req.second.x == x)
-                && (tile_req.second.y == y);
-          }
-        );
+        // Smooth over a few steps, but start over after a pause
+        const float2 velocity = (pos - m.pos) / dt;
+        m.velocity = dt > 0.5f ? velocity : 0.5f * (m.velocity + velocity);
+      }
+    }
 
-        if( req != _tile_requests.end() )
-          // already sent
-          return;
+    m.pos = pos;
+    m.zoom = zoom;
+    m.time = now;
+  }
 
-        TileRequest tile_req = {
-          socket,
-          tile_map,
-          zoom,
-          x, y,
-          float2(tile.width, tile.height),
-          clock::now()
-        };
-        uint8_t req_id = ++_tile_request_id;
-        _tile_requests[req_id] = tile_req;
-        sent = true;
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::resetMotion(
+    const SlotType::TextPopup::Popup& popup
+  )
+  {
+    _motions.erase(&popup);
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::prefetch( const SlotType::TextPopup::Popup& popup,
+                                         QWebSocket* socket )
+  {
+    HierarchicTileMapPtr tile_map = popup.hover_region.tile_map.lock();
+    if( !tile_map || !_ipc_server->_tile_prefetch_memory )
+      return;
+
+    const Rect& src = popup.hover_region.src_region;
+    const float2& scroll_size = popup.hover_region.scroll_region.size;
+    const int zoom = popup.hover_region.zoom;
+
+    float2 velocity;
+    int zoom_dir = 0;
+    auto motion = _motions.find(&popup);
+    if( motion != _motions.end() )
+    {
+      const float age =
+        std::chrono::duration<float>(clock::now() - motion->second.time)
+        .count();
+      if( age < 0.5f )
+        velocity = motion->second.velocity;
+      zoom_dir = motion->second.zoom_dir;
+    }
+
+    // Size of a tile in source region coordinates
+    const float scale = 1 / tile_map->getLayerScale(zoom);
+    const float2 tile_size( scale * tile_map->getTileWidth(),
+                            scale * tile_map->getTileHeight() );
+
+    // One ring of neighbouring tiles, extended in scroll direction by the
+    // distance scrolled within the next half second (but at most 4 tiles)
+    float2 ahead = 0.5f * velocity;
+    clamp<float>(ahead.x, -4 * tile_size.x, 4 * tile_size.x);
+    clamp<float>(ahead.y, -4 * tile_size.y, 4 * tile_size.y);
+
+    float l = src.l() - tile_size.x + std::min(ahead.x, 0.f),
+          t = src.t() - tile_size.y + std::min(ahead.y, 0.f),
+          r = src.r() + tile_size.x + std::max(ahead.x, 0.f),
+          b = src.b() + tile_size.y + std::max(ahead.y, 0.f);
+    clamp<float>(l, 0, scroll_size.x);
+    clamp<float>(t, 0, scroll_size.y);
+    clamp<float>(r, l, scroll_size.x);
+    clamp<float>(b, t, scroll_size.y);
+
+    requestTiles( tile_map,
+                  socket,
+                  Rect(float2(l, t), float2(r - l, b - t)),
+                  zoom,
+                  true );
+
+    if( !zoom_dir )
+      return;
+
+    // Same region at the next zoom level (in the direction of the last zoom
+    // change)
+    const int max_zoom = log2( scroll_size.y
+                             / _ipc_server->_preview_height
+                             / 0.9 ) + 0.7;
+    const int next_zoom = zoom + zoom_dir;
+    if( next_zoom < 0 || next_zoom > max_zoom )
+      return;
+
+    const float2 next_size = std::pow(2.f, static_cast<float>(-zoom_dir))
+                           * src.size;
+    float2 next_pos = src.pos + 0.5f * (src.size - next_size);
+    clamp<float>(next_pos.x, 0, std::max(scroll_size.x - next_size.x, 0.f));
+    clamp<float>(next_pos.y, 0, std::max(scroll_size.y - next_size.y, 0.f));
+
+    requestTiles( tile_map,
+                  socket,
+                  Rect(next_pos, next_size),
+                  next_zoom,
+                  true );
+  }
+
+  //----------------------------------------------------------------------------
+  bool IPCServer::TileHandler::requestTiles(
+    const HierarchicTileMapPtr& tile_map,
+    QWebSocket* socket,
+    const Rect& src,
+    int zoom,
+    bool prefetch )
+  {
+    if( !socket )
+      return false;
+
+    const size_t prefetch_budget =
+      static_cast<size_t>(std::max(_ipc_server->_tile_prefetch_memory, 0))
+      << 20;
+
+    const MapRect rect = tile_map->requestRect(src, zoom);
+    const float2 tile_size( tile_map->getTileWidth(),
+                            tile_map->getTileHeight() );
+    const float2 center( 0.5f * (rect.min[0] + rect.max[0]),
+                         0.5f * (rect.min[1] + rect.max[1]) );
+
+    // Tiles are stored (from the disk cache) only after visiting all tiles, as
+    // storing might modify the map
+    std::vector<TileRequest> new_requests;
+    rect.foreachTile([&](Tile& tile, size_t x, size_t y)
+    {
+      if( tile.type != Tile::NONE )
+        return;
+
+      // Load tiles from the center of the visible region first, and visible
+      // tiles before prefetched ones
+      const float2 offset( ((x + 0.5f) * tile_size.x - center.x) / tile_size.x,
+                           ((y + 0.5f) * tile_size.y - center.y) / tile_size.y );
+      const float priority = offset.length() + (prefetch ? 1000 : 0);
+      const size_t bytes = 4 * tile.width * tile.height;
+
+      const TileKey key = {
+        tile_map->getId(),
+        HierarchicTileMap::getLevel(zoom),
+        x, y
+      };
+
+      auto index = _request_index.find(key);
+      if( index != _request_index.end() )
+      {
+        // Already requested (maybe by another region showing the same tile)
+        TileRequest& req = _tile_requests.at(index->second);
+        if( req.prefetch && !prefetch )
+        {
+          // Prefetched tile has become visible
+          req.prefetch = false;
+          _prefetch_bytes -= bytes;
+        }
+        else if( !req.prefetch && prefetch && req.frame != _frame )
+        {
+          // Previously visible tile is now only prefetched
+          req.prefetch = true;
+          _prefetch_bytes += bytes;
+        }
+
+        if( req.frame != _frame || priority < req.priority )
+          req.priority = priority;
+        req.frame = _frame;
+        return;
       }
+
+      new_requests.push_back(TileRequest{
+        socket,
+        tile_map,
+        key,
+        zoom,
+        x, y,
+        float2(tile.width, tile.height),
+        priority,
+        _frame,
+        prefetch,
+        false,
+        clock::now()
+      });
     });
-    if( sent )
-      _new_request = 2;
-    return sent;
+
+    bool added = false,
+         loaded = false;
+    for(auto const& req: new_requests)
+    {
+      const size_t bytes = 4 * req.tile_size.x * req.tile_size.y;
+      if( loadCachedTile(*tile_map, req.x, req.y, req.zoom, bytes) )
+      {
+        loaded = true;
+        continue;
+      }
+
+      if( prefetch && _prefetch_bytes + bytes > prefetch_budget )
+        continue;
+
+      const uint32_t req_id = ++_tile_request_id;
+      _tile_requests[req_id] = req;
+      _request_index[req.key] = req_id;
+      if( prefetch )
+        _prefetch_bytes += bytes;
+      added = true;
+    }
+
+    if( loaded )
+      _ipc_server->dirtyRender();
+    if( added )
+      _ipc_server->dirtyProcess();
+    return added;
+  }
+
+  //----------------------------------------------------------------------------
+  bool IPCServer::TileHandler::loadCachedTile( HierarchicTileMap& tile_map,
+                                               size_t x, size_t y,
+                                               int zoom,
+                                               size_t size )
+  {
+    if( !_ipc_server->_tile_disk_cache || !tile_map.persistent_id )
+      return false;
+
+    const TileDiskCache::Key key = {
+      tile_map.persistent_id,
+      static_cast<uint32_t>(HierarchicTileMap::getLevel(zoom)),
+      static_cast<uint32_t>(x),
+      static_cast<uint32_t>(y)
+    };
+    TileDataPtr data = _ipc_server->_tile_disk_cache->get(key, size);
+    if( !data )
+      return false;
+
+    tile_map.setTileData(x, y, zoom, data, size);
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::nextFrame()
+  {
+    ++_frame;
+  }
+
+  //----------------------------------------------------------------------------
+  bool IPCServer::TileHandler::sendRequests()
+  {
+    const clock::time_point now = clock::now();
+    const auto timeout =
+      std::chrono::milliseconds(_ipc_server->_tile_request_timeout);
+
+    std::map<QWebSocket*, int> in_flight;
+    std::vector<TileRequests::iterator> queued;
+    bool timed_out = false,
+         more_queued = false;
+    clock::time_point oldest_sent = clock::time_point::max();
+
+    for(auto req = _tile_requests.begin(); req != _tile_requests.end();)
+    {
+      const TileRequest& r = req->second;
+
+      // Not visible since the last frame (tile requests are updated every
+      // frame for visible regions)
+      if( r.tile_map.expired() || r.frame + 1 < _frame )
+      {
+        req = removeRequest(req, r.sent);
+        continue;
+      }
+
+      // Probably lost, so request again with the next frame
+      if( r.sent && now - r.time_stamp > timeout )
+      {
+        LOG_WARN("Tile request #" << req->first << " timed out.");
+        req = removeRequest(req, true);
+        timed_out = true;
+        continue;
+      }
+
+      if( r.sent )
+      {
+        in_flight[ r.socket ] += 1;
+        oldest_sent = std::min(oldest_sent, r.time_stamp);
+      }
+      else
+        queued.push_back(req);
+      ++req;
+    }
+
+    std::sort
+    (
+      queued.begin(),
+      queued.end(),
+      [](const TileRequests::iterator& lhs, const TileRequests::iterator& rhs)
+      {
+        return lhs->second.priority < rhs->second.priority;
+      }
+    );
+
+    // Also limit the requests sent at once, to not congest the clients
+    int allowed_requests = 6;
+    for(auto const& req: queued)
+    {
+      int& num_in_flight = in_flight[ req->second.socket ];
+      if( num_in_flight >= _ipc_server->_tile_requests_per_client )
+        // Will be sent once a request of this client has been answered
+        continue;
+
+      if( allowed_requests <= 0 )
+      {
+        more_queued = true;
+        break;
+      }
+
+      sendRequest(req->first, req->second);
+      req->second.sent = true;
+      req->second.time_stamp = now;
+      oldest_sent = std::min(oldest_sent, now);
+
+      ++num_in_flight;
+      --allowed_requests;
+    }
+
+    // Processing only runs on demand, so make sure to check again once the
+    // oldest request in flight times out
+    QTimer& timer = _ipc_server->_tile_timeout_timer;
+    if( oldest_sent == clock::time_point::max() )
+      timer.stop();
+    else
+      timer.start
+      (
+        static_cast<int>
+        (
+          std::chrono::duration_cast<std::chrono::milliseconds>
+          (
+            oldest_sent + timeout - now
+          ).count() + 1
+        )
+      );
+
+    return timed_out || more_queued;
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::setTileData( QWebSocket* socket,
+                                            uint32_t req_id,
+                                            bool short_id,
+                                            const TileDataPtr& data,
+                                            size_t size )
+  {
+    auto request = findRequest(socket, req_id, short_id);
+    if( request == _tile_requests.end() )
+    {
+      LOG_WARN("Received unknown tile request #" << req_id);
+      return;
+    }
+
+    // Free the slot for the next request of this client in any case
+    _ipc_server->dirtyProcess();
+
+    if( !data )
+    {
+      // Tile is still empty, so it will be requested again once required
+      LOG_WARN("Failed to decode tile #" << request->first);
+      removeRequest(request, false);
+      return;
+    }
+
+    auto req_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>
+      (
+        clock::now() - request->second.time_stamp
+      ).count();
+
+    std::cout << "request #" << request->first << " " << req_ms << "ms"
+              << std::endl;
+
+    const TileRequest req = request->second;
+    removeRequest(request, false);
+
+    HierarchicTileMapPtr tile_map = req.tile_map.lock();
+    if( !tile_map )
+    {
+      LOG_WARN("Received tile request for expired map.");
+      return;
+    }
+
+    const size_t expected_size = 4 * req.tile_size.x * req.tile_size.y;
+    if( size != expected_size )
+    {
+      LOG_WARN( "Invalid tile data size (" << size << " instead of "
+                                           << expected_size << "byte)" );
+      return;
+    }
+
+    tile_map->setTileData(req.x, req.y, req.zoom, data, size);
+
+    if( _ipc_server->_tile_disk_cache && tile_map->persistent_id )
+    {
+      const TileDiskCache::Key key = {
+        tile_map->persistent_id,
+        static_cast<uint32_t>(HierarchicTileMap::getLevel(req.zoom)),
+        static_cast<uint32_t>(req.x),
+        static_cast<uint32_t>(req.y)
+      };
+      _ipc_server->_tile_disk_cache->put(key, data.get(), size);
+    }
+
+    _ipc_server->dirtyRender();
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::removeRequests(QWebSocket* socket)
+  {
+    for(auto req = _tile_requests.begin(); req != _tile_requests.end();)
+    {
+      if( req->second.socket == socket )
+        req = removeRequest(req, false);
+      else
+        ++req;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  IPCServer::TileHandler::TileRequests::iterator
+  IPCServer::TileHandler::findRequest( QWebSocket* socket,
+                                       uint32_t req_id,
+                                       bool short_id )
+  {
+    if( !short_id )
+      return _tile_requests.find(req_id);
+
+    // Legacy clients only send the lowest 8 bits of the id, which is still
+    // unique as long as less than 256 requests per client are in flight.
+    auto match = _tile_requests.end();
+    for(auto req = _tile_requests.begin(); req != _tile_requests.end(); ++req)
+    {
+      if(    !req->second.sent
+          || req->second.socket != socket
+          || (req->first & 0xff) != req_id )
+        continue;
+
+      if( match == _tile_requests.end() || req->first > match->first )
+        match = req;
+    }
+    return match;
+  }
+
+  //----------------------------------------------------------------------------
+  IPCServer::TileHandler::TileRequests::iterator
+  IPCServer::TileHandler::removeRequest( TileRequests::iterator req,
+                                         bool notify_client )
+  {
+    if( notify_client )
+      req->second.socket->sendTextMessage(QString(
+      "{"
+        "\"task\": \"CANCEL\","
+        "\"id\": \"preview-tile\","
+        "\"req_id\": " + QString::number(req->first) +
+      "}"));
+
+    if( req->second.prefetch )
+      _prefetch_bytes -= 4 * req->second.tile_size.x * req->second.tile_size.y;
+
+    _request_index.erase(req->second.key);
+    return _tile_requests.erase(req);
+  }
+
+  //----------------------------------------------------------------------------
+  void IPCServer::TileHandler::sendRequest( uint32_t req_id,
+                                            const TileRequest& req )
+  {
+    HierarchicTileMapPtr tile_map = req.tile_map.lock();
+    if( !tile_map )
+      return;
+
+    float scale = 1/tile_map->getLayerScale(req.zoom);
+    Rect src( float2( req.x * tile_map->getTileWidth(),
+                      req.y * tile_map->getTileHeight() ),
+              req.tile_size );
+    src *= scale;
+    src.pos.x += tile_map->margin_left;
+
+    const QString format = _ipc_server->getTileFormat(req.socket);
+
+    std::cout << "request tile " << src.toString(true) << std::endl;
+    req.socket->sendTextMessage(QString(
+    "{"
+      "\"task\": \"GET\","
+      "\"id\": \"preview-tile\","
+      "\"size\": [" + QString::number(req.tile_size.x)
+              + "," + QString::number(req.tile_size.y)
+              + "],"
+      "\"sections_src\":" + to_string(tile_map->partitions_src).c_str() + ","
+      "\"sections_dest\":" + to_string(tile_map->partitions_dest).c_str() + ","
+      "\"src\": " + src.toString(true).c_str() + ","
+      "\"format\": \"" + format + "\","
+      "\"req_id\": " + QString::number(req_id) +
+    "}"));
   }
 
 } // namespace LinksRouting
@@ -0,0 +1,17 @@
+uniform sampler2D inputTex;
+// Half size of a texel of the input texture
+uniform vec2 halfpixel;
+
+// Downsample step of the dual filter (5 bilinear taps)
+void main()
+{
+  vec2 uv = gl_TexCoord[0].xy;
+
+  vec4 sum = 4.0 * texture2D(inputTex, uv);
+  sum += texture2D(inputTex, uv - halfpixel);
+  sum += texture2D(inputTex, uv + halfpixel);
+  sum += texture2D(inputTex, uv + vec2(halfpixel.x, -halfpixel.y));
+  sum += texture2D(inputTex, uv - vec2(halfpixel.x, -halfpixel.y));
+
+  gl_FragColor = sum / 8.0;
+}
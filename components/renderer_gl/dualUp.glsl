@@ -0,0 +1,25 @@
+uniform sampler2D inputTex;
+// Half size of a texel of the input texture
+uniform vec2 halfpixel;
+uniform int normalize_color;
+
+// Upsample step of the dual filter (8 bilinear taps)
+void main()
+{
+  vec2 uv = gl_TexCoord[0].xy;
+
+  vec4 sum = texture2D(inputTex, uv + vec2(-halfpixel.x * 2.0, 0.0));
+  sum += texture2D(inputTex, uv + vec2(-halfpixel.x, halfpixel.y)) * 2.0;
+  sum += texture2D(inputTex, uv + vec2(0.0, halfpixel.y * 2.0));
+  sum += texture2D(inputTex, uv + vec2(halfpixel.x, halfpixel.y)) * 2.0;
+  sum += texture2D(inputTex, uv + vec2(halfpixel.x * 2.0, 0.0));
+  sum += texture2D(inputTex, uv + vec2(halfpixel.x, -halfpixel.y)) * 2.0;
+  sum += texture2D(inputTex, uv + vec2(0.0, -halfpixel.y * 2.0));
+  sum += texture2D(inputTex, uv + vec2(-halfpixel.x, -halfpixel.y)) * 2.0;
+
+  vec4 color = sum / 12.0;
+  if( normalize_color > 0 && color.a > 0.0001 )
+    color.rgb /= color.a;
+
+  gl_FragColor = color;
+}
@@ -0,0 +1,79 @@
+#ifndef LR_DAMAGETRACKER
+#define LR_DAMAGETRACKER
+
+#include "color.h"
+#include "float2.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <vector>
+
+namespace LinksRouting
+{
+  /**
+   * Detect regions which need to be redrawn by comparing the items (segments,
+   * nodes, popups, ...) drawn in the current frame with the previous frame.
+   * Every item is identified by a key (eg. its address) and described by its
+   * bounding box and a hash of everything influencing its appearance.
+   */
+  class DamageTracker
+  {
+    public:
+
+      DamageTracker();
+
+      /** Start collecting the items of a new frame */
+      void begin();
+
+      /** Add an item of the current frame */
+      void add(const void* key, const Rect& bbox, size_t hash);
+
+      /**
+       * Finish the current frame and compare it with the previous one.
+       *
+       * @return Whether anything has changed
+       */
+      bool end();
+
+      /** Force redrawing everything with the next frame */
+      void invalidate();
+
+      /** Whether everything needs to be redrawn */
+      bool isAllDamaged() const { return _all; }
+
+      /** Changed regions of the last frame */
+      const std::vector<Rect>& getDamage() const { return _damage; }
+
+      /** Bounding box of all changed regions */
+      Rect getBounds() const;
+
+      template<typename T>
+      static void hashCombine(size_t& seed, const T& val)
+      {
+        seed ^= std::hash<T>()(val) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+      }
+
+      static void hashCombine(size_t& seed, const float2& val);
+      static void hashCombine(size_t& seed, const Rect& val);
+      static void hashCombine(size_t& seed, const Color& val);
+
+    protected:
+
+      struct Item
+      {
+        Rect    bbox;
+        size_t  hash;
+      };
+      typedef std::map<const void*, Item> Items;
+
+      Items             _items_last,
+                        _items_cur;
+      std::vector<Rect> _damage;
+      bool              _all,
+                        _invalid;
+  };
+
+} // namespace LinksRouting
+
+#endif //LR_DAMAGETRACKER
@@ -4,12 +4,15 @@
 #include <renderer.h>
 #include <common/componentarguments.h>
 
+#include "damagetracker.h"
 #include "fbo.h"
+#include "GeometryBuffer.hpp"
 #include "glsl/glsl.h"
 #include "slots.hpp"
 #include "slotdata/image.hpp"
 #include "slotdata/text_popup.hpp"
 
+#include <memory>
 #include <queue>
 #include <set>
 
@@ -46,6 +49,8 @@ namespace LinksRouting
       Color                 _color_cur,
                             _color_covered_cur;
       int                   _num_blur;
+      std::string           _blur_mode;   ///< "separable" or "dual"
+      int                   _glow_levels;
 
       unsigned int _margin_left;
 
@@ -59,20 +64,76 @@ namespace LinksRouting
       slot_t<SlotType::Image>::type _slot_links,
                                     _slot_xray;
 
-      /** Frame buffer object where links get rendered to */
+      /** Publish the link colors (eg. for color dependent costs) */
+      slot_t<std::vector<Color>>::type _slot_colors;
+
+      /**
+       * Publish the regions of "/rendered-links" changed by the last frame
+       * (desktop coordinates, including the blur margin)
+       */
+      slot_t<std::vector<Rect>>::type _slot_damage;
+
+      /**
+       * Frame buffer object where links get rendered to (0 = links, 1 = blur
+       * temporary, 2 = blurred links). The buffers are kept between frames,
+       * so only damaged regions need to be redrawn.
+       */
       gl::FBO   _links_fbo,
                 _xray_fbo;
 
+      /** Changed items since the last frame */
+      DamageTracker _damage;
+      bool          _links_valid;
+      std::string   _blur_config;
+
+      /**
+       * Retained geometry of all links and regions. Only rebuilt if the hash
+       * of all link items (see collectDamage) changes.
+       */
+      GeometryBuffer  _link_geometry;
+      size_t          _links_hash,
+                      _link_geometry_hash;
+      bool            _link_geometry_rendered;
+
+      /**
+       * Downsampled levels for dual filter blur (1/2, 1/4, ...). Color buffer
+       * 0 holds the downsampled and 1 the upsampled image.
+       */
+      std::vector<std::unique_ptr<gl::FBO>> _glow_fbos;
+
       cwc::glShaderManager  _shader_manager;
       cwc::glShader*        _blur_x_shader;
       cwc::glShader*        _blur_y_shader;
+      cwc::glShader*        _dual_down_shader;
+      cwc::glShader*        _dual_up_shader;
 
       typedef std::queue<const LinkDescription::HyperEdge*> HyperEdgeQueue;
       typedef std::set<const LinkDescription::HyperEdge*> HyperEdgeSet;
 
       Color getCurrentColor() const;
 
-      void blur(gl::FBO& fbo);
+      /**
+       * Blur color buffer 0 of @a fbo into color buffer 2 (Only inside
+       * @a region, given in pixels)
+       *
+       * @return Region of color buffer 2 which has been updated
+       */
+      Rect blur(gl::FBO& fbo, const Rect& region);
+
+      /**
+       * Blur by down- and upsampling over _glow_fbos (dual filter). Much
+       * cheaper than blur() for large framebuffers.
+       */
+      Rect blurDual(gl::FBO& fbo, const Rect& region);
+
+      /**
+       * Add everything drawn by process() to the damage tracker
+       */
+      void collectDamage(const LinkDescription::LinkList& links);
+
+      /** Map from desktop to _links_fbo pixel coordinates and back */
+      Rect toFramebuffer(const Rect& rect) const;
+      Rect fromFramebuffer(const Rect& rect) const;
 
       bool renderLinks( const LinkDescription::LinkList& links,
                         int pass = 0 );
@@ -0,0 +1,110 @@
+#include "damagetracker.h"
+
+namespace LinksRouting
+{
+
+  //----------------------------------------------------------------------------
+  DamageTracker::DamageTracker():
+    _all(true),
+    _invalid(true)
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  void DamageTracker::begin()
+  {
+    _items_cur.clear();
+  }
+
+  //----------------------------------------------------------------------------
+  void DamageTracker::add(const void* key, const Rect& bbox, size_t hash)
+  {
+    Item& item = _items_cur[key];
+    if( item.bbox.isValid() )
+    {
+      // Same key used multiple times (eg. node rendered in both passes)
+      item.bbox.expand(bbox.topLeft());
+      item.bbox.expand(bbox.bottomRight());
+      hashCombine(item.hash, hash);
+    }
+    else
+    {
+      item.bbox = bbox;
+      item.hash = hash;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  bool DamageTracker::end()
+  {
+    _damage.clear();
+    _all = _invalid;
+    _invalid = false;
+
+    if( !_all )
+    {
+      for(auto cur = _items_cur.begin(); cur != _items_cur.end(); ++cur)
+      {
+        auto last = _items_last.find(cur->first);
+        if( last == _items_last.end() )
+          _damage.push_back(cur->second.bbox);
+        else if(    last->second.hash != cur->second.hash
+                 || last->second.bbox != cur->second.bbox )
+        {
+          _damage.push_back(last->second.bbox);
+          _damage.push_back(cur->second.bbox);
+        }
+      }
+
+      for(auto last = _items_last.begin(); last != _items_last.end(); ++last)
+        if( _items_cur.find(last->first) == _items_cur.end() )
+          _damage.push_back(last->second.bbox);
+    }
+
+    _items_last.swap(_items_cur);
+    return _all || !_damage.empty();
+  }
+
+  //----------------------------------------------------------------------------
+  void DamageTracker::invalidate()
+  {
+    _invalid = true;
+  }
+
+  //----------------------------------------------------------------------------
+  Rect DamageTracker::getBounds() const
+  {
+    Rect bounds;
+    for(auto rect = _damage.begin(); rect != _damage.end(); ++rect)
+    {
+      bounds.expand(rect->topLeft());
+      bounds.expand(rect->bottomRight());
+    }
+    return bounds;
+  }
+
+  //----------------------------------------------------------------------------
+  void DamageTracker::hashCombine(size_t& seed, const float2& val)
+  {
+    hashCombine(seed, val.x);
+    hashCombine(seed, val.y);
+  }
+
+  //----------------------------------------------------------------------------
+  void DamageTracker::hashCombine(size_t& seed, const Rect& val)
+  {
+    hashCombine(seed, val.pos);
+    hashCombine(seed, val.size);
+  }
+
+  //----------------------------------------------------------------------------
+  void DamageTracker::hashCombine(size_t& seed, const Color& val)
+  {
+    hashCombine(seed, val.r);
+    hashCombine(seed, val.g);
+    hashCombine(seed, val.b);
+    hashCombine(seed, val.a);
+  }
+
+} // namespace LinksRouting
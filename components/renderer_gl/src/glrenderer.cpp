@@ -3,6 +3,7 @@
 #include "log.hpp"
 
 #include <GL/glu.h>
+#include <cmath>
 #include <iostream>
 
 std::ostream& operator<<(std::ostream& s, const std::vector<float2>& verts)
@@ -20,14 +21,61 @@ std::ostream& operator<<(std::ostream& s, const std::vector<float2>& verts)
 
 namespace LinksRouting
 {
+  //----------------------------------------------------------------------------
+  static Rect grow(const Rect& rect, const float2& d)
+  {
+    return Rect(rect.pos - d, rect.size + 2 * d);
+  }
+
+  //----------------------------------------------------------------------------
+  static Rect boundingBox( const LinkDescription::points_t& points,
+                           const float2& offset,
+                           float margin )
+  {
+    Rect bbox;
+    for(auto p = points.begin(); p != points.end(); ++p)
+      bbox.expand(*p + offset);
+    return grow(bbox, float2(margin, margin));
+  }
+
+  //----------------------------------------------------------------------------
+  static void setScissor(const Rect& rect)
+  {
+    const GLint x = std::floor(rect.l()),
+                y = std::floor(rect.t());
+    glScissor(x, y, std::ceil(rect.r()) - x, std::ceil(rect.b()) - y);
+  }
+
+  //----------------------------------------------------------------------------
+  static float widenSize(const LinkDescription::HyperEdgeDescriptionSegment& s)
+  {
+    if(    s.nodes.empty()
+        || !s.nodes.back()->getChildren().empty()
+        || !s.get<bool>("widen-end", true) )
+      return 0.f;
+
+    if( !s.nodes.back()->get<std::string>("virtual-outside").empty() )
+      return 13;
+    else
+      return 55;
+  }
+
   //----------------------------------------------------------------------------
   GlRenderer::GlRenderer():
     Configurable("GLRenderer"),
     _margin_left(0),
+    _links_valid(false),
+    _links_hash(0),
+    _link_geometry_hash(0),
+    _link_geometry_rendered(false),
     _blur_x_shader(nullptr),
-    _blur_y_shader(nullptr)
+    _blur_y_shader(nullptr),
+    _dual_down_shader(nullptr),
+    _dual_up_shader(nullptr)
   {
     registerArg("NumBlur", _num_blur = 1);
+    registerArg("BlurMode", _blur_mode = "separable");
+    registerArg("GlowLevels", _glow_levels = 2);
   }
 
   //----------------------------------------------------------------------------
@@ -44,6 +92,12 @@ namespace LinksRouting
 
     _slot_xray = slots.create<SlotType::Image>("/rendered-xray");
     _slot_xray->_data->type = SlotType::Image::OpenGLTexture;
+
+    _slot_colors = slots.create<std::vector<Color>>("/link-colors");
+    *_slot_colors->_data = _colors;
+    _slot_colors->setValid(true);
+
+    _slot_damage = slots.create<std::vector<Rect>>("/rendered-links/damage");
   }
 
   //----------------------------------------------------------------------------
@@ -87,7 +141,7 @@ namespace LinksRouting
 
     _links_fbo.init( upscale * w,
                      upscale * h,
-                     GL_RGBA8, 2, false,
+                     GL_RGBA8, 3, false,
                      GL_LINEAR,
                      GL_NEAREST,
                      false,
@@ -95,13 +149,15 @@ namespace LinksRouting
     *_slot_links->_data =
       SlotType::Image( _links_fbo.width,
                        _links_fbo.height,
-                       _links_fbo.colorBuffers.at(0) );
+                       _links_fbo.colorBuffers.at(2) );
 
     _xray_fbo.init(w, h, GL_RGBA8, 1, false, GL_NEAREST);
     *_slot_xray->_data = SlotType::Image(w, h, _xray_fbo.colorBuffers.at(0));
 
     _blur_x_shader = _shader_manager.loadfromFile(0, "blurX.glsl");
     _blur_y_shader = _shader_manager.loadfromFile(0, "blurY.glsl");
+    _dual_down_shader = _shader_manager.loadfromFile(0, "dualDown.glsl");
+    _dual_up_shader = _shader_manager.loadfromFile(0, "dualUp.glsl");
 
     init = true;
     return true;
@@ -119,20 +175,69 @@ namespace LinksRouting
     assert( _blur_x_shader );
     assert( _blur_y_shader );
 
-    _slot_links->setValid(false);
-    _links_fbo.bind();
+    const Rect fbo_region( float2(0, 0),
+                           float2(_links_fbo.width, _links_fbo.height) );
 
-    glClearColor(0,0,0,0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    const LinkDescription::LinkList& links = *_subscribe_links->_data;
+    if( links.empty() )
+    {
+      _slot_damage->_data->clear();
+      if( _links_valid )
+      {
+        _slot_links->setValid(false);
+        _links_fbo.swapColorAttachment(2);
+        _links_fbo.bind();
+        glClearColor(0,0,0,0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        _links_fbo.unbind();
+        _links_valid = false;
+        _slot_damage->_data->push_back( fromFramebuffer(fbo_region) );
+      }
+      _slot_damage->setValid(true);
+      return 0;
+    }
 
-    if( _subscribe_links->_data->empty() )
+    const std::string blur_config = _blur_mode
+                                  + ":" + std::to_string(_num_blur)
+                                  + ":" + std::to_string(_glow_levels);
+    if( blur_config != _blur_config )
     {
-      _links_fbo.unbind();
+      _blur_config = blur_config;
+      _links_valid = false;
+    }
+
+    if( !_links_valid )
+      _damage.invalidate();
+
+    _damage.begin();
+    collectDamage(links);
+    if( !_damage.end() )
+    {
+      // Nothing has changed -> keep the links from the last frame
+      _slot_damage->_data->clear();
+      _slot_damage->setValid(true);
       return 0;
     }
 
-    glPushAttrib(GL_VIEWPORT_BIT);
+    const bool full_redraw = _damage.isAllDamaged();
+    const Rect region = full_redraw
+                      ? fbo_region
+                      : grow( toFramebuffer(_damage.getBounds()),
+                              float2(2, 2) );
+
+    _slot_links->setValid(false);
+    _links_fbo.swapColorAttachment(0);
+    _links_fbo.bind();
+
+    // Only redraw the damaged region. Everything outside keeps the content of
+    // the last frame.
+    glPushAttrib(GL_VIEWPORT_BIT | GL_SCISSOR_BIT | GL_ENABLE_BIT);
     glViewport(0, 0, _links_fbo.width, _links_fbo.height);
+    glEnable(GL_SCISSOR_TEST);
+    setScissor(region);
+
+    glClearColor(0,0,0,0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
     bool rendered_anything = false;
     if( !_subscribe_outlines->_data->popups.empty() )
@@ -184,13 +289,52 @@ namespace LinksRouting
     _links_fbo.unbind();
 
     if( !rendered_anything )
+    {
+      // Links are not shown at all
+      _slot_links->_data->id = _links_fbo.colorBuffers.at(2);
+      _links_fbo.swapColorAttachment(2);
+      _links_fbo.bind();
+      glClear(GL_COLOR_BUFFER_BIT);
+      _links_fbo.unbind();
+      _links_valid = false;
+      _slot_damage->_data->assign(1, fromFramebuffer(fbo_region));
+      _slot_damage->setValid(true);
       return 0;
+    }
 
     glDisable(GL_BLEND);
     glColor4f(1,1,1,1);
 
-    blur(_links_fbo);
+    Rect blurred = region;
+    size_t output = 2;
+    if( _blur_mode == "dual" && _dual_down_shader && _dual_up_shader )
+      blurred = blurDual(_links_fbo, region);
+    else if( _num_blur > 0 )
+      blurred = blur(_links_fbo, region);
+    else
+      output = 0;
+
+    _slot_links->_data->id = _links_fbo.colorBuffers.at(output);
     _slot_links->setValid(true);
+    _links_valid = true;
+
+    std::vector<Rect>& damage = *_slot_damage->_data;
+    damage.clear();
+    if( full_redraw || blurred == fbo_region )
+      damage.push_back( fromFramebuffer(fbo_region) );
+    else
+    {
+      // Every changed item is affected by the blur and rounding to pixels
+      const float2 margin =
+        0.5f * fromFramebuffer(Rect( float2(0, 0),
+                                     blurred.size - region.size
+                                                  + float2(4, 4) )).size;
+      for(auto rect = _damage.getDamage().begin();
+               rect != _damage.getDamage().end();
+             ++rect )
+        damage.push_back( grow(*rect, margin) );
+    }
+    _slot_damage->setValid(true);
 
 #if 1
     return 0;
@@ -251,6 +395,9 @@ namespace LinksRouting
                               0.7f ) );
     //std::cout << "GlRenderer: Added color (" << val << ")" << std::endl;
 
+    if( _slot_colors )
+      *_slot_colors->_data = _colors;
+
     return true;
   }
 
@@ -263,15 +410,26 @@ namespace LinksRouting
   }
 
   //----------------------------------------------------------------------------
-  void GlRenderer::blur(gl::FBO& fbo)
+  Rect GlRenderer::blur(gl::FBO& fbo, const Rect& region)
   {
-    assert(fbo.colorBuffers.size() >= 2);
+    assert(fbo.colorBuffers.size() >= 3);
+
+    // Every pass reads up to three texels in each direction. Repeated blurring
+    // would require keeping the result of every iteration, so only a single
+    // iteration is limited to the damaged region.
+    const Rect scissor = _num_blur > 1
+                       ? Rect(float2(0, 0), float2(fbo.width, fbo.height))
+                       : grow(region, float2(4, 4));
+
+    glPushAttrib(GL_SCISSOR_BIT | GL_ENABLE_BIT);
+    glEnable(GL_SCISSOR_TEST);
+    setScissor(scissor);
 
     for( int i = 0; i < _num_blur; ++i )
     {
       fbo.swapColorAttachment(1);
       fbo.bind();
-      fbo.bindTex(0);
+      fbo.bindTex(i ? 2 : 0);
       _blur_x_shader->begin();
       _blur_x_shader->setUniform1i("inputTex", 0);
       _blur_x_shader->setUniform1f("scale", 1);
@@ -279,7 +437,7 @@ namespace LinksRouting
       _blur_x_shader->end();
       fbo.unbind();
 
-      fbo.swapColorAttachment(0);
+      fbo.swapColorAttachment(2);
       fbo.bind();
       fbo.bindTex(1);
       _blur_y_shader->begin();
@@ -294,12 +452,315 @@ namespace LinksRouting
       _blur_y_shader->end();
       fbo.unbind();
     }
+
+    glPopAttrib();
+    return scissor;
+  }
+
+  //----------------------------------------------------------------------------
+  Rect GlRenderer::blurDual(gl::FBO& fbo, const Rect& region)
+  {
+    assert(fbo.colorBuffers.size() >= 3);
+
+    const size_t num_levels = std::max(1, _glow_levels);
+
+    if(    _glow_fbos.size() != num_levels
+        || _glow_fbos.front()->width != std::max(1u, fbo.width / 2)
+        || _glow_fbos.front()->height != std::max(1u, fbo.height / 2) )
+    {
+      _glow_fbos.clear();
+      unsigned int w = fbo.width,
+                   h = fbo.height;
+      for(size_t i = 0; i < num_levels; ++i)
+      {
+        w = std::max(1u, w / 2);
+        h = std::max(1u, h / 2);
+
+        _glow_fbos.push_back(std::unique_ptr<gl::FBO>(new gl::FBO));
+        _glow_fbos.back()->init(w, h, GL_RGBA8, 2, false, GL_LINEAR);
+      }
+    }
+
+    auto pass = [](cwc::glShader* shader,
+                   GLuint src,
+                   unsigned int src_width,
+                   unsigned int src_height,
+                   gl::FBO& dest,
+                   const Rect& scissor)
+    {
+      dest.bind();
+      setScissor(scissor);
+      glEnable(GL_TEXTURE_2D);
+      glBindTexture(GL_TEXTURE_2D, src);
+      shader->setUniform1i("inputTex", 0);
+      shader->setUniform2f("halfpixel", 0.5f / src_width, 0.5f / src_height);
+      dest.draw(dest.width, dest.height, 0, 0, -1, true, true);
+      glDisable(GL_TEXTURE_2D);
+      dest.unbind();
+    };
+
+    glPushAttrib(GL_SCISSOR_BIT | GL_ENABLE_BIT);
+    glEnable(GL_SCISSOR_TEST);
+
+    // Every level is kept between frames, so only the damaged region (grown by
+    // the filter footprint of each step) needs to be updated.
+    Rect scissor = region;
+
+    // Downsample...
+    _dual_down_shader->begin();
+    GLuint src = fbo.colorBuffers.at(0);
+    unsigned int src_width = fbo.width,
+                 src_height = fbo.height;
+    for(size_t i = 0; i < _glow_fbos.size(); ++i)
+    {
+      gl::FBO& dest = *_glow_fbos[i];
+      scissor = grow(0.5f * scissor, float2(2, 2));
+      dest.swapColorAttachment(0);
+      pass(_dual_down_shader, src, src_width, src_height, dest, scissor);
+
+      src = dest.colorBuffers.at(0);
+      src_width = dest.width;
+      src_height = dest.height;
+    }
+    _dual_down_shader->end();
+
+    // ...and upsample again
+    _dual_up_shader->begin();
+    _dual_up_shader->setUniform1i("normalize_color", 0);
+    for(size_t i = _glow_fbos.size() - 1; i > 0; --i)
+    {
+      // Upsampled images go to the second buffer to keep the downsampled
+      // ones for the next frame.
+      gl::FBO& dest = *_glow_fbos[i - 1];
+      scissor = grow(2.f * scissor, float2(2, 2));
+      dest.swapColorAttachment(1);
+      pass(_dual_up_shader, src, src_width, src_height, dest, scissor);
+
+      src = dest.colorBuffers.at(1);
+      src_width = dest.width;
+      src_height = dest.height;
+    }
+
+    // Last step directly writes back to the full resolution buffer
+#ifdef USE_DESKTOP_BLEND
+    _dual_up_shader->setUniform1i("normalize_color", 0);
+#else
+    _dual_up_shader->setUniform1i("normalize_color", 1);
+#endif
+    scissor = grow(2.f * scissor, float2(2, 2));
+    fbo.swapColorAttachment(2);
+    pass(_dual_up_shader, src, src_width, src_height, fbo, scissor);
+    _dual_up_shader->end();
+
+    glPopAttrib();
+    return scissor;
+  }
+
+  //----------------------------------------------------------------------------
+  void GlRenderer::collectDamage(const LinkDescription::LinkList& links)
+  {
+    typedef DamageTracker DT;
+    const float line_width = 3;
+
+    _links_hash = 0;
+
+    for( auto const& outline: _subscribe_outlines->_data->popups )
+    {
+      Rect reg_title = outline.region_title;
+      if( !outline.preview->isVisible() )
+        reg_title.size.x = std::min(150.f, reg_title.size.x);
+
+      size_t hash = 0;
+      DT::hashCombine(hash, reg_title);
+      DT::hashCombine(hash, outline.preview->isVisible());
+      DT::hashCombine(hash, _colors.front());
+      _damage.add(&outline, reg_title, hash);
+    }
+
+    for(auto link = links.begin(); link != links.end(); ++link)
+    {
+      Color color(1.0, 0.2, 0.2);
+      if( !_colors.empty() )
+        color = _colors[ link->_color_id % _colors.size() ];
+
+      HyperEdgeQueue hedges_open;
+      HyperEdgeSet   hedges_done;
+
+      hedges_open.push(link->_link.get());
+      do
+      {
+        const LinkDescription::HyperEdge* hedge = hedges_open.front();
+        hedges_open.pop();
+
+        if( hedges_done.find(hedge) != hedges_done.end() )
+          continue;
+        hedges_done.insert(hedge);
+
+        LinkDescription::nodes_t nodes;
+        auto fork = hedge->getHyperEdgeDescription();
+        if( !fork )
+          nodes = hedge->getNodes();
+        else
+        {
+          for( auto& segment: fork->outgoing )
+          {
+            if( !segment.trail.empty() )
+            {
+              const float widen_size = widenSize(segment);
+
+              size_t hash = 0;
+              for(auto const& p: segment.trail)
+                DT::hashCombine(hash, p);
+              DT::hashCombine(hash, segment.get<bool>("covered"));
+              DT::hashCombine(hash, widen_size);
+              DT::hashCombine(hash, color);
+
+              // Widening the end adds a few pixels in normal direction
+              _damage.add( &segment,
+                           boundingBox( segment.trail,
+                                        float2(),
+                                        line_width + (widen_size > 0 ? 8 : 0) ),
+                           hash );
+              DT::hashCombine(_links_hash, static_cast<const void*>(&segment));
+              DT::hashCombine(_links_hash, hash);
+            }
+
+            nodes.insert( nodes.end(),
+                          segment.nodes.begin(),
+                          segment.nodes.end() );
+          }
+        }
+
+        float2 offset;
+        if( !nodes.empty() && nodes.front()->getParent() )
+          offset = nodes.front()->getParent()->get<float2>("screen-offset");
+
+        // Same conditions as in NodeRenderer::renderNodes
+        for(auto node = nodes.begin(); node != nodes.end(); ++node)
+        {
+          bool hover = (*node)->get<bool>("hover");
+          float alpha = (*node)->get<float>("alpha", hover ? 1 : 0);
+          if( alpha > 0.01 )
+            hover = true;
+
+          if( !hover && (*node)->get<bool>("hidden") )
+            continue;
+
+          for(auto child = (*node)->getChildren().begin();
+                   child != (*node)->getChildren().end();
+                 ++child )
+            hedges_open.push( child->get() );
+
+          if( (*node)->getVertices().empty() )
+            continue;
+
+          size_t hash = 0;
+          for(auto const& p: (*node)->getVertices())
+            DT::hashCombine(hash, p);
+          DT::hashCombine(hash, offset);
+          DT::hashCombine(hash, hover);
+          DT::hashCombine(hash, alpha);
+          DT::hashCombine(hash, (*node)->get<bool>("hover"));
+          DT::hashCombine(hash, (*node)->get<bool>("covered"));
+          DT::hashCombine(hash, (*node)->get<bool>("outside"));
+          DT::hashCombine(hash, (*node)->get<bool>("filled", false));
+          DT::hashCombine(hash, (*node)->get<bool>("outline-only"));
+          DT::hashCombine(hash, (*node)->get<bool>("outline-title"));
+          DT::hashCombine(hash, color);
+
+          Rect bbox = boundingBox((*node)->getVertices(), offset, line_width);
+          if( hover )
+          {
+            // Covered regions (drawn in first pass without offset)
+            const Rect rp = (*node)->get<Rect>("covered-preview-region"),
+                       r = (*node)->get<Rect>("covered-region");
+            const Rect regions[] = { grow(rp, float2(3, 3)),
+                                     grow(r, float2(4, 4)) };
+            for(auto const& region: regions)
+            {
+              if( !region.isValid() )
+                continue;
+              bbox.expand(region.topLeft());
+              bbox.expand(region.bottomRight());
+              DT::hashCombine(hash, region);
+            }
+          }
+
+          _damage.add(node->get(), bbox, hash);
+          DT::hashCombine(_links_hash, static_cast<const void*>(node->get()));
+          DT::hashCombine(_links_hash, hash);
+        }
+      } while( !hedges_open.empty() );
+    }
+
+    for( auto const& popup: _subscribe_popups->_data->popups )
+    {
+      size_t hash = 0;
+      DT::hashCombine(hash, popup.region.isVisible());
+      DT::hashCombine(hash, popup.region.region);
+      DT::hashCombine(hash, popup.region.border);
+
+      const float margin = popup.region.border + 1;
+      _damage.add( &popup,
+                   grow(popup.region.region, float2(margin, margin)),
+                   hash );
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  Rect GlRenderer::toFramebuffer(const Rect& rect) const
+  {
+    GLdouble modelview[16],
+             projection[16];
+    glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+    glGetDoublev(GL_PROJECTION_MATRIX, projection);
+    const GLint viewport[4] = {0, 0, GLint(_links_fbo.width),
+                                     GLint(_links_fbo.height)};
+
+    Rect ret;
+    const float2 corners[] = { rect.topLeft(), rect.bottomRight() };
+    for(auto const& p: corners)
+    {
+      GLdouble x, y, z;
+      gluProject(p.x, p.y, 0, modelview, projection, viewport, &x, &y, &z);
+      ret.expand(float2(x, y));
+    }
+    return ret;
+  }
+
+  //----------------------------------------------------------------------------
+  Rect GlRenderer::fromFramebuffer(const Rect& rect) const
+  {
+    GLdouble modelview[16],
+             projection[16];
+    glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+    glGetDoublev(GL_PROJECTION_MATRIX, projection);
+    const GLint viewport[4] = {0, 0, GLint(_links_fbo.width),
+                                     GLint(_links_fbo.height)};
+
+    Rect ret;
+    const float2 corners[] = { rect.topLeft(), rect.bottomRight() };
+    for(auto const& p: corners)
+    {
+      GLdouble x, y, z;
+      gluUnProject(p.x, p.y, 0, modelview, projection, viewport, &x, &y, &z);
+      ret.expand(float2(x, y));
+    }
+    return ret;
   }
 
   //----------------------------------------------------------------------------
   bool GlRenderer::renderLinks( const LinkDescription::LinkList& links,
                                 int pass )
   {
+    // Geometry of the last frame is still up to date if no link has changed
+    // (eg. only popups or the x-ray preview)
+    if( pass > 0 && _link_geometry_hash == _links_hash )
+    {
+      _link_geometry.draw();
+      return _link_geometry_rendered;
+    }
+
     bool rendered_anything = false;
     _color_cur = Color(1.0, 0.2, 0.2);
 
@@ -307,6 +768,13 @@ namespace LinksRouting
     renderer.setUseStencil(true);
     renderer.setLineWidth(3);
 
+    // Collect all lines and regions and draw them at once
+    if( pass > 0 )
+    {
+      _link_geometry.clear();
+      renderer.setGeometryBuffer(&_link_geometry);
+    }
+
     for(auto link = links.begin(); link != links.end(); ++link)
     {
       if( !_colors.empty() )
@@ -344,10 +812,6 @@ namespace LinksRouting
         }
         else
         {
-          // Don't draw where region highlights already have been drawn
-          glStencilFunc(GL_EQUAL, 0, 1);
-          glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-
           LinkDescription::nodes_t nodes;
           for( auto& segment: fork->outgoing )
           {
@@ -356,37 +820,22 @@ namespace LinksRouting
                 /*&& segment.trail.front().x >= 0
                 && segment.trail.front().y >= 24*/ )
             {
-              // Draw path
-              float widen_size = 0.f;
-              if(   !segment.nodes.empty()
-                  && segment.nodes.back()->getChildren().empty()
-                  && segment.get<bool>("widen-end", true) )
-              {
-                if( !segment.nodes.back()
-                            ->get<std::string>("virtual-outside").empty() )
-                  widen_size = 13;
-                else
-                  widen_size = 55;
-              }
-              line_borders_t region = calcLineBorders( segment.trail,
-                                                       3,
-                                                       false,
-                                                       widen_size );
-
-              glColor4fv(   segment.get<bool>("covered")
-                          ? _color_covered_cur
-                          : _color_cur );
-              glBegin(GL_TRIANGLE_STRIP);
-              for( auto first = std::begin(region.first),
-                        second = std::begin(region.second);
-                   first != std::end(region.first);
-                   ++first,
-                   ++second )
-              {
-                glVertex2f(first->x, first->y);
-                glVertex2f(second->x, second->y);
-              }
-              glEnd();
+              // Draw path (trails never change, see trail_borders)
+              const line_borders_t& region =
+                calcLineBordersCached( segment.trail_borders,
+                                       0,
+                                       segment.trail,
+                                       3,
+                                       false,
+                                       widenSize(segment) );
+
+              // Don't draw where region highlights already have been drawn
+              _link_geometry.addStrip( region.first,
+                                       region.second,
+                                         segment.get<bool>("covered")
+                                       ? _color_covered_cur
+                                       : _color_cur,
+                                       GeometryBuffer::STENCIL_TEST );
             }
 
             // Collect nodes for drawing them after the links to prevent links
@@ -407,6 +856,13 @@ namespace LinksRouting
       } while( !hedges_open.empty() );
     }
 
+    if( pass > 0 )
+    {
+      _link_geometry_hash = _links_hash;
+      _link_geometry_rendered = rendered_anything;
+      _link_geometry.draw();
+    }
+
     return rendered_anything;
   }
 
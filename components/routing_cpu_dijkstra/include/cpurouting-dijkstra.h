@@ -5,11 +5,13 @@
 #include "common/componentarguments.h"
 
 #include "slots.hpp"
+#include "slotdata/color_costmap.hpp"
 #include "slotdata/image.hpp"
 #include "slotdata/polygon.hpp"
 
 #include "dijkstra.h"
 
+#include <map>
 #include <set>
 
 #ifndef QWINDOWDEFS_H
@@ -59,10 +61,57 @@ namespace Dijkstra
       /* Drawable desktop region */
       slot_t<Rect>::type _subscribe_desktop_rect;
 
+      /* Costmap (only used if in main memory, eg. from CPUCostAnalysis) */
+      slot_t<SlotType::Image>::type _subscribe_costmap;
+
+      /* Costs per link color (textures, eg. from GlCostAnalysis) */
+      slot_t<SlotType::ColorCostMaps>::type _subscribe_color_costmaps;
+      slot_t<uint32_t>::type                _subscribe_costmap_revision;
+      slot_t<std::vector<Color>>::type      _subscribe_link_colors;
+
       RegionGroups _global_route_nodes;
       Grids        _grids;
 
-      void collectNodes(LinkDescription::HyperEdge* hedge);
+      double                _cost_weight,
+                            _color_cost_weight;
+      std::vector<uint32_t> _penalties; ///< Per grid cell (from the costmap)
+
+      /** Mean color costs per grid cell for each layer of the color costmaps */
+      std::vector<Color>              _color_cell_colors;
+      std::vector<std::vector<float>> _color_cells;
+      uint32_t                        _color_cells_revision;
+      size_t                          _color_cells_size;
+
+      /** Costmap and color penalties per grid cell for each layer */
+      std::vector<std::vector<uint32_t>> _color_penalties;
+
+      /** Penalties for routing each node (NULL if without costs) */
+      std::map<const LinkDescription::Node*, const uint32_t*> _node_penalties;
+
+      /**
+       * Sample the costmap for every grid cell (cleared if no costmap is
+       * available).
+       */
+      void updatePenalties( size_t grid_width,
+                            size_t grid_height,
+                            size_t cell_size );
+
+      /**
+       * Read back the color cost layers (only if changed) and combine them with
+       * the costmap penalties (cleared if not available).
+       */
+      void updateColorPenalties( size_t grid_width,
+                                 size_t grid_height,
+                                 size_t cell_size );
+
+      /**
+       * Get the penalties for a link of the given color (NULL if without
+       * costs).
+       */
+      const uint32_t* getPenalties(uint32_t color_id) const;
+
+      void collectNodes( LinkDescription::HyperEdge* hedge,
+                         const uint32_t* penalties );
       void bundle( const float2& pos,
                    const Bundle& bundle = {} );
 
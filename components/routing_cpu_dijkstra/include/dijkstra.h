@@ -84,7 +84,17 @@ namespace dijkstra
       size_t getHeight() const { return _height; }
 
       void reset();
-      void run(size_t src_x, size_t src_y);
+
+      /**
+       * Compute the cost of the cheapest path from the given node to every
+       * other node.
+       *
+       * @param penalties   Additional cost for entering each node (optional,
+       *                    width * height values, row by row)
+       */
+      void run( size_t src_x,
+                size_t src_y,
+                const uint32_t* penalties = nullptr );
       bool hasRun() const;
 
       const Node& operator()(size_t x, size_t y) const;
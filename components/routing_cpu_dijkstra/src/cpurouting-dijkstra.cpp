@@ -1,9 +1,14 @@
 #include "cpurouting-dijkstra.h"
 #include "log.hpp"
 
+#include <GL/gl.h>
+
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstring>
 #include <limits>
+#include <stdexcept>
 
 namespace LinksRouting
 {
@@ -11,11 +16,17 @@ namespace Dijkstra
 {
   typedef LinkDescription::HyperEdgeDescriptionSegment segment_t;
 
+  // Keep the cost of a single step within a sane range
+  static const float MAX_PENALTY = 1000;
+
   //----------------------------------------------------------------------------
   CPURouting::CPURouting() :
-    Configurable("CPURoutingDijkstra")
+    Configurable("CPURoutingDijkstra"),
+    _color_cells_revision(0),
+    _color_cells_size(0)
   {
-
+    registerArg("CostWeight", _cost_weight = 10.0);
+    registerArg("ColorCostWeight", _color_cost_weight = 10.0);
   }
 
   //------------------------------------------------------------------------------
@@ -32,6 +43,34 @@ namespace Dijkstra
 
     _subscribe_desktop_rect =
       slot_subscriber.getSlot<Rect>("/desktop/rect");
+
+    // Only published if a cost analysis is attached
+    try
+    {
+      _subscribe_costmap =
+        slot_subscriber.getSlot<SlotType::Image>("/costmap");
+    }
+    catch(std::runtime_error&)
+    {
+      _subscribe_costmap.reset();
+    }
+
+    // Only published by GlCostAnalysis and GlRenderer
+    try
+    {
+      _subscribe_color_costmaps =
+        slot_subscriber.getSlot<SlotType::ColorCostMaps>("/costmap/colors");
+      _subscribe_costmap_revision =
+        slot_subscriber.getSlot<uint32_t>("/costmap/revision");
+      _subscribe_link_colors =
+        slot_subscriber.getSlot<std::vector<Color>>("/link-colors");
+    }
+    catch(std::runtime_error&)
+    {
+      _subscribe_color_costmaps.reset();
+      _subscribe_costmap_revision.reset();
+      _subscribe_link_colors.reset();
+    }
   }
 
   //----------------------------------------------------------------------------
@@ -128,12 +167,16 @@ namespace Dijkstra
       divup(_subscribe_desktop_rect->_data->size.y, GRID_SIZE)
     );
 
+    updatePenalties(grid_size.x, grid_size.y, GRID_SIZE);
+    updateColorPenalties(grid_size.x, grid_size.y, GRID_SIZE);
+
     _global_route_nodes.clear();
+    _node_penalties.clear();
 
     LinkDescription::LinkList& links = *_subscribe_links->_data;
     for( auto it = links.begin(); it != links.end(); ++it )
     {
-      collectNodes(it->_link.get());
+      collectNodes(it->_link.get(), getPenalties(it->_color_id));
     }
 
     for(const auto& group: _global_route_nodes)
@@ -169,7 +212,7 @@ namespace Dijkstra
 
           if( pass == 0 )
           {
-            _grids[i].run(x, y);
+            _grids[i].run(x, y, _node_penalties[node.get()]);
           }
           else
           {
@@ -266,8 +309,197 @@ namespace Dijkstra
     return region_covers;
   }
 
+  /**
+   * Mean of @a channel of @a img (@a channels floats per pixel, covering the
+   * whole desktop) for every grid cell.
+   */
+  static void sampleCells( const float* img,
+                           size_t width,
+                           size_t height,
+                           size_t channels,
+                           size_t channel,
+                           const Rect& desktop,
+                           size_t grid_width,
+                           size_t grid_height,
+                           size_t cell_size,
+                           std::vector<float>& cells )
+  {
+    const float scale_x = width / desktop.size.x,
+                scale_y = height / desktop.size.y;
+
+    cells.resize(grid_width * grid_height);
+    for(size_t gy = 0; gy < grid_height; ++gy)
+    {
+      // Image rows covered by the cell (at least one)
+      const size_t y0 = std::min<size_t>( gy * cell_size * scale_y,
+                                          height - 1 ),
+                   y1 = std::max<size_t>(
+                          std::min<size_t>(
+                            std::ceil((gy + 1) * cell_size * scale_y),
+                            height ),
+                          y0 + 1 );
+
+      for(size_t gx = 0; gx < grid_width; ++gx)
+      {
+        const size_t x0 = std::min<size_t>( gx * cell_size * scale_x,
+                                            width - 1 ),
+                     x1 = std::max<size_t>(
+                            std::min<size_t>(
+                              std::ceil((gx + 1) * cell_size * scale_x),
+                              width ),
+                            x0 + 1 );
+
+        float sum = 0;
+        for(size_t y = y0; y < y1; ++y)
+          for(size_t x = x0; x < x1; ++x)
+            sum += img[(y * width + x) * channels + channel];
+
+        cells[gy * grid_width + gx] = sum / ((x1 - x0) * (y1 - y0));
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void CPURouting::updatePenalties( size_t grid_width,
+                                    size_t grid_height,
+                                    size_t cell_size )
+  {
+    _penalties.clear();
+
+    if(    _cost_weight <= 0
+        || !_subscribe_costmap
+        || !_subscribe_costmap->isValid() )
+      return;
+
+    // Textures (GlCostAnalysis) can not be read here
+    const SlotType::Image& costmap = *_subscribe_costmap->_data;
+    if(    costmap.type != SlotType::Image::ImageGray32F
+        || !costmap.pdata
+        || !costmap.width
+        || !costmap.height )
+      return;
+
+    const Rect& desktop = *_subscribe_desktop_rect->_data;
+    if( desktop.size.x <= 0 || desktop.size.y <= 0 )
+      return;
+
+    std::vector<float> cells;
+    sampleCells( reinterpret_cast<const float*>(costmap.pdata),
+                 costmap.width, costmap.height, 1, 0,
+                 desktop, grid_width, grid_height, cell_size,
+                 cells );
+
+    _penalties.resize(cells.size());
+    for(size_t i = 0; i < cells.size(); ++i)
+      _penalties[i] = static_cast<uint32_t>(
+        std::min(MAX_PENALTY, static_cast<float>(_cost_weight) * cells[i] + .5f)
+      );
+  }
+
+  //----------------------------------------------------------------------------
+  void CPURouting::updateColorPenalties( size_t grid_width,
+                                         size_t grid_height,
+                                         size_t cell_size )
+  {
+    _color_penalties.clear();
+
+    if(    _color_cost_weight <= 0
+        || !_subscribe_color_costmaps
+        || !_subscribe_color_costmaps->isValid() )
+      return;
+
+    const Rect& desktop = *_subscribe_desktop_rect->_data;
+    if( desktop.size.x <= 0 || desktop.size.y <= 0 )
+      return;
+
+    const SlotType::ColorCostMaps& maps = *_subscribe_color_costmaps->_data;
+    std::vector<Color> colors;
+    for(auto const& layer: maps.layers)
+      colors.push_back(layer.color);
+
+    // Layers only change with the colors or a new costmap revision, so only
+    // read them back (which stalls the GPU) in that case.
+    const uint32_t revision = *_subscribe_costmap_revision->_data;
+    const size_t num_cells = grid_width * grid_height;
+    if(    colors != _color_cell_colors
+        || revision != _color_cells_revision
+        || num_cells != _color_cells_size )
+    {
+      _color_cell_colors = colors;
+      _color_cells_revision = revision;
+      _color_cells_size = num_cells;
+      _color_cells.assign(maps.layers.size(), std::vector<float>());
+
+      std::vector<float> pixels;
+      unsigned int read_tex = 0;
+      for(size_t i = 0; i < maps.layers.size(); ++i)
+      {
+        const SlotType::ColorCostMaps::Layer& layer = maps.layers[i];
+        const SlotType::Image& img = layer.image;
+        if(    img.type != SlotType::Image::OpenGLTexture
+            || !img.id
+            || !img.width
+            || !img.height )
+          continue;
+
+        // Up to four layers share a texture (one per channel)
+        if( img.id != read_tex )
+        {
+          pixels.resize(img.width * img.height * 4);
+          glBindTexture(GL_TEXTURE_2D, img.id);
+          glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &pixels[0]);
+          glBindTexture(GL_TEXTURE_2D, 0);
+          read_tex = img.id;
+        }
+
+        sampleCells( &pixels[0], img.width, img.height, 4, layer.channel,
+                     desktop, grid_width, grid_height, cell_size,
+                     _color_cells[i] );
+      }
+    }
+
+    // Add to the costmap penalties
+    _color_penalties.resize(_color_cells.size());
+    for(size_t i = 0; i < _color_cells.size(); ++i)
+    {
+      const std::vector<float>& cells = _color_cells[i];
+      std::vector<uint32_t>& penalties = _color_penalties[i];
+      if( cells.empty() )
+        continue;
+
+      penalties.resize(cells.size());
+      for(size_t j = 0; j < cells.size(); ++j)
+      {
+        float penalty = static_cast<float>(_color_cost_weight) * cells[j] + .5f;
+        if( !_penalties.empty() )
+          penalty += _penalties[j];
+        penalties[j] = static_cast<uint32_t>(std::min(MAX_PENALTY, penalty));
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  const uint32_t* CPURouting::getPenalties(uint32_t color_id) const
+  {
+    const uint32_t* penalties = _penalties.empty() ? nullptr : &_penalties[0];
+    if(    _color_penalties.empty()
+        || !_subscribe_link_colors->isValid()
+        || _subscribe_link_colors->_data->empty() )
+      return penalties;
+
+    // Same color as used by the renderer
+    const std::vector<Color>& link_colors = *_subscribe_link_colors->_data;
+    const Color& color = link_colors[ color_id % link_colors.size() ];
+    for(size_t i = 0; i < _color_penalties.size(); ++i)
+      if( _color_cell_colors[i] == color && !_color_penalties[i].empty() )
+        return &_color_penalties[i][0];
+
+    return penalties;
+  }
+
   //----------------------------------------------------------------------------
-  void CPURouting::collectNodes(LinkDescription::HyperEdge* hedge)
+  void CPURouting::collectNodes( LinkDescription::HyperEdge* hedge,
+                                 const uint32_t* penalties )
   {
     bool no_route = hedge->get<bool>("no-route");
 
@@ -289,7 +521,7 @@ namespace Dijkstra
 
       // add children (hyperedges)
       for( auto& child: node->getChildren() )
-        collectNodes(child.get());
+        collectNodes(child.get(), penalties);
 
       nodes.push_back(node);
 
@@ -317,6 +549,7 @@ namespace Dijkstra
       if( !node->get<bool>("outside") )
       {
         _global_route_nodes[ getCoveringWId(*node) ].push_back(node);
+        _node_penalties[ node.get() ] = penalties;
         continue;
       }
     }
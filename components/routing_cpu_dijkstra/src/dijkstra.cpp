@@ -129,7 +129,9 @@ namespace dijkstra
   }
 
   //----------------------------------------------------------------------------
-  void Grid::run(size_t src_x, size_t src_y)
+  void Grid::run( size_t src_x,
+                  size_t src_y,
+                  const uint32_t* penalties )
   {
     dijkstra::Queue open_nodes;
 
@@ -158,8 +160,9 @@ namespace dijkstra
             continue;
 
           uint32_t new_cost = cur_node->getCost()
-                            // TODO penalty (eg. for covering highlight regions)
                             + ((x == cur_node.x || y == cur_node.y) ? 2 : 3);
+          if( penalties )
+            new_cost += penalties[y * _width + x];
 
           if( new_cost < neighbour->getCost() )
           {
@@ -0,0 +1,99 @@
+#ifndef LR_CLPROFILER
+#define LR_CLPROFILER
+
+// Use Exceptions for OpenCL C++ API
+#define __CL_ENABLE_EXCEPTIONS
+
+#if defined(__APPLE__) || defined(__MACOSX)
+# include <OpenCL/cl.hpp>
+#else
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#endif
+# include <CL/cl.hpp>
+#endif
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace LinksRouting
+{
+  /**
+   * Collects the profiling information (queued/submit/start/end) of all kernel
+   * launches during a frame and aggregates them per kernel. Requires a command
+   * queue created with CL_QUEUE_PROFILING_ENABLE.
+   */
+  class CLProfiler
+  {
+    public:
+
+      /** Number of histogram buckets (bucket i: [2^i, 2^(i+1)) us) */
+      static const size_t NUM_BUCKETS = 24;
+
+      /** Timestamps of a single launch, relative to start of frame (in ms) */
+      struct Launch
+      {
+        std::string kernel;
+        double queued, submit, start, end;
+      };
+
+      struct KernelStats
+      {
+        size_t    count;
+        double    min, max, sum;    ///< Execution times (end - start) in ms
+        double    sum_wait;         ///< Time from queued to start in ms
+        size_t    histogram[NUM_BUCKETS];
+
+        KernelStats();
+        void add(double exec_ms, double wait_ms);
+      };
+
+      CLProfiler();
+
+      void setEnabled(bool enabled) { _enabled = enabled; }
+      bool isEnabled() const { return _enabled; }
+
+      /**
+       * Register the event of a kernel launch. The timestamps are only read
+       * in endFrame, so the event does not need to be completed yet.
+       */
+      void add(const std::string& kernel, const cl::Event& event);
+
+      /**
+       * Wait for all registered events and add their timings to the
+       * statistics.
+       *
+       * @param verbose   Print the timings of this frame to stdout
+       */
+      void endFrame(bool verbose = false);
+
+      /**
+       * Drop the events of the current frame without reading them (eg. if the
+       * frame has been aborted by an error).
+       */
+      void discardFrame();
+
+      void reset();
+
+      /**
+       * Get statistics and the launches of the last frame as JSON object.
+       */
+      std::string toJSON() const;
+
+    protected:
+
+      typedef std::vector<std::pair<std::string, cl::Event>> PendingEvents;
+      typedef std::map<std::string, KernelStats> Stats;
+
+      bool                _enabled;
+      size_t              _num_frames;
+      PendingEvents       _pending;
+      Stats               _stats;
+      std::vector<Launch> _last_frame;
+  };
+
+} // namespace LinksRouting
+
+#endif //LR_CLPROFILER
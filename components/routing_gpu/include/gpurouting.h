@@ -2,10 +2,13 @@
 #define LR_GPUROUTING
 
 #include "routing.h"
+#include "config.h"
 #include "common/componentarguments.h"
+#include "clprofiler.h"
 
 #include "slots.hpp"
 #include "slotdata/image.hpp"
+#include "slotdata/metrics.hpp"
 #include "slotdata/polygon.hpp"
 
 // Use Exceptions for OpenCL C++ API
@@ -45,7 +48,7 @@ namespace LinksRouting
         return (type & Component::Routing);
       }
 
-      void process(unsigned int type);
+      uint32_t process(unsigned int type) override;
 
     private:
 
@@ -56,8 +59,37 @@ namespace LinksRouting
       }
 
       slot_t<SlotType::Image>::type _subscribe_costmap;
+      slot_t<uint32_t>::type _subscribe_costmap_revision;
       slot_t<SlotType::Image>::type _subscribe_desktop;
       slot_t<LinkDescription::LinkList>::type _subscribe_links;
+      slot_t<SlotType::Metrics>::type _subscribe_metrics;
+      slot_t<Config*>::type _subscribe_user_config;
+
+      /**
+       * Parameters of the routing kernels which are passed as compile time
+       * defines (BLOCK_SIZE_X, ROUTING_QUEUE_SIZE, ...) to the OpenCL program.
+       */
+      struct KernelConfig
+      {
+        int block_size[2];
+        int queue_size;
+        int num_local_workers;
+        int warp_size;
+
+        KernelConfig();
+
+        bool operator==(const KernelConfig& rhs) const;
+        bool operator!=(const KernelConfig& rhs) const
+        {
+          return !(*this == rhs);
+        }
+
+        std::string buildOptions() const;
+
+        /** Serialize as "bx by queue workers warp" */
+        std::string toString() const;
+        bool fromString(const std::string& str);
+      };
 
       struct LinkInfo
       {
@@ -120,10 +152,54 @@ namespace LinksRouting
       int _routingNumLocalWorkers;
       int _routingLocalWorkersWarpSize;
 
+      /** Benchmark kernel configurations if none is stored for the device */
+      bool        _autotune;
+      bool        _specializeKernels;
+
+      /** Tuned configurations ("device|bx by queue workers warp;...") */
+      std::string _autotuneResults;
+
+      std::string   _cl_source;
+      std::string   _cl_build_args;
+      KernelConfig  _program_config;
+      bool          _program_specialized;
+
+      /** Per kernel timings, exported as "/metrics/GPURouting" */
+      CLProfiler  _profiler;
+      bool        _profiling;
+      bool        _profiling_verbose;
+
+      /** Revision of the costmap all current routes have been computed on */
+      uint32_t _costmap_revision;
+
       size_t _buffer_width, _buffer_height;
       cl::Buffer  _cl_lastCostMap_buffer;
       cl::Buffer  _cl_routeMap_buffer;
       
+      KernelConfig getKernelConfig() const;
+      void setKernelConfig(const KernelConfig& cfg);
+
+      /**
+       * (Re)build the routing program and create all kernels. If @a specialize
+       * is set the given configuration is compiled into the kernels.
+       */
+      void buildProgram(const KernelConfig& cfg, bool specialize);
+
+      /** Unique identifier of the used device (name + driver version) */
+      std::string getDeviceKey() const;
+
+      bool loadTunedConfig(KernelConfig& cfg) const;
+      void storeTunedConfig(const KernelConfig& cfg);
+
+      /**
+       * Benchmark a set of kernel configurations on a synthetic costmap and
+       * return the fastest one.
+       */
+      KernelConfig autotune();
+      double benchmarkConfig( const KernelConfig& cfg,
+                              const cl::Image2D& costmap,
+                              int width, int height );
+
       void updateRouteMap();
       void createRoutes(LinksRouting::LinkDescription::HyperEdge& ld);
 
@@ -28,6 +28,30 @@ typedef struct _QueueElement
 #define  QueueElementReady 1
 #define  QueueElementReading 2
 #define  QueueElementRead 0
+
+// Routing parameters can be fixed at build time (-D BLOCK_SIZE_X=... etc.), so
+// the compiler is able to specialize loop bounds and local memory indexing.
+// Otherwise the values passed as kernel arguments are used.
+#if defined(BLOCK_SIZE_X) && defined(BLOCK_SIZE_Y)
+# define SPECIALIZE_BLOCK_SIZE(arg) ((int2)(BLOCK_SIZE_X, BLOCK_SIZE_Y))
+# define BLOCK_WORK_GROUP_SIZE \
+  __attribute__((reqd_work_group_size(BLOCK_SIZE_X, BLOCK_SIZE_Y, 1)))
+#else
+# define SPECIALIZE_BLOCK_SIZE(arg) (arg)
+# define BLOCK_WORK_GROUP_SIZE
+#endif
+
+#ifdef ROUTING_QUEUE_SIZE
+# define SPECIALIZE_QUEUE_SIZE(arg) (ROUTING_QUEUE_SIZE)
+#else
+# define SPECIALIZE_QUEUE_SIZE(arg) (arg)
+#endif
+
+#ifdef ROUTING_NUM_LOCAL_WORKERS
+# define NUM_LOCAL_WORKERS ROUTING_NUM_LOCAL_WORKERS
+#else
+# define NUM_LOCAL_WORKERS get_local_size(1)
+#endif
 void checkAndSetQueueState(volatile global QueueElement* element, uint state, uint expected)
 {
   //volatile global int* pstate = ((volatile global int*)element) + 3;
@@ -566,6 +590,7 @@ float loadCostToLocalAndSetRoute(const int2 group_id, const int2 gid, const int2
   return r_in;
 }
 
+BLOCK_WORK_GROUP_SIZE
 __kernel void updateRouteMap(read_only image2d_t costmap,
                              global float* lastCostmap,
                              global float* routeMap,
@@ -662,6 +687,7 @@ __kernel void prepareIndividualRoutingParent(global float* routedata,
   routedata[targets[targetOffset+layer]*routeDataPerNode + pos] = sum;
 }
 
+BLOCK_WORK_GROUP_SIZE
 __kernel void prepareIndividualRouting(const global float* costmap,
                                        global float* routedata,
                                        const global uint4* startingPoints,
@@ -978,21 +1004,23 @@ __kernel void routeLocal(global const float* routeMap,
                          global const int* routingIds,
                          volatile global float* routingData,
                          const int routeDataPerNode,
-                         const int2 blockSize,
+                         const int2 blockSizeArg,
                          const int2 numBlocks,
                          local int* data,
                          local volatile uint* queue,
-                         const int queueSize,
+                         const int queueSizeArg,
                          volatile global uint* activeBuffer,
                          const int2 activeBufferSize,
                          local uint* l_reduction)
 {
+  const int2 blockSize = SPECIALIZE_BLOCK_SIZE(blockSizeArg);
+  const int queueSize = SPECIALIZE_QUEUE_SIZE(queueSizeArg);
   int borderElements = 2*(blockSize.x + blockSize.y - 2);
   int workerId = get_local_id(1);
   const int lid = get_local_id(0);
   const int linId = get_local_id(0) + get_local_size(0)*get_local_id(1);
   const int workerSize = get_local_size(0);
-  const int workers = get_local_size(1);
+  const int workers = NUM_LOCAL_WORKERS;
   int withinWorkerId = get_local_id(0);
   int elementsPerWorker = borderElements + 1;
   routingData = routingData + routeDataPerNode*routingIds[get_group_id(0)];
@@ -1229,11 +1257,12 @@ __kernel void routeLocal(global const float* routeMap,
 __kernel void voteMinimum( global const float* routecost,
                            global const uint* ids,
                            const int routeDataPerNode,
-                           const int2 blockSize,
+                           const int2 blockSizeArg,
                            const int2 numBlocks,
                            global volatile float* vote,
                            local float* l_reduction)
 {
+  const int2 blockSize = SPECIALIZE_BLOCK_SIZE(blockSizeArg);
   //__local volatile float mymin;
   //mymin = 0.1f*MAXFLOAT;
   //barrier(CLK_LOCAL_MEM_FENCE);
@@ -1254,13 +1283,14 @@ __kernel void voteMinimum( global const float* routecost,
     atomic_min((volatile global uint*)(vote+get_global_id(2)), as_uint(mymin));
 }
 
+BLOCK_WORK_GROUP_SIZE
 __kernel void getMinimum( global const float* costmap,
                           global const float* routecost,
                           global const uint* ids,
                           global const uint* childIds,
                           global const uint* childIdOffsets,
                           const int routeDataPerNode,
-                          const int2 blockSize,
+                          const int2 blockSizeArg,
                           const int2 numBlocks,
                           const int2 dim,
                           global const float* vote,
@@ -1271,6 +1301,7 @@ __kernel void getMinimum( global const float* costmap,
                           local float* l_reduction,
                           local int* locals)
 {
+  const int2 blockSize = SPECIALIZE_BLOCK_SIZE(blockSizeArg);
   const int L_SHOULD_TRY = 0;
   const int L_ROUTE_DATA_OFFSET = 0;
   //__local bool should_try;
@@ -1466,6 +1497,7 @@ float2 checkFinalBlock(int2 blockId, int startLid, global const float* routecost
   return (float2)(*minresX, minresY);
 }
 
+BLOCK_WORK_GROUP_SIZE
 __kernel void calcInterBlockRoute(global const float* routecost,
                                   global const float* routeMap,
                                   global const float* costmap,
@@ -1473,7 +1505,7 @@ __kernel void calcInterBlockRoute(global const float* routecost,
                                   global const int4* tos,
                                   global const int* ids,
                                   const int routeDataPerNode,
-                                  const int2 blockSize,
+                                  const int2 blockSizeArg,
                                   const int2 numBlocks,
                                   const int2 dim,
                                   global uint* interblockResult,
@@ -1485,6 +1517,7 @@ __kernel void calcInterBlockRoute(global const float* routecost,
                                   local float* localsF,
                                   local int2* localsI2)
 {
+  const int2 blockSize = SPECIALIZE_BLOCK_SIZE(blockSizeArg);
   const int L_OFFSET = 1;
   const int L_TESTSTART = 0;
   const int LF_MINVOTER = 0;
@@ -1614,12 +1647,13 @@ __kernel void calcInterBlockRoute(global const float* routecost,
   } while( !( localsF[LF_MINVOTER]  == 0 || localsF[LF_MINVOTER]  >= localsF[LF_INCOST] ) );
 }
 
+BLOCK_WORK_GROUP_SIZE
 __kernel void routeConstruct( global const float* routecost,
                               global const float* costmap,
                               global const int4* tos,
                               global const int* ids,
                               const int routeDataPerNode,
-                              const int2 blockSize,
+                              const int2 blockSizeArg,
                               const int2 numBlocks,
                               const int2 dim,
                               global const uint* interblockResult,
@@ -1629,6 +1663,7 @@ __kernel void routeConstruct( global const float* routecost,
                               local float* l_route,
                               local int* locals)
 {
+  const int2 blockSize = SPECIALIZE_BLOCK_SIZE(blockSizeArg);
   uint myedge = get_global_id(2);
   uint myblockoffset = get_group_id(0);
   interblockResult = interblockResult + myedge*interblockSize;
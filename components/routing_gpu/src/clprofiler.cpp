@@ -0,0 +1,172 @@
+#include "clprofiler.h"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace LinksRouting
+{
+
+  //----------------------------------------------------------------------------
+  CLProfiler::KernelStats::KernelStats():
+    count(0),
+    min(std::numeric_limits<double>::max()),
+    max(0),
+    sum(0),
+    sum_wait(0)
+  {
+    std::fill(histogram, histogram + NUM_BUCKETS, 0);
+  }
+
+  //----------------------------------------------------------------------------
+  void CLProfiler::KernelStats::add(double exec_ms, double wait_ms)
+  {
+    count += 1;
+    min = std::min(min, exec_ms);
+    max = std::max(max, exec_ms);
+    sum += exec_ms;
+    sum_wait += wait_ms;
+
+    double us = exec_ms * 1000;
+    size_t bucket = us < 1 ? 0 : static_cast<size_t>(std::log2(us));
+    histogram[ std::min(bucket, NUM_BUCKETS - 1) ] += 1;
+  }
+
+  //----------------------------------------------------------------------------
+  CLProfiler::CLProfiler():
+    _enabled(true),
+    _num_frames(0)
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  void CLProfiler::add(const std::string& kernel, const cl::Event& event)
+  {
+    if( _enabled )
+      _pending.push_back(std::make_pair(kernel, event));
+  }
+
+  //----------------------------------------------------------------------------
+  void CLProfiler::discardFrame()
+  {
+    _pending.clear();
+  }
+
+  //----------------------------------------------------------------------------
+  void CLProfiler::endFrame(bool verbose)
+  {
+    if( _pending.empty() )
+      return;
+
+    _last_frame.clear();
+    _last_frame.reserve(_pending.size());
+
+    cl_ulong frame_start = std::numeric_limits<cl_ulong>::max();
+    std::vector<cl_ulong> times(4 * _pending.size());
+
+    try
+    {
+      for(size_t i = 0; i < _pending.size(); ++i)
+      {
+        cl::Event& event = _pending[i].second;
+        event.wait();
+
+        cl_ulong* t = &times[4 * i];
+        event.getProfilingInfo(CL_PROFILING_COMMAND_QUEUED, t);
+        event.getProfilingInfo(CL_PROFILING_COMMAND_SUBMIT, t + 1);
+        event.getProfilingInfo(CL_PROFILING_COMMAND_START, t + 2);
+        event.getProfilingInfo(CL_PROFILING_COMMAND_END, t + 3);
+
+        frame_start = std::min(frame_start, t[0]);
+      }
+    }
+    catch(cl::Error& ex)
+    {
+      LOG_WARN("Failed to read profiling info: " << ex.what()
+                                                 << " (" << ex.err() << ")");
+      _pending.clear();
+      return;
+    }
+
+    if( verbose )
+      std::cout << "CLInfo:\n";
+
+    for(size_t i = 0; i < _pending.size(); ++i)
+    {
+      const cl_ulong* t = &times[4 * i];
+
+      Launch launch;
+      launch.kernel = _pending[i].first;
+      launch.queued = (t[0] - frame_start) / 1000000.0;
+      launch.submit = (t[1] - frame_start) / 1000000.0;
+      launch.start  = (t[2] - frame_start) / 1000000.0;
+      launch.end    = (t[3] - frame_start) / 1000000.0;
+      _last_frame.push_back(launch);
+
+      double exec_ms = launch.end - launch.start;
+      _stats[ launch.kernel ].add(exec_ms, launch.start - launch.queued);
+
+      if( verbose )
+        std::cout << " - " << launch.kernel << ": " << exec_ms << "ms\n";
+    }
+
+    _pending.clear();
+    _num_frames += 1;
+  }
+
+  //----------------------------------------------------------------------------
+  void CLProfiler::reset()
+  {
+    _num_frames = 0;
+    _pending.clear();
+    _stats.clear();
+    _last_frame.clear();
+  }
+
+  //----------------------------------------------------------------------------
+  std::string CLProfiler::toJSON() const
+  {
+    std::ostringstream strm;
+    strm << "{\"frames\":" << _num_frames << ",\"kernels\":{";
+
+    for(auto it = _stats.begin(); it != _stats.end(); ++it)
+    {
+      const KernelStats& s = it->second;
+      if( it != _stats.begin() )
+        strm << ",";
+
+      strm << "\"" << it->first << "\":{"
+           << "\"count\":" << s.count << ","
+           << "\"min\":" << s.min << ","
+           << "\"max\":" << s.max << ","
+           << "\"avg\":" << s.sum / s.count << ","
+           << "\"total\":" << s.sum << ","
+           << "\"avg_wait\":" << s.sum_wait / s.count << ","
+           << "\"histogram_us_log2\":[";
+
+      for(size_t i = 0; i < NUM_BUCKETS; ++i)
+        strm << (i ? "," : "") << s.histogram[i];
+      strm << "]}";
+    }
+
+    strm << "},\"last_frame\":[";
+    for(size_t i = 0; i < _last_frame.size(); ++i)
+    {
+      const Launch& l = _last_frame[i];
+      strm << (i ? "," : "")
+           << "{\"kernel\":\"" << l.kernel << "\","
+           << "\"queued\":" << l.queued << ","
+           << "\"submit\":" << l.submit << ","
+           << "\"start\":" << l.start << ","
+           << "\"end\":" << l.end << "}";
+    }
+    strm << "]}";
+
+    return strm.str();
+  }
+
+} // namespace LinksRouting
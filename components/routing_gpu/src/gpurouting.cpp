@@ -35,6 +35,8 @@ namespace LinksRouting
   //----------------------------------------------------------------------------
   GPURouting::GPURouting() :
     Configurable("GPURouting"),
+    _program_specialized(false),
+    _costmap_revision(0),
     _buffer_width(0),
     _buffer_height(0)
   {
@@ -44,6 +46,11 @@ namespace LinksRouting
     registerArg("NumLocalWorkers", _routingNumLocalWorkers = 4);
     registerArg("WorkersWarpSize", _routingLocalWorkersWarpSize = 32);
     registerArg("BValue",_Bvalue = 1.0);
+    registerArg("Autotune", _autotune = true);
+    registerArg("SpecializeKernels", _specializeKernels = true);
+    registerArg("AutotuneResults", _autotuneResults);
+    registerArg("Profiling", _profiling = true);
+    registerArg("ProfilingVerbose", _profiling_verbose = false);
   }
 
   //------------------------------------------------------------------------------
@@ -57,10 +64,22 @@ namespace LinksRouting
   {
     _subscribe_costmap =
       slot_subscriber.getSlot<LinksRouting::SlotType::Image>("/costmap");
+    _subscribe_costmap_revision =
+      slot_subscriber.getSlot<uint32_t>("/costmap/revision");
     _subscribe_desktop =
       slot_subscriber.getSlot<LinksRouting::SlotType::Image>("/desktop");
     _subscribe_links =
       slot_subscriber.getSlot<LinkDescription::LinkList>("/links");
+    _subscribe_metrics =
+      slot_subscriber.getSlot<SlotType::Metrics>("/metrics");
+    _subscribe_user_config =
+      slot_subscriber.getSlot<Config*>("/user-config");
+
+    _subscribe_metrics->_data->add
+    (
+      name(),
+      std::bind(&CLProfiler::toJSON, &_profiler)
+    );
   }
 
   //----------------------------------------------------------------------------
@@ -206,7 +225,7 @@ namespace LinksRouting
       std::ifstream source_file("routing.cl");
       if( !source_file )
         throw std::runtime_error("Failed to open routing.cl");
-      std::string source( std::istreambuf_iterator<char>(source_file),
+      _cl_source.assign( std::istreambuf_iterator<char>(source_file),
                          (std::istreambuf_iterator<char>()) );
 
       //now handled via include
@@ -216,51 +235,35 @@ namespace LinksRouting
       //std::string source2( std::istreambuf_iterator<char>(source_file2),
       //                   (std::istreambuf_iterator<char>()) );
 
-      cl::Program::Sources sources;
-      sources.push_back( std::make_pair(source.c_str(), source.length()) );
-      //sources.push_back( std::make_pair(source2.c_str(), source2.length()) );
-
-      _cl_program = cl::Program(_cl_context, sources);
-
       char c_cdir[1024];
       if (!GetCurrentDir(c_cdir, 1024))
         throw std::runtime_error("Failed to retrieve current working directory");
-      try
-      {
-        std::string buildargs;
-        buildargs += "-cl-fast-relaxed-math";
-        buildargs += " -I ";
-        buildargs += c_cdir;
-        //std::cout << buildargs << std::endl;
-        _cl_program.build(devices, buildargs.c_str());
-      }
-      catch(cl::Error& ex)
-      {
-        std::cerr << "Failed to build OpenCL program: "
-                  << " -- Log: " << _cl_program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(_cl_device)
-                  << std::endl;
-        throw;
-      }
-
-      std::cout << "OpenCL Program Build:"
-                << "\n -- Status:\t" << _cl_program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(_cl_device)
-                << "\n -- Options:\t" << _cl_program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(_cl_device)
-                << "\n -- Log: " << _cl_program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(_cl_device)
-                << std::endl;
 
-      _cl_initMem_kernel = cl::Kernel(_cl_program, "initMem");
+      _cl_build_args = "-cl-fast-relaxed-math";
+      _cl_build_args += " -I ";
+      _cl_build_args += c_cdir;
 
-      _cl_updateRouteMap_kernel = cl::Kernel(_cl_program, "updateRouteMap");
-      _cl_prepareBorderCosts_kernel = cl::Kernel(_cl_program, "prepareBorderCosts");
-      _cl_prepareIndividualRouting_kernel = cl::Kernel(_cl_program, "prepareIndividualRouting");
-      _cl_prepareIndividualRoutingParent_kernel = cl::Kernel(_cl_program, "prepareIndividualRoutingParent");
-      _cl_routing_kernel  = cl::Kernel(_cl_program, "routeLocal");
+      // -----------------------------
+      // Kernel configuration (block size, queue size, etc.)
 
+      KernelConfig cfg = getKernelConfig();
+      if( _autotune && loadTunedConfig(cfg) )
+        LOG_INFO("Using tuned kernel config: " << cfg.toString());
+      else if( _autotune )
+      {
+        try
+        {
+          cfg = autotune();
+          storeTunedConfig(cfg);
+        }
+        catch(std::exception& ex)
+        {
+          LOG_WARN("Autotuning failed: " << ex.what());
+        }
+      }
+      setKernelConfig(cfg);
 
-      _cl_voteMinimum_kernel = cl::Kernel(_cl_program, "voteMinimum");
-      _cl_getMinimum_kernel = cl::Kernel(_cl_program, "getMinimum");
-      _cl_routeInterBlock_kernel = cl::Kernel(_cl_program, "calcInterBlockRoute");
-      _cl_routeConstruct_kernel = cl::Kernel(_cl_program, "routeConstruct");
+      buildProgram(cfg, _specializeKernels);
     }
     catch(std::exception& ex)
     {
@@ -276,7 +279,478 @@ namespace LinksRouting
   //----------------------------------------------------------------------------
   void GPURouting::shutdown()
   {
+    if( _subscribe_metrics )
+      _subscribe_metrics->_data->remove(name());
+  }
 
+  //----------------------------------------------------------------------------
+  GPURouting::KernelConfig::KernelConfig():
+    queue_size(128),
+    num_local_workers(4),
+    warp_size(32)
+  {
+    block_size[0] = block_size[1] = 8;
+  }
+
+  //----------------------------------------------------------------------------
+  bool GPURouting::KernelConfig::operator==(const KernelConfig& rhs) const
+  {
+    return block_size[0] == rhs.block_size[0]
+        && block_size[1] == rhs.block_size[1]
+        && queue_size == rhs.queue_size
+        && num_local_workers == rhs.num_local_workers
+        && warp_size == rhs.warp_size;
+  }
+
+  //----------------------------------------------------------------------------
+  std::string GPURouting::KernelConfig::buildOptions() const
+  {
+    std::ostringstream strm;
+    strm << " -D BLOCK_SIZE_X=" << block_size[0]
+         << " -D BLOCK_SIZE_Y=" << block_size[1]
+         << " -D ROUTING_QUEUE_SIZE=" << queue_size
+         << " -D ROUTING_NUM_LOCAL_WORKERS=" << num_local_workers;
+    return strm.str();
+  }
+
+  //----------------------------------------------------------------------------
+  std::string GPURouting::KernelConfig::toString() const
+  {
+    std::ostringstream strm;
+    strm << block_size[0] << " "
+         << block_size[1] << " "
+         << queue_size << " "
+         << num_local_workers << " "
+         << warp_size;
+    return strm.str();
+  }
+
+  //----------------------------------------------------------------------------
+  bool GPURouting::KernelConfig::fromString(const std::string& str)
+  {
+    KernelConfig cfg;
+    std::istringstream strm(str);
+    strm >> cfg.block_size[0]
+         >> cfg.block_size[1]
+         >> cfg.queue_size
+         >> cfg.num_local_workers
+         >> cfg.warp_size;
+
+    if(    !strm
+        || cfg.block_size[0] < 2 || cfg.block_size[1] < 2
+        || cfg.queue_size < 1
+        || cfg.num_local_workers < 1
+        || cfg.warp_size < 1 )
+      return false;
+
+    *this = cfg;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  GPURouting::KernelConfig GPURouting::getKernelConfig() const
+  {
+    KernelConfig cfg;
+    cfg.block_size[0] = _blockSize[0];
+    cfg.block_size[1] = _blockSize[1];
+    cfg.queue_size = _routingQueueSize;
+    cfg.num_local_workers = _routingNumLocalWorkers;
+    cfg.warp_size = _routingLocalWorkersWarpSize;
+    return cfg;
+  }
+
+  //----------------------------------------------------------------------------
+  void GPURouting::setKernelConfig(const KernelConfig& cfg)
+  {
+    _blockSize[0] = cfg.block_size[0];
+    _blockSize[1] = cfg.block_size[1];
+    _routingQueueSize = cfg.queue_size;
+    _routingNumLocalWorkers = cfg.num_local_workers;
+    _routingLocalWorkersWarpSize = cfg.warp_size;
+  }
+
+  //----------------------------------------------------------------------------
+  void GPURouting::buildProgram(const KernelConfig& cfg, bool specialize)
+  {
+    cl::Program::Sources sources;
+    sources.push_back( std::make_pair(_cl_source.c_str(), _cl_source.length()) );
+
+    _cl_program = cl::Program(_cl_context, sources);
+
+    std::string buildargs = _cl_build_args;
+    if( specialize )
+      buildargs += cfg.buildOptions();
+
+    try
+    {
+      _cl_program.build(std::vector<cl::Device>(1, _cl_device), buildargs.c_str());
+    }
+    catch(cl::Error& ex)
+    {
+      std::cerr << "Failed to build OpenCL program: "
+                << " -- Log: " << _cl_program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(_cl_device)
+                << std::endl;
+      throw;
+    }
+
+    std::cout << "OpenCL Program Build:"
+              << "\n -- Status:\t" << _cl_program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(_cl_device)
+              << "\n -- Options:\t" << _cl_program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(_cl_device)
+              << "\n -- Log: " << _cl_program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(_cl_device)
+              << std::endl;
+
+    _cl_initMem_kernel = cl::Kernel(_cl_program, "initMem");
+
+    _cl_updateRouteMap_kernel = cl::Kernel(_cl_program, "updateRouteMap");
+    _cl_prepareBorderCosts_kernel = cl::Kernel(_cl_program, "prepareBorderCosts");
+    _cl_prepareIndividualRouting_kernel = cl::Kernel(_cl_program, "prepareIndividualRouting");
+    _cl_prepareIndividualRoutingParent_kernel = cl::Kernel(_cl_program, "prepareIndividualRoutingParent");
+    _cl_routing_kernel  = cl::Kernel(_cl_program, "routeLocal");
+
+
+    _cl_voteMinimum_kernel = cl::Kernel(_cl_program, "voteMinimum");
+    _cl_getMinimum_kernel = cl::Kernel(_cl_program, "getMinimum");
+    _cl_routeInterBlock_kernel = cl::Kernel(_cl_program, "calcInterBlockRoute");
+    _cl_routeConstruct_kernel = cl::Kernel(_cl_program, "routeConstruct");
+
+    _program_config = cfg;
+    _program_specialized = specialize;
+
+    // Layout of the route map depends on the block size, so recreate buffers
+    // and reroute everything.
+    _buffer_width = _buffer_height = 0;
+    _link_infos.clear();
+  }
+
+  //----------------------------------------------------------------------------
+  std::string GPURouting::getDeviceKey() const
+  {
+    std::string key = _cl_device.getInfo<CL_DEVICE_NAME>()
+                    + " "
+                    + _cl_device.getInfo<CL_DRIVER_VERSION>();
+
+    // Strip trailing '\0' and separators used in the stored results
+    key.erase(std::remove(key.begin(), key.end(), '\0'), key.end());
+    std::replace(key.begin(), key.end(), '|', '_');
+    std::replace(key.begin(), key.end(), ';', '_');
+    return key;
+  }
+
+  //----------------------------------------------------------------------------
+  bool GPURouting::loadTunedConfig(KernelConfig& cfg) const
+  {
+    const std::string key = getDeviceKey() + "|";
+
+    std::istringstream strm(_autotuneResults);
+    std::string entry;
+    while( std::getline(strm, entry, ';') )
+    {
+      if( entry.compare(0, key.length(), key) == 0 )
+        return cfg.fromString(entry.substr(key.length()));
+    }
+
+    return false;
+  }
+
+  //----------------------------------------------------------------------------
+  void GPURouting::storeTunedConfig(const KernelConfig& cfg)
+  {
+    const std::string key = getDeviceKey() + "|";
+
+    // Replace eventually existing entry for the same device
+    std::string results;
+    std::istringstream strm(_autotuneResults);
+    std::string entry;
+    while( std::getline(strm, entry, ';') )
+    {
+      if( entry.empty() || entry.compare(0, key.length(), key) == 0 )
+        continue;
+      results += entry + ";";
+    }
+    results += key + cfg.toString();
+
+    if( _subscribe_user_config && *_subscribe_user_config->_data )
+      (*_subscribe_user_config->_data)
+        ->setString("GPURouting:AutotuneResults", results);
+    _autotuneResults = results;
+  }
+
+  //----------------------------------------------------------------------------
+  GPURouting::KernelConfig GPURouting::autotune()
+  {
+    LOG_INFO("Autotuning routing kernels for '" << getDeviceKey() << "'");
+
+    // Synthetic costmap: low cost background with some expensive rectangles
+    // (like windows on a desktop) at deterministic positions.
+    const int width = 256,
+              height = 160;
+    std::vector<cl_float> costs(width * height, 0.01f);
+
+    unsigned int seed = 4711;
+    for(int i = 0; i < 24; ++i)
+    {
+      seed = seed * 1103515245 + 12345;
+      int x = (seed >> 8) % width;
+      seed = seed * 1103515245 + 12345;
+      int y = (seed >> 8) % height;
+      seed = seed * 1103515245 + 12345;
+      int w = 8 + (seed >> 8) % 64;
+      seed = seed * 1103515245 + 12345;
+      int h = 8 + (seed >> 8) % 48;
+      float cost = 0.2f + 0.1f * (i % 8);
+
+      for(int cy = y; cy < std::min(y + h, height); ++cy)
+        for(int cx = x; cx < std::min(x + w, width); ++cx)
+          costs[cx + cy * width] = std::max(costs[cx + cy * width], cost);
+    }
+
+    cl::Image2D costmap
+    (
+      _cl_context,
+      CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+      cl::ImageFormat(CL_R, CL_FLOAT),
+      width,
+      height,
+      0,
+      &costs[0]
+    );
+
+    // Tune parameters one after another (block size, queue/workers, warp
+    // size) to keep the number of program builds low.
+    KernelConfig best = getKernelConfig();
+    double best_time = benchmarkConfig(best, costmap, width, height);
+
+    auto tryConfig = [&](const KernelConfig& cfg)
+    {
+      if( cfg == best )
+        return;
+
+      double time = benchmarkConfig(cfg, costmap, width, height);
+      if( time < best_time )
+      {
+        best = cfg;
+        best_time = time;
+      }
+    };
+
+    const int block_sizes[][2] = { {8, 8}, {16, 8}, {16, 16} };
+    for(size_t i = 0; i < sizeof(block_sizes) / sizeof(block_sizes[0]); ++i)
+    {
+      KernelConfig cfg = best;
+      cfg.block_size[0] = block_sizes[i][0];
+      cfg.block_size[1] = block_sizes[i][1];
+      tryConfig(cfg);
+    }
+
+    const int queue_sizes[] = {64, 128, 256};
+    const int num_workers[] = {2, 4, 8};
+    for(size_t i = 0; i < sizeof(queue_sizes) / sizeof(queue_sizes[0]); ++i)
+      for(size_t j = 0; j < sizeof(num_workers) / sizeof(num_workers[0]); ++j)
+      {
+        KernelConfig cfg = best;
+        cfg.queue_size = queue_sizes[i];
+        cfg.num_local_workers = num_workers[j];
+        tryConfig(cfg);
+      }
+
+    // Warp size preferred by the device (eg. 1 for CPU runtimes)
+    buildProgram(best, true);
+    int warp_sizes[] = {
+      32,
+      static_cast<int>(
+        _cl_routing_kernel
+          .getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(_cl_device)
+      )
+    };
+    for(size_t i = 0; i < sizeof(warp_sizes) / sizeof(warp_sizes[0]); ++i)
+    {
+      KernelConfig cfg = best;
+      cfg.warp_size = std::max(warp_sizes[i], 1);
+      tryConfig(cfg);
+    }
+
+    if( best_time == std::numeric_limits<double>::max() )
+      throw std::runtime_error("No valid kernel configuration found.");
+
+    LOG_INFO("Autotuning finished: " << best.toString()
+                                     << " (" << best_time << "ms)");
+    return best;
+  }
+
+  //----------------------------------------------------------------------------
+  double GPURouting::benchmarkConfig( const KernelConfig& cfg,
+                                      const cl::Image2D& costmap,
+                                      int width, int height )
+  {
+    int bs[2] = { cfg.block_size[0], cfg.block_size[1] };
+    const int boundaryElements = 2*(bs[0] + bs[1]-2);
+    const int localWorkerSize = divup(boundaryElements, cfg.warp_size)*cfg.warp_size;
+
+    // Check device limits
+    const size_t max_work_group =
+      _cl_device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+    const cl_ulong local_mem = _cl_device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+    const size_t route_local_mem =
+      (cfg.num_local_workers*(boundaryElements+1) + cfg.queue_size + boundaryElements)
+      * sizeof(cl_float);
+
+    if(    static_cast<size_t>(bs[0] * bs[1]) > max_work_group
+        || static_cast<size_t>(localWorkerSize * cfg.num_local_workers) > max_work_group
+        || 2*(bs[0]+2)*(bs[1]+2)*sizeof(float) + sizeof(int) > local_mem
+        || route_local_mem > local_mem )
+      return std::numeric_limits<double>::max();
+
+    try
+    {
+      buildProgram(cfg, true);
+
+      int blocks[2] = { divup(width, bs[0]-1), divup(height, bs[1]-1) };
+      cl_int bufferDim[2] = { width, height };
+
+      cl::Buffer lastCostMap(_cl_context, CL_MEM_READ_WRITE, width*height*sizeof(cl_float));
+      cl::Buffer routeMap(_cl_context, CL_MEM_READ_WRITE, blocks[0]*blocks[1]*boundaryElements*(boundaryElements+1)/2*sizeof(cl_float));
+
+      int rowelements = blocks[0]*(bs[0]-1)+1;
+      int colelements = (blocks[0]+1)*(bs[1]-2);
+      int requiredElements = (blocks[1]+1)*rowelements + blocks[1]*colelements;
+      cl::Buffer routingData(_cl_context, CL_MEM_READ_WRITE, sizeof(cl_float)*requiredElements);
+
+      // Route from a single target in the center of the costmap
+      int4 target(width/2 - 2, height/2 - 2, width/2 + 2, height/2 + 2);
+      cl_uint routingId = 0;
+      std::vector<cl_int4> startingBlocks;
+      for(int y = target.y/(bs[1]-1); y < divup(target.w,bs[1]-1); ++y)
+        for(int x = target.x/(bs[0]-1); x < divup(target.z,bs[0]-1); ++x)
+        {
+          cl_int4 nblock;
+          nblock.s[0] = x; nblock.s[1] = y; nblock.s[2] = 0; nblock.s[3] = routingId;
+          startingBlocks.push_back(nblock);
+        }
+
+      int maxInitDim = sqrt(static_cast<float>(cfg.queue_size))/2;
+      int4 startBlockRange(std::max(0, target.x/(bs[0]-1) - maxInitDim/2),
+                           std::max(0, target.y/(bs[1]-1) - maxInitDim/2),
+                           std::min(blocks[0]-1, target.z/(bs[0]-1) + maxInitDim/2 + 1),
+                           std::min(blocks[1]-1, target.w/(bs[1]-1) + maxInitDim/2 + 1));
+
+      cl::Buffer d_routingIds(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint), &routingId);
+      cl::Buffer d_routingPoints(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int4), &target);
+      cl::Buffer d_startingBlocks(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, startingBlocks.size()*sizeof(cl_int4), &startingBlocks[0]);
+      cl::Buffer d_startBlockRange(_cl_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_int4), &startBlockRange);
+
+      cl_uint activeBufferSize[] = {divup(blocks[0],8), divup(blocks[1],8)};
+      cl::Buffer d_routeActive(_cl_context, CL_MEM_READ_WRITE, 2*activeBufferSize[0]*activeBufferSize[1]*sizeof(cl_uint));
+
+      _cl_updateRouteMap_kernel.setArg(0, costmap);
+      _cl_updateRouteMap_kernel.setArg(1, lastCostMap);
+      _cl_updateRouteMap_kernel.setArg(2, routeMap);
+      _cl_updateRouteMap_kernel.setArg(3, 2 * sizeof(cl_int), bufferDim);
+      _cl_updateRouteMap_kernel.setArg(4, 1);
+      _cl_updateRouteMap_kernel.setArg(5, 2*(bs[0]+2)*(bs[1]+2)*sizeof(float), NULL);
+      _cl_updateRouteMap_kernel.setArg(6, sizeof(int), NULL);
+
+      _cl_prepareBorderCosts_kernel.setArg(0, routingData);
+
+      _cl_prepareIndividualRouting_kernel.setArg(0, lastCostMap);
+      _cl_prepareIndividualRouting_kernel.setArg(1, routingData);
+      _cl_prepareIndividualRouting_kernel.setArg(2, d_routingPoints);
+      _cl_prepareIndividualRouting_kernel.setArg(3, d_startingBlocks);
+      _cl_prepareIndividualRouting_kernel.setArg(4, 2 * sizeof(cl_int), bufferDim);
+      _cl_prepareIndividualRouting_kernel.setArg(5, 2 * sizeof(cl_int), blocks);
+      _cl_prepareIndividualRouting_kernel.setArg(6, sizeof(cl_int), &requiredElements);
+      _cl_prepareIndividualRouting_kernel.setArg(7, 2*(bs[0]+2)*(bs[1]+2)*sizeof(float), NULL);
+      _cl_prepareIndividualRouting_kernel.setArg(8, sizeof(int), NULL);
+
+      _cl_initMem_kernel.setArg(0, d_routeActive);
+      _cl_initMem_kernel.setArg(1, 0);
+
+      _cl_routing_kernel.setArg(0, routeMap);
+      _cl_routing_kernel.setArg(1, d_startBlockRange);
+      _cl_routing_kernel.setArg(2, d_routingIds);
+      _cl_routing_kernel.setArg(3, routingData);
+      _cl_routing_kernel.setArg(4, requiredElements);
+      _cl_routing_kernel.setArg(5, 2 * sizeof(cl_int), bs);
+      _cl_routing_kernel.setArg(6, 2 * sizeof(cl_int), blocks);
+      _cl_routing_kernel.setArg(7, cfg.num_local_workers*(boundaryElements+1)*sizeof(cl_float), NULL);
+      _cl_routing_kernel.setArg(8, cfg.queue_size * sizeof(cl_int), NULL);
+      _cl_routing_kernel.setArg(9, cfg.queue_size);
+      _cl_routing_kernel.setArg(10, d_routeActive);
+      _cl_routing_kernel.setArg(11, 2 * sizeof(cl_int), activeBufferSize);
+      _cl_routing_kernel.setArg(12, boundaryElements * sizeof(cl_uint), NULL);
+
+      // Take the best of a few runs (first one includes warm up)
+      double best = std::numeric_limits<double>::max();
+      for(int run = 0; run < 3; ++run)
+      {
+        std::vector<cl::Event> events(5);
+        _cl_command_queue.enqueueNDRangeKernel
+        (
+          _cl_updateRouteMap_kernel,
+          cl::NullRange,
+          cl::NDRange(blocks[0]*bs[0], blocks[1]*bs[1]),
+          cl::NDRange(bs[0], bs[1]),
+          0,
+          &events[0]
+        );
+        _cl_command_queue.enqueueNDRangeKernel
+        (
+          _cl_prepareBorderCosts_kernel,
+          cl::NullRange,
+          cl::NDRange(requiredElements, 1),
+          cl::NullRange,
+          0,
+          &events[1]
+        );
+        _cl_command_queue.enqueueNDRangeKernel
+        (
+          _cl_prepareIndividualRouting_kernel,
+          cl::NullRange,
+          cl::NDRange(bs[0]*startingBlocks.size(), bs[1]),
+          cl::NDRange(bs[0], bs[1]),
+          0,
+          &events[2]
+        );
+        _cl_command_queue.enqueueNDRangeKernel
+        (
+          _cl_initMem_kernel,
+          cl::NullRange,
+          cl::NDRange(2*activeBufferSize[0], activeBufferSize[1]),
+          cl::NullRange,
+          0,
+          &events[3]
+        );
+        _cl_command_queue.enqueueNDRangeKernel
+        (
+          _cl_routing_kernel,
+          cl::NullRange,
+          cl::NDRange(localWorkerSize, cfg.num_local_workers),
+          cl::NDRange(localWorkerSize, cfg.num_local_workers),
+          0,
+          &events[4]
+        );
+        _cl_command_queue.finish();
+
+        double time = 0;
+        for(size_t i = 0; i < events.size(); ++i)
+        {
+          cl_ulong start, end;
+          events[i].getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
+          events[i].getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
+          time += (end - start) / 1000000.0;
+        }
+        best = std::min(best, time);
+      }
+
+      LOG_INFO("Autotune: " << cfg.toString() << " -> " << best << "ms");
+      return best;
+    }
+    catch(cl::Error& ex)
+    {
+      LOG_WARN("Autotune: " << cfg.toString() << " failed: " << ex.what()
+                                               << " (" << ex.err() << ")");
+      _cl_command_queue.finish();
+      return std::numeric_limits<double>::max();
+    }
   }
 
   //----------------------------------------------------------------------------
@@ -458,7 +932,7 @@ namespace LinksRouting
   }
 
   //----------------------------------------------------------------------------
-  void GPURouting::process(unsigned int type)
+  uint32_t GPURouting::process(unsigned int type)
   {
 
     //----------------------
@@ -467,36 +941,44 @@ namespace LinksRouting
     if( !_subscribe_costmap->isValid() )
     {
       std::cerr << "GPURouting: No valid costmap received." << std::endl;
-      return;
+      return 0;
     }
 
     if( !_subscribe_desktop->isValid() )
     {
       std::cerr << "GPURouting: No valid desktop image received." << std::endl;
-      return;
+      return 0;
     }
 
     if( _subscribe_costmap->_data->type != SlotType::Image::OpenGLTexture )
     {
       std::cerr << "GPURouting: No OpenGL texture costmap received." << std::endl;
-      return;
+      return 0;
     }
 
     if(    !_subscribe_costmap->_data->width
         || !_subscribe_costmap->_data->height )
     {
       std::cerr << "GPURouting: Invalide costmap dimensions (=0)." << std::endl;
-      return;
+      return 0;
     }
 
     if( !_subscribe_links->isValid() )
     {
       LOG_DEBUG("No valid routing data available.");
-      return;
+      return 0;
     }
 
+    _profiler.setEnabled(_profiling);
+
     try
     {
+    // Kernel parameters might have been changed at runtime
+    const KernelConfig cfg = getKernelConfig();
+    if(    _program_specialized != _specializeKernels
+        || (_specializeKernels && cfg != _program_config) )
+      buildProgram(cfg, _specializeKernels);
+
     updateRouteMap();
 
     // now start analyzing the links
@@ -510,15 +992,24 @@ namespace LinksRouting
 //    unsigned int numBlocks[2] = {divup<unsigned>(width,_blockSize[0]),divup<unsigned>(height,_blockSize[1])};
 //    unsigned int sumBlocks = numBlocks[0]*numBlocks[1];
 
+    // Reroute all links if the screen (and therefore the costmap) has changed
+    bool costmap_changed = false;
+    if(    _subscribe_costmap_revision->isValid()
+        && *_subscribe_costmap_revision->_data != _costmap_revision )
+    {
+      costmap_changed = true;
+      _costmap_revision = *_subscribe_costmap_revision->_data;
+    }
+
     for( auto it = links.begin(); it != links.end(); ++it )
     {
       auto info = _link_infos.find(it->_id);
 
 
-      if(    info != _link_infos.end()
+      if(    !costmap_changed
+          && info != _link_infos.end()
           && info->second._stamp == it->_stamp
           && info->second._revision == it->_link->getRevision() )
-        //TODO: check if screen has changed -> update
         continue;
 
       LOG_INFO("NEW DATA to route: "
@@ -998,13 +1489,22 @@ namespace LinksRouting
       //throw std::runtime_error("Done routing!");
     }
 
+    _profiler.endFrame(_profiling_verbose);
 
     }
     catch(cl::Error& err)
     {
       std::cerr << err.err() << "->" << err.what() << std::endl;
+      _profiler.discardFrame();
       throw;
     }
+    catch(...)
+    {
+      _profiler.discardFrame();
+      throw;
+    }
+
+    return 0;
   }
   //kernel test
 
@@ -2424,12 +2924,7 @@ void calcInterBlockRouteDummy(const float* routecost,
     int boundaryElements = 2*(_blockSize[0] + _blockSize[1]-2);
     dumpBuffer<float>(_cl_command_queue, _cl_routeMap_buffer, _blocks[0]*boundaryElements, _blocks[1]*boundaryElements/2, fname2.str());
 
-
-    cl_ulong start, end;
-    std::cout << "CLInfo:\n";
-    updateRouteMap_Event.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-    updateRouteMap_Event.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-    std::cout << " - updateRouteMap: " << (end-start)/1000000.0  << "ms\n";
+    _profiler.add("updateRouteMap", updateRouteMap_Event);
   }
 
   bool getTargetRect(const std::vector<float2> &vertices, int4& target, int downsample, int buffer_width, int buffer_height)
@@ -2510,7 +3005,6 @@ void calcInterBlockRouteDummy(const float* routecost,
 
     int downsample = _subscribe_desktop->_data->width / _subscribe_costmap->_data->width;
     int boundaryElements = 2*(_blockSize[0] + _blockSize[1]-2);
-    cl_ulong start, end;
 
     //there can be loops due to hyperedges connecting the same nodes, so we have to avoid double entries
     //the same way, one node could be put on different levels, so we need to analyse the nodes level first
@@ -2598,9 +3092,7 @@ void calcInterBlockRouteDummy(const float* routecost,
       &prepareBorderCostsEvent
     );
     _cl_command_queue.finish();
-    prepareBorderCostsEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-    prepareBorderCostsEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-    std::cout << " - prepareBorderCosts: " << (end-start)/1000000.0  << "ms\n";
+    _profiler.add("prepareBorderCosts", prepareBorderCostsEvent);
 
 
     //bottom up routing -> for every level do:
@@ -2736,9 +3228,7 @@ void calcInterBlockRouteDummy(const float* routecost,
           );
 
           _cl_command_queue.finish();
-          prepareIndividualRoutingEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          prepareIndividualRoutingEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - prepareIndividualRouting: " << (end-start)/1000000.0  << "ms\n";
+          _profiler.add("prepareIndividualRouting", prepareIndividualRoutingEvent);
 
           ////debug:
           //std::vector<float> mem(requiredElements*slices);
@@ -2785,9 +3275,7 @@ void calcInterBlockRouteDummy(const float* routecost,
           );
 
           _cl_command_queue.finish();
-          prepareIndividualRoutingParentEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          prepareIndividualRoutingParentEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - prepareIndividualRoutingParent: " << (end-start)/1000000.0  << "ms\n";
+          _profiler.add("prepareIndividualRoutingParent", prepareIndividualRoutingParentEvent);
           //dumpBuffer<float>(_cl_command_queue, d_routingData, requiredElements, slices, "routingPrepareFromParent");
         }
 
@@ -2865,9 +3353,7 @@ void calcInterBlockRouteDummy(const float* routecost,
             &clearActiveBufferEvent
           );
           _cl_command_queue.finish();
-          clearActiveBufferEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          clearActiveBufferEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - clearActiveBuffer: " << (end-start)/1000000.0  << "ms\n";
+          _profiler.add("initMem", clearActiveBufferEvent);
 
 
 
@@ -2898,9 +3384,7 @@ void calcInterBlockRouteDummy(const float* routecost,
             &routingRoutingEvent
           );
           _cl_command_queue.finish();
-          routingRoutingEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          routingRoutingEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - routingRouting: " << (end-start)/1000000.0  << "ms\n";
+          _profiler.add("routeLocal", routingRoutingEvent);
           //printfBuffer<uint>(_cl_command_queue, d_routeActive, 2*activeBufferSize[0], activeBufferSize[1]*startBlockRange.size(), "activeBuffer");
           //dumpBuffer<float>(_cl_command_queue, d_routingData, requiredElements, slices, "routingRouting");
         }
@@ -2996,9 +3480,7 @@ void calcInterBlockRouteDummy(const float* routecost,
           //debug
           _cl_command_queue.enqueueReadBuffer(d_voteMin, true, 0, voteMin.size()*sizeof(float), &voteMin[0]);
           //
-          routingVoteMinEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          routingVoteMinEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - routingVoteMin: " << (end-start)/1000000.0  << "ms\n";
+          _profiler.add("voteMinimum", routingVoteMinEvent);
 
 
           int maxResults = 3*32+1;
@@ -3035,9 +3517,7 @@ void calcInterBlockRouteDummy(const float* routecost,
             &routingGetMinEvent
           );
           _cl_command_queue.finish();
-          routingGetMinEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          routingGetMinEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - routingGetMin: " << (end-start)/1000000.0  << "ms\n";
+          _profiler.add("getMinimum", routingGetMinEvent);
 
           _cl_command_queue.enqueueReadBuffer(d_minSearchResults, true, 0, minSearchResults.size()*sizeof(uint), &minSearchResults[0]);
           auto thisdatastart = minSearchResults.begin();
@@ -3217,9 +3697,7 @@ void calcInterBlockRouteDummy(const float* routecost,
             &routingRouteInterBlockEvent
           );
           _cl_command_queue.finish();
-          routingRouteInterBlockEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          routingRouteInterBlockEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - routingRouteInterBlock: " << (end-start)/1000000.0  << "ms\n";
+          _profiler.add("calcInterBlockRoute", routingRouteInterBlockEvent);
 
           std::vector<uint> blockRoutes(needRouteConstructionElements.size()*maxBlocksForRoute);
           _cl_command_queue.enqueueReadBuffer(d_blockRoutes, true, 0, blockRoutes.size()*sizeof(uint), &blockRoutes[0]);
@@ -3285,9 +3763,7 @@ void calcInterBlockRouteDummy(const float* routecost,
             &routingRouteConstructEvent
           );
           _cl_command_queue.finish();
-          routingRouteConstructEvent.getProfilingInfo(CL_PROFILING_COMMAND_END, &end);
-          routingRouteConstructEvent.getProfilingInfo(CL_PROFILING_COMMAND_START, &start);
-          std::cout << " - routingRouteConstruct: " << (end-start)/1000000.0  << "ms\n";
+          _profiler.add("routeConstruct", routingRouteConstructEvent);
 
           std::vector<uint> innerBlockRoutes(innerBlockRoutesSize);
           _cl_command_queue.enqueueReadBuffer(d_innerBlockRoutes, true, 0, innerBlockRoutesSize*sizeof(uint), &innerBlockRoutes[0]);
@@ -10,6 +10,7 @@
 
 #include <slots.hpp>
 #include <slotdata/component_selection.hpp>
+#include <slotdata/metrics.hpp>
 
 #include <list>
 #include <stdexcept>
@@ -82,6 +83,9 @@ namespace LinksRouting
 
       slot_t<Config*>::type _slot_user_config;
 
+      /** Runtime statistics provided by the components */
+      slot_t<SlotType::Metrics>::type _slot_metrics;
+
       std::string _default_routing;
 
       void initConfig(Config* config);
@@ -127,6 +127,9 @@ namespace LinksRouting
     _slot_user_config = getSlotCollector().create<Config*>("/user-config");
     *_slot_user_config->_data = _user_config;
 
+    _slot_metrics = getSlotCollector().create<SlotType::Metrics>("/metrics");
+    _slot_metrics->setValid(true);
+
     for( auto c = _components.begin(); c != _components.end(); ++c )
     {
       c->comp->init();
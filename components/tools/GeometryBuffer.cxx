@@ -0,0 +1,131 @@
+/*
+ * GeometryBuffer.cxx
+ *
+ *  Created on: 19.10.2026
+ */
+
+#include "GeometryBuffer.hpp"
+
+#ifdef WIN32
+# include <GL/glew.h>
+#else
+# define GL_GLEXT_PROTOTYPES 1
+# include <GL/gl.h>
+# include <GL/glext.h>
+#endif
+
+#include <cstddef>
+
+namespace LinksRouting
+{
+
+  //----------------------------------------------------------------------------
+  GeometryBuffer::GeometryBuffer():
+    _vbo(0),
+    _modified(false)
+  {
+
+  }
+
+  //----------------------------------------------------------------------------
+  GeometryBuffer::~GeometryBuffer()
+  {
+    if( _vbo )
+      glDeleteBuffers(1, &_vbo);
+  }
+
+  //----------------------------------------------------------------------------
+  void GeometryBuffer::clear()
+  {
+    _vertices.clear();
+    _batches.clear();
+    _modified = true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool GeometryBuffer::empty() const
+  {
+    return _vertices.empty();
+  }
+
+  //----------------------------------------------------------------------------
+  void GeometryBuffer::draw()
+  {
+    if( _vertices.empty() )
+      return;
+
+    if( !_vbo )
+      glGenBuffers(1, &_vbo);
+
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+
+    // Links usually do not change between frames, so the geometry is kept
+    // (and not uploaded again) until it is rebuilt.
+    if( _modified )
+    {
+      glBufferData( GL_ARRAY_BUFFER,
+                    _vertices.size() * sizeof(Vertex),
+                    &_vertices[0],
+                    GL_DYNAMIC_DRAW );
+      _modified = false;
+    }
+
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer( 2,
+                     GL_FLOAT,
+                     sizeof(Vertex),
+                     reinterpret_cast<void*>(offsetof(Vertex, pos)) );
+    glColorPointer( 4,
+                    GL_FLOAT,
+                    sizeof(Vertex),
+                    reinterpret_cast<void*>(offsetof(Vertex, color)) );
+
+    for(auto batch = _batches.begin(); batch != _batches.end(); ++batch)
+    {
+      if( batch->stencil == STENCIL_WRITE )
+      {
+        glStencilFunc(GL_ALWAYS, 1, 1);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+      }
+      else if( batch->stencil == STENCIL_TEST )
+      {
+        glStencilFunc(GL_EQUAL, 0, 1);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+      }
+
+      glDrawArrays(GL_TRIANGLES, batch->first, batch->count);
+    }
+
+    glPopClientAttrib();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  //----------------------------------------------------------------------------
+  void GeometryBuffer::addTriangle( const float2& a,
+                                    const float2& b,
+                                    const float2& c,
+                                    const Color& color,
+                                    StencilMode stencil )
+  {
+    if( _batches.empty() || _batches.back().stencil != stencil )
+    {
+      Batch batch = {stencil, _vertices.size(), 0};
+      _batches.push_back(batch);
+    }
+
+    const float2* points[3] = {&a, &b, &c};
+    for(size_t i = 0; i < 3; ++i)
+    {
+      Vertex v = {
+        {points[i]->x, points[i]->y},
+        {color.r, color.g, color.b, color.a}
+      };
+      _vertices.push_back(v);
+    }
+    _batches.back().count += 3;
+    _modified = true;
+  }
+
+} // namespace LinksRouting
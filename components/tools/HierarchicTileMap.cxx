@@ -6,6 +6,8 @@
  */
 
 #include "HierarchicTileMap.hpp"
+#include "TileAtlas.hpp"
+#include "TileStore.hpp"
 
 #include <GL/gl.h>
 
@@ -13,6 +15,68 @@
 #include <cassert>
 #include <cstdint>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define LR_USE_SSE 1
+# include <emmintrin.h>
+#endif
+
+//------------------------------------------------------------------------------
+/**
+ * Halve the size of an RGBA image with a 2x2 box filter. Odd edges are
+ * handled by repeating the last row/column.
+ *
+ * @param dest_stride   Pixels per row of @a dest
+ */
+static void downsample( const uint8_t* src,
+                        size_t src_width,
+                        size_t src_height,
+                        uint8_t* dest,
+                        size_t dest_stride,
+                        size_t width,
+                        size_t height )
+{
+  for(size_t y = 0; y < height; ++y)
+  {
+    const uint8_t* row0 = src + 4 * src_width * std::min(2 * y, src_height - 1),
+                 * row1 = src + 4 * src_width * std::min(2 * y + 1, src_height - 1);
+    uint8_t* out = dest + 4 * dest_stride * y;
+
+    size_t x = 0;
+#if LR_USE_SSE
+    // 8 source pixels to 4 destination pixels per step (rounding up twice is
+    // fine for previews)
+    for(; x + 4 <= width && 2 * x + 8 <= src_width; x += 4)
+    {
+      __m128i a = _mm_avg_epu8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8 * x)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8 * x))
+      );
+      __m128i b = _mm_avg_epu8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8 * x + 16)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8 * x + 16))
+      );
+      __m128 even = _mm_shuffle_ps( _mm_castsi128_ps(a),
+                                    _mm_castsi128_ps(b),
+                                    _MM_SHUFFLE(2, 0, 2, 0) ),
+             odd  = _mm_shuffle_ps( _mm_castsi128_ps(a),
+                                    _mm_castsi128_ps(b),
+                                    _MM_SHUFFLE(3, 1, 3, 1) );
+      _mm_storeu_si128( reinterpret_cast<__m128i*>(out + 4 * x),
+                        _mm_avg_epu8( _mm_castps_si128(even),
+                                      _mm_castps_si128(odd) ) );
+    }
+#endif
+    for(; x < width; ++x)
+    {
+      const size_t x0 = 4 * std::min(2 * x, src_width - 1),
+                   x1 = 4 * std::min(2 * x + 1, src_width - 1);
+      for(size_t c = 0; c < 4; ++c)
+        out[4 * x + c] = ( row0[x0 + c] + row0[x1 + c]
+                         + row1[x0 + c] + row1[x1 + c] + 2 ) / 4;
+    }
+  }
+}
+
 //----------------------------------------------------------------------------
 Layer::Layer(HierarchicTileMap* map):
   _map(map)
@@ -104,6 +168,8 @@ MapRect::QuadList MapRect::getQuads() const
            bottom = max_y - min[1];
 
     Quads quads;
+    quads._x = x;
+    quads._y = y;
     quads._tex_coords.push_back(float2(tex_min.x, tex_min.y));
     quads._tex_coords.push_back(float2(tex_max.x, tex_min.y));
     quads._tex_coords.push_back(float2(tex_max.x, tex_max.y));
@@ -150,6 +216,13 @@ void MapRect::foreachTile(const MapRect::tile_callback_t& func) const
       func(layer.getTile(x, y), x, y);
 }
 
+//------------------------------------------------------------------------------
+static unsigned int nextId()
+{
+  static unsigned int id = 0;
+  return ++id;
+}
+
 //------------------------------------------------------------------------------
 HierarchicTileMap::HierarchicTileMap( unsigned int width,
                                       unsigned int height,
@@ -157,13 +230,21 @@ HierarchicTileMap::HierarchicTileMap( unsigned int width,
                                       unsigned int tile_height ):
    margin_left(0),
    margin_right(0),
+   persistent_id(0),
+  _id( nextId() ),
   _width( width ),
   _height( height ),
   _tile_width( tile_width ),
   _tile_height( tile_height ),
   _change_id(0)
 {
+  TileStore::getInstance().addMap(this);
+}
 
+//------------------------------------------------------------------------------
+HierarchicTileMap::~HierarchicTileMap()
+{
+  TileStore::getInstance().removeMap(this);
 }
 
 //------------------------------------------------------------------------------
@@ -207,124 +288,139 @@ MapRect HierarchicTileMap::requestRect(const Rect& rect, size_t zoom)
 void HierarchicTileMap::setTileData( size_t x, size_t y, size_t zoom,
                                      const char* data,
                                      size_t data_size )
+{
+  TileDataPtr copy(new uint8_t[data_size], std::default_delete<uint8_t[]>());
+  memcpy(copy.get(), data, data_size);
+
+  setTileData(x, y, zoom, copy, data_size);
+}
+
+//------------------------------------------------------------------------------
+void HierarchicTileMap::setTileData( size_t x, size_t y, size_t zoom,
+                                     const TileDataPtr& data,
+                                     size_t data_size )
 {
   Tile& tile = getLayer(zoom).getTile(x, y);
 
   assert( tile.width * tile.height * 4 == data_size );
 
-  if( tile.type == Tile::ImageRGBA8 )
-    delete[] tile.pdata;
-  tile.pdata = new uint8_t[data_size];
-  memcpy(tile.pdata, data, data_size);
+  storeTile(tile, x, y, zoom, data, data_size);
+  tile.downsampled = false;
 
+  updateCoarserTile(x, y, zoom);
+}
+
+//------------------------------------------------------------------------------
+void HierarchicTileMap::storeTile( Tile& tile,
+                                   size_t x, size_t y, size_t zoom,
+                                   const TileDataPtr& data,
+                                   size_t data_size )
+{
+  const TileKey key = {_id, getLevel(zoom), x, y};
+  tile.pdata = TileStore::getInstance().store(key, data, data_size);
   tile.type = Tile::ImageRGBA8;
 
-  ++_change_id;
+  tile.change_id = ++_change_id;
 
   for(auto cb: _change_callbacks)
     cb(*this, x, y, zoom);
 }
 
 //------------------------------------------------------------------------------
-bool HierarchicTileMap::render( const Rect& src_region,
-                                const float2& src_size,
-                                const Rect& target_region,
-                                size_t zoom,
-                                bool auto_center,
-                                double alpha,
-                                GLImageCache* cache )
+void HierarchicTileMap::updateCoarserTile(size_t x, size_t y, size_t zoom)
 {
-  MapRect rect = requestRect(src_region, zoom);
-  float2 rect_size = rect.getSize();
-  MapRect::QuadList quads = rect.getQuads();
-  for(auto quad = quads.begin(); quad != quads.end(); ++quad)
-  {
-    GLuint tex_id = 0;
-
-    if( quad->first->type == Tile::ImageRGBA8 )
+  // Layers are only aligned to each other for explicit zoom levels, and only
+  // with even tile sizes every tile maps to exactly four tiles of the next
+  // finer layer.
+  if(    zoom == static_cast<size_t>(-1) || zoom == 0
+      || _tile_width % 2 || _tile_height % 2 )
+    return;
+
+  // Layers up to the current one already exist, so references stay valid
+  Layer& coarse_layer = getLayer(zoom - 1),
+       & fine_layer = getLayer(zoom);
+
+  const size_t cx = x / 2,
+               cy = y / 2;
+  if( cx >= coarse_layer.sizeX() || cy >= coarse_layer.sizeY() )
+    return;
+
+  // Never replace tiles rendered by the client
+  Tile& tile = coarse_layer.getTile(cx, cy);
+  if( tile.type != Tile::NONE && !tile.downsampled )
+    return;
+
+  const Tile* fine_tiles[2][2] = {};
+  for(size_t i = 0; i < 2; ++i)
+    for(size_t j = 0; j < 2; ++j)
     {
-      if( cache )
-      {
-        auto cache_it = cache->find(quad->first->pdata);
-        if( cache_it != cache->end() )
-          tex_id = cache_it->second;
-      }
-
-      if( !tex_id )
-      {
-        std::cout << "load tile to GPU (" << quad->first->width
-                                   << "x" << quad->first->height
-                                   << ")" << std::endl;
-        glGenTextures(1, &tex_id);
-        glBindTexture(GL_TEXTURE_2D, tex_id);
-
-        glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-        glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-        glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP );
-        glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP );
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-
-        glTexImage2D(
-          GL_TEXTURE_2D,
-          0,
-          GL_RGBA,
-          quad->first->width,
-          quad->first->height,
-          0,
-          GL_RGBA,
-          GL_UNSIGNED_BYTE,
-          quad->first->pdata
-        );
-
-        if( cache )
-        {
-          (*cache)[ quad->first->pdata ] = tex_id;
-        }
-        else
-        {
-          delete[] quad->first->pdata;
-          quad->first->id = tex_id;
-          quad->first->type = Tile::OpenGLTexture;
-        }
-      }
+      const size_t fx = 2 * cx + i,
+                   fy = 2 * cy + j;
+      if( fx >= fine_layer.sizeX() || fy >= fine_layer.sizeY() )
+        continue;
+
+      const Tile& fine_tile = fine_layer.getTile(fx, fy);
+      if( fine_tile.type != Tile::ImageRGBA8 || !fine_tile.pdata )
+        // Not (yet) available, or compressed
+        return;
+
+      fine_tiles[i][j] = &fine_tile;
     }
-    else if( quad->first->type == Tile::OpenGLTexture )
+
+  const size_t size = 4 * tile.width * tile.height;
+  TileDataPtr data(new uint8_t[size], std::default_delete<uint8_t[]>());
+  memset(data.get(), 0, size);
+
+  for(size_t i = 0; i < 2; ++i)
+    for(size_t j = 0; j < 2; ++j)
     {
-      tex_id = quad->first->id;
+      const Tile* fine_tile = fine_tiles[i][j];
+      const size_t left = i * _tile_width / 2,
+                   top = j * _tile_height / 2;
+      if( !fine_tile || left >= tile.width || top >= tile.height )
+        continue;
+
+      downsample( static_cast<const uint8_t*>(fine_tile->pdata),
+                  fine_tile->width,
+                  fine_tile->height,
+                  data.get() + 4 * (top * tile.width + left),
+                  tile.width,
+                  std::min<size_t>(tile.width - left, (fine_tile->width + 1) / 2),
+                  std::min<size_t>(tile.height - top, (fine_tile->height + 1) / 2) );
     }
 
-    if( !tex_id )
-      continue;
-
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, tex_id);
-    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+  storeTile(tile, cx, cy, zoom - 1, data, size);
+  tile.downsampled = true;
 
-    float offset_x = 0;
-    if( !auto_center && target_region.size.x > rect_size.x )
-      offset_x = (target_region.size.x - rect_size.x) / 2;
+  updateCoarserTile(cx, cy, zoom - 1);
+}
 
-    glPushMatrix();
-    glTranslatef( target_region.pos.x + offset_x,
-                  target_region.pos.y,
-                  0 );
+//------------------------------------------------------------------------------
+bool HierarchicTileMap::render( const Rect& src_region,
+                                const float2& src_size,
+                                const Rect& target_region,
+                                TileAtlas& atlas,
+                                size_t zoom,
+                                bool auto_center,
+                                double alpha )
+{
+  TileStore::getInstance().update();
 
-    glColor4f(alpha,alpha,alpha,alpha);
-    glBegin(GL_QUADS);
-    for(size_t i = 0; i < quad->second._coords.size(); ++i)
-    {
-      glTexCoord2fv(quad->second._tex_coords[i].ptr());
-      glVertex2fv(quad->second._coords[i].ptr());
+  MapRect rect = requestRect(src_region, zoom);
+  float2 rect_size = rect.getSize();
+  MapRect::QuadList quads = rect.getQuads();
 
-//      std::cout << "    " << quad->second._coords[i] << ", tex: " << quad->second._tex_coords[i] << "\n";
-    }
-    glEnd();
+  float offset_x = 0;
+  if( !auto_center && target_region.size.x > rect_size.x )
+    offset_x = (target_region.size.x - rect_size.x) / 2;
 
-    glPopMatrix();
+  const float2 offset = target_region.pos + float2(offset_x, 0);
 
-    glDisable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-  }
+  bool complete = renderTiles( quads,
+                               getLevel(zoom),
+                               offset,
+                               alpha,
+                               atlas );
 
   // ----------
   // Scrollbars
@@ -365,7 +461,40 @@ bool HierarchicTileMap::render( const Rect& src_region,
     glEnd();
   }
 
-  return true;
+  return complete;
+}
+
+//------------------------------------------------------------------------------
+void HierarchicTileMap::releaseTile(size_t level, size_t x, size_t y)
+{
+  if( level >= _layers.size() || !_layers[level].isInit() )
+    return;
+
+  // Keep the change id, as the tile might still be cached on the GPU
+  Tile& tile = _layers[level].getTile(x, y);
+  tile.type = Tile::NONE;
+  tile.pdata = nullptr;
+}
+
+//------------------------------------------------------------------------------
+void HierarchicTileMap::setTilePointer( size_t level,
+                                        size_t x,
+                                        size_t y,
+                                        uint8_t* data )
+{
+  if( level >= _layers.size() || !_layers[level].isInit() )
+    return;
+
+  Tile& tile = _layers[level].getTile(x, y);
+  if( tile.type != Tile::ImageRGBA8 )
+    return;
+
+  tile.pdata = data;
+
+  // Decompressed data is ready for uploading
+  if( data )
+    for(auto cb: _change_callbacks)
+      cb(*this, x, y, level);
 }
 
 //------------------------------------------------------------------------------
@@ -382,6 +511,7 @@ float HierarchicTileMap::getLayerScale(size_t zoom) const
 //------------------------------------------------------------------------------
 void HierarchicTileMap::setWidth(size_t width)
 {
+  TileStore::getInstance().removeTiles(_id);
   _layers.clear();
   _width = width;
 
@@ -391,16 +521,95 @@ void HierarchicTileMap::setWidth(size_t width)
 //------------------------------------------------------------------------------
 void HierarchicTileMap::setHeight(size_t height)
 {
+  TileStore::getInstance().removeTiles(_id);
   _layers.clear();
   _height = height;
 
   ++_change_id;
 }
 
+//------------------------------------------------------------------------------
+bool HierarchicTileMap::renderTiles( MapRect::QuadList const& quads,
+                                     size_t level,
+                                     float2 const& offset,
+                                     double alpha,
+                                     TileAtlas& atlas )
+{
+  struct Vertex
+  {
+    float tex_coord[2],
+          pos[2];
+  };
+
+  // Collect the quads of all tiles, grouped by atlas page
+  std::map<unsigned int, std::vector<Vertex>> batches;
+
+  for(auto quad = quads.begin(); quad != quads.end(); ++quad)
+  {
+    const TileKey key = {_id, level, quad->second._x, quad->second._y};
+    if( quad->first->type == Tile::ImageRGBA8 )
+      TileStore::getInstance().touch(key);
+
+    const TileAtlas::Entry* entry =
+      atlas.get(key, *quad->first, _tile_width, _tile_height);
+    if( !entry )
+    {
+      // Compressed tiles need to be decompressed before uploading. The change
+      // callbacks are notified once the data is available, so no additional
+      // render pass is required for them.
+      if( quad->first->type == Tile::ImageRGBA8 && !quad->first->pdata )
+        TileStore::getInstance().load(key);
+      continue;
+    }
+
+    const Rect& tex = entry->region;
+    std::vector<Vertex>& vertices = batches[ entry->texture ];
+    for(size_t i = 0; i < quad->second._coords.size(); ++i)
+    {
+      const float2& tex_coord = quad->second._tex_coords[i],
+                  & pos = quad->second._coords[i];
+      Vertex v = {
+        { tex.pos.x + tex_coord.x * tex.size.x,
+          tex.pos.y + tex_coord.y * tex.size.y },
+        { offset.x + pos.x,
+          offset.y + pos.y }
+      };
+      vertices.push_back(v);
+    }
+  }
+
+  if( !batches.empty() )
+  {
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    glColor4f(alpha,alpha,alpha,alpha);
+
+    for(auto batch = batches.begin(); batch != batches.end(); ++batch)
+    {
+      const std::vector<Vertex>& vertices = batch->second;
+
+      glBindTexture(GL_TEXTURE_2D, batch->first);
+      glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), vertices[0].tex_coord);
+      glVertexPointer(2, GL_FLOAT, sizeof(Vertex), vertices[0].pos);
+      glDrawArrays(GL_QUADS, 0, vertices.size());
+    }
+
+    glDisable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPopClientAttrib();
+  }
+
+  return atlas.numDeferred() == 0;
+}
+
 //------------------------------------------------------------------------------
 Layer& HierarchicTileMap::getLayer(size_t zoom)
 {
-  size_t level = (zoom != static_cast<size_t>(-1)) ? zoom : 0;
+  size_t level = getLevel(zoom);
   if( level >= _layers.size() )
     _layers.resize(level + 1, Layer(this));
 
@@ -419,3 +628,9 @@ Layer& HierarchicTileMap::getLayer(size_t zoom)
 
   return layer;
 }
+
+//------------------------------------------------------------------------------
+size_t HierarchicTileMap::getLevel(size_t zoom)
+{
+  return (zoom != static_cast<size_t>(-1)) ? zoom : 0;
+}
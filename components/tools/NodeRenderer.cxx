@@ -15,7 +15,8 @@ namespace LinksRouting
     _use_stencil(false),
     _color(1,0,0),
     _color_covered(0.8,0,0,0.5),
-    _line_width(3)
+    _line_width(3),
+    _geometry(nullptr)
   {
 
   }
@@ -40,6 +41,12 @@ namespace LinksRouting
     _line_width = w;
   }
 
+  //----------------------------------------------------------------------------
+  void NodeRenderer::setGeometryBuffer(GeometryBuffer* buffer)
+  {
+    _geometry = buffer;
+  }
+
   //----------------------------------------------------------------------------
   bool NodeRenderer::renderNodes( const LinkDescription::nodes_t& nodes,
                                   HyperEdgeQueue* hedges_open,
@@ -57,16 +64,24 @@ namespace LinksRouting
 
     bool rendered_anything = false;
 
+    GeometryBuffer* geometry = pass > 0 ? _geometry : nullptr;
+    const GeometryBuffer::StencilMode stencil =
+      _use_stencil ? GeometryBuffer::STENCIL_WRITE
+                   : GeometryBuffer::STENCIL_KEEP;
+
+    float2 offset = float2();
     if( pass > 0 && do_transform )
     {
       // First pass is used by xray previews which are given in absolute
       // coordinates.
-      float2 offset = float2();
       if( !nodes.empty() && nodes.front()->getParent() )
         offset = nodes.front()->getParent()->get<float2>("screen-offset");
 
-      glPushMatrix();
-      glTranslatef(offset.x, offset.y, 0);
+      if( !geometry )
+      {
+        glPushMatrix();
+        glTranslatef(offset.x, offset.y, 0);
+      }
     }
 
     for( auto node = nodes.begin(); node != nodes.end(); ++node )
@@ -117,6 +132,57 @@ namespace LinksRouting
         color_cur *= 0.5;
 
       bool filled = (*node)->get<bool>("filled", false);
+      if( geometry )
+      {
+        const bool map_points = _partitions_src && _partitions_dest;
+        auto mapPoints = [this](LinkDescription::points_t& points)
+        {
+          for(auto& p: points)
+            p = mapVertex(p.x, p.y);
+        };
+
+        if( !filled && !render_all && !(*node)->get<bool>("outline-only") )
+        {
+          if( map_points )
+          {
+            LinkDescription::points_t vertices = (*node)->getVertices();
+            mapPoints(vertices);
+            geometry->addPolygon(vertices, Color(0,0,0,0), stencil, offset);
+          }
+          else
+            geometry->addPolygon( (*node)->getVertices(),
+                                  Color(0,0,0,0),
+                                  stencil,
+                                  offset );
+        }
+
+        const line_borders_t& borders =
+          calcLineBordersCached( (*node)->getLineBordersCache(),
+                                 (*node)->getRevision(),
+                                 (*node)->getVertices(),
+                                 _line_width,
+                                 true );
+        line_borders_t mapped_borders;
+        if( map_points )
+        {
+          mapped_borders = borders;
+          mapPoints(mapped_borders.first);
+          mapPoints(mapped_borders.second);
+        }
+        const line_borders_t& region = map_points ? mapped_borders : borders;
+
+        if( filled )
+          geometry->addPolygon(region.second, color_cur, stencil, offset);
+        else
+          geometry->addStrip( region.first,
+                              region.second,
+                              color_cur,
+                              stencil,
+                              offset );
+        rendered_anything = true;
+        continue;
+      }
+
       if( !filled && !render_all && !(*node)->get<bool>("outline-only") )
       {
         Color light(0,0,0,0);// = 0.5 * color_cur;
@@ -130,9 +196,12 @@ namespace LinksRouting
         glEnd();
       }
       glColor4fv(color_cur);
-      line_borders_t region = calcLineBorders( (*node)->getVertices(),
-                                               _line_width,
-                                               true );
+      const line_borders_t& region =
+        calcLineBordersCached( (*node)->getLineBordersCache(),
+                               (*node)->getRevision(),
+                               (*node)->getVertices(),
+                               _line_width,
+                               true );
       glBegin(filled ? GL_POLYGON : GL_TRIANGLE_STRIP);
       for( auto first = std::begin(region.first),
                 second = std::begin(region.second);
@@ -148,7 +217,7 @@ namespace LinksRouting
       rendered_anything = true;
     }
 
-    if( pass > 0 && do_transform )
+    if( pass > 0 && do_transform && !geometry )
     {
       glPopMatrix();
     }
@@ -206,6 +275,14 @@ namespace LinksRouting
 
   //----------------------------------------------------------------------------
   float2 NodeRenderer::glVertex2f(float x, float y)
+  {
+    float2 pos = mapVertex(x, y);
+    ::glVertex2f(pos.x, pos.y);
+    return pos;
+  }
+
+  //----------------------------------------------------------------------------
+  float2 NodeRenderer::mapVertex(float x, float y) const
   {
 #if 1
     if( _partitions_dest && _partitions_src )
@@ -241,7 +318,6 @@ namespace LinksRouting
       x -= _margin_left;
     }
 #endif
-    ::glVertex2f(x, y);
     return float2(x, y);
   }
 
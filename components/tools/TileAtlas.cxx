@@ -0,0 +1,340 @@
+/*
+ * TileAtlas.cxx
+ *
+ *  Created on: 19.10.2026
+ */
+
+#include "TileAtlas.hpp"
+#include "HierarchicTileMap.hpp"
+
+#ifdef WIN32
+# include <GL/glew.h>
+#else
+# define GL_GLEXT_PROTOTYPES 1
+# include <GL/gl.h>
+# include <GL/glext.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+//------------------------------------------------------------------------------
+static TileAtlas::Entry makeEntry( unsigned int texture,
+                                   size_t cols,
+                                   size_t rows,
+                                   size_t slot_width,
+                                   size_t slot_height,
+                                   size_t slot,
+                                   const Tile& tile )
+{
+  // Inset by half a texel to prevent linear filtering from sampling
+  // neighbouring tiles
+  const float tex_width = cols * slot_width,
+              tex_height = rows * slot_height;
+  const float2 origin( (slot % cols) * slot_width,
+                       (slot / cols) * slot_height );
+
+  TileAtlas::Entry entry;
+  entry.texture = texture;
+  entry.region = Rect(
+    float2( (origin.x + 0.5f) / tex_width,
+            (origin.y + 0.5f) / tex_height ),
+    float2( (tile.width - 1.f) / tex_width,
+            (tile.height - 1.f) / tex_height )
+  );
+  return entry;
+}
+
+//------------------------------------------------------------------------------
+size_t TileAtlas::Page::lastUsed() const
+{
+  size_t last_used = 0;
+  for(auto const& slot: slots)
+    if( slot.used )
+      last_used = std::max(last_used, slot.last_used);
+  return last_used;
+}
+
+//------------------------------------------------------------------------------
+TileAtlas::TileAtlas( size_t budget,
+                      size_t page_size,
+                      size_t max_uploads ):
+  _budget(budget),
+  _page_size(page_size),
+  _max_uploads(std::max<size_t>(max_uploads, 1)),
+  _frame(0),
+  _num_uploads(0),
+  _num_deferred(0),
+  _stats(),
+  _next_pbo(0)
+{
+  GLint max_size = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+  if( max_size > 0 )
+    _page_size = std::min<size_t>(_page_size, max_size);
+
+  // One buffer per upload of a frame, so that a buffer is only reused once
+  // the previous frame has been submitted.
+  _pbos.resize(_max_uploads);
+  glGenBuffers(_pbos.size(), &_pbos[0]);
+}
+
+//------------------------------------------------------------------------------
+TileAtlas::~TileAtlas()
+{
+  for(auto const& page: _pages)
+    glDeleteTextures(1, &page->texture);
+  glDeleteBuffers(_pbos.size(), &_pbos[0]);
+}
+
+//------------------------------------------------------------------------------
+void TileAtlas::nextFrame()
+{
+  ++_frame;
+  _num_uploads = 0;
+  _num_deferred = 0;
+}
+
+//------------------------------------------------------------------------------
+const TileAtlas::Entry* TileAtlas::get( const TileKey& key,
+                                        const Tile& tile,
+                                        size_t slot_width,
+                                        size_t slot_height )
+{
+  if( !tile.change_id )
+    return nullptr;
+
+  // The image data is only required for uploading, as it might have already
+  // been released or compressed by the (CPU) tile store.
+  const bool has_data = tile.type == Tile::ImageRGBA8 && tile.pdata;
+
+  auto loc = _locations.find(key);
+  if( loc != _locations.end() )
+  {
+    Location& l = loc->second;
+    l.page->slots[ l.slot ].last_used = _frame;
+
+    if( l.change_id == tile.change_id )
+    {
+      ++_stats.hits;
+      return &l.entry;
+    }
+
+    // Replace outdated tile in place (and show the old image until the new
+    // one could be uploaded)
+    ++_stats.misses;
+    if( !has_data )
+      return &l.entry;
+    if( _num_uploads >= _max_uploads )
+    {
+      ++_num_deferred;
+      return &l.entry;
+    }
+
+    upload(tile, *l.page, l.slot);
+    ++_num_uploads;
+
+    l.change_id = tile.change_id;
+    l.entry = makeEntry( l.page->texture,
+                         l.page->cols, l.page->rows,
+                         l.page->slot_width, l.page->slot_height,
+                         l.slot, tile );
+    return &l.entry;
+  }
+
+  ++_stats.misses;
+  if( !has_data )
+    return nullptr;
+
+  if( _num_uploads >= _max_uploads )
+  {
+    ++_num_deferred;
+    return nullptr;
+  }
+
+  // Over capacity (all slots used during this frame). Retrying would not help
+  // until other tiles are no longer visible, so the tile is just skipped.
+  Page* page = nullptr;
+  size_t slot = 0;
+  if( !allocSlot(slot_width, slot_height, page, slot) )
+    return nullptr;
+
+  Slot& s = page->slots[slot];
+  if( s.used )
+  {
+    _locations.erase(s.key);
+    ++_stats.evictions;
+  }
+
+  s.used = true;
+  s.key = key;
+  s.last_used = _frame;
+
+  upload(tile, *page, slot);
+  ++_num_uploads;
+
+  Location& new_loc = _locations[ key ];
+  new_loc.page = page;
+  new_loc.slot = slot;
+  new_loc.change_id = tile.change_id;
+  new_loc.entry = makeEntry( page->texture,
+                             page->cols, page->rows,
+                             page->slot_width, page->slot_height,
+                             slot, tile );
+
+  return &new_loc.entry;
+}
+
+//------------------------------------------------------------------------------
+bool TileAtlas::allocSlot( size_t slot_width,
+                           size_t slot_height,
+                           Page*& page,
+                           size_t& slot )
+{
+  Page* lru_page = nullptr;
+  size_t lru_slot = 0;
+  bool has_page = false;
+
+  for(auto const& p: _pages)
+  {
+    if( p->slot_width != slot_width || p->slot_height != slot_height )
+      continue;
+
+    has_page = true;
+    for(size_t i = 0; i < p->slots.size(); ++i)
+    {
+      const Slot& s = p->slots[i];
+      if( !s.used )
+      {
+        page = p.get();
+        slot = i;
+        return true;
+      }
+
+      if(    s.last_used != _frame
+          && (!lru_page || s.last_used < lru_page->slots[lru_slot].last_used) )
+      {
+        lru_page = p.get();
+        lru_slot = i;
+      }
+    }
+  }
+
+  const size_t cols = std::max<size_t>(_page_size / slot_width, 1),
+               rows = std::max<size_t>(_page_size / slot_height, 1),
+               page_bytes = 4 * cols * slot_width * rows * slot_height;
+
+  if( _stats.bytes + page_bytes > _budget )
+    freePages(page_bytes, slot_width, slot_height);
+
+  // Prefer growing over evicting, as long as the budget is not exceeded
+  if( _stats.bytes + page_bytes <= _budget || !has_page )
+  {
+    page = addPage(slot_width, slot_height);
+    slot = 0;
+    return true;
+  }
+
+  if( !lru_page )
+    return false;
+
+  page = lru_page;
+  slot = lru_slot;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+TileAtlas::Page* TileAtlas::addPage(size_t slot_width, size_t slot_height)
+{
+  PagePtr p(new Page);
+  p->slot_width = slot_width;
+  p->slot_height = slot_height;
+  p->cols = std::max<size_t>(_page_size / slot_width, 1);
+  p->rows = std::max<size_t>(_page_size / slot_height, 1);
+  p->slots.resize(p->cols * p->rows, Slot{false, TileKey(), 0});
+
+  glGenTextures(1, &p->texture);
+  glBindTexture(GL_TEXTURE_2D, p->texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8,
+                p->cols * slot_width, p->rows * slot_height,
+                0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  _stats.bytes += p->bytes();
+  _pages.push_back(std::move(p));
+
+  return _pages.back().get();
+}
+
+//------------------------------------------------------------------------------
+void TileAtlas::freePages(size_t bytes, size_t slot_width, size_t slot_height)
+{
+  while( _stats.bytes + bytes > _budget )
+  {
+    auto lru = _pages.end();
+    for(auto p = _pages.begin(); p != _pages.end(); ++p)
+    {
+      if(    ((*p)->slot_width == slot_width && (*p)->slot_height == slot_height)
+          || (*p)->lastUsed() == _frame )
+        continue;
+
+      if( lru == _pages.end() || (*p)->lastUsed() < (*lru)->lastUsed() )
+        lru = p;
+    }
+
+    if( lru == _pages.end() )
+      return;
+
+    for(auto loc = _locations.begin(); loc != _locations.end();)
+    {
+      if( loc->second.page == lru->get() )
+      {
+        loc = _locations.erase(loc);
+        ++_stats.evictions;
+      }
+      else
+        ++loc;
+    }
+
+    _stats.bytes -= (*lru)->bytes();
+    glDeleteTextures(1, &(*lru)->texture);
+    _pages.erase(lru);
+  }
+}
+
+//------------------------------------------------------------------------------
+void TileAtlas::upload(const Tile& tile, const Page& page, size_t slot)
+{
+  const size_t size = 4 * tile.width * tile.height;
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbos[_next_pbo]);
+  _next_pbo = (_next_pbo + 1) % _pbos.size();
+
+  // Orphan the previous storage, so mapping does not wait for a pending
+  // transfer from the same buffer
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  if( void* dest = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY) )
+  {
+    memcpy(dest, tile.pdata, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  }
+
+  glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+  glBindTexture(GL_TEXTURE_2D, page.texture);
+  glTexSubImage2D( GL_TEXTURE_2D, 0,
+                   (slot % page.cols) * page.slot_width,
+                   (slot / page.cols) * page.slot_height,
+                   tile.width, tile.height,
+                   GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glPopClientAttrib();
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -0,0 +1,354 @@
+/*
+ * TileStore.cxx
+ *
+ *  Created on: 19.10.2026
+ */
+
+#include "TileStore.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+TileStore& TileStore::getInstance()
+{
+  static TileStore store;
+  return store;
+}
+
+//------------------------------------------------------------------------------
+TileStore::TileStore():
+  _budget(512 * 1024 * 1024),
+  _hot_budget(0),
+  _size(0),
+  _hot_size(0),
+  _num_evicted(0),
+  _level(0),
+  _generation(0),
+  _quit(false)
+{
+
+}
+
+//------------------------------------------------------------------------------
+TileStore::~TileStore()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _quit = true;
+  }
+  _cond_work.notify_all();
+
+  if( _worker.joinable() )
+    _worker.join();
+}
+
+//------------------------------------------------------------------------------
+void TileStore::setBudget(size_t bytes)
+{
+  _budget = bytes;
+  evict(0);
+}
+
+//------------------------------------------------------------------------------
+void TileStore::setCompression(int level, size_t hot_size)
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _level = std::max(0, std::min(level, 9));
+  }
+  _hot_budget = hot_size;
+
+  if( _level && !_worker.joinable() )
+    _worker = std::thread(&TileStore::workerLoop, this);
+
+  cool();
+}
+
+//------------------------------------------------------------------------------
+void TileStore::setResultCallback(const ResultCallback& cb)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  _result_callback = cb;
+}
+
+//------------------------------------------------------------------------------
+void TileStore::addMap(HierarchicTileMap* map)
+{
+  _maps[ map->getId() ] = map;
+}
+
+//------------------------------------------------------------------------------
+void TileStore::removeMap(HierarchicTileMap* map)
+{
+  removeTiles(map->getId());
+  _maps.erase(map->getId());
+}
+
+//------------------------------------------------------------------------------
+uint8_t* TileStore::store( const TileKey& key,
+                           const TileDataPtr& data,
+                           size_t size )
+{
+  auto tile = _tiles.find(key);
+  if( tile != _tiles.end() )
+    remove(tile);
+
+  evict(size);
+
+  _lru.push_front(key);
+
+  Entry& entry = _tiles[key];
+  entry.data = data;
+  entry.compressed.reset();
+  entry.size = size;
+  entry.lru = _lru.begin();
+  entry.generation = ++_generation;
+  entry.pending = false;
+  entry.keep_hot = false;
+
+  _size += size;
+  _hot_size += size;
+
+  // Never affects the new tile, as it is the most recently used one
+  cool();
+
+  return entry.data.get();
+}
+
+//------------------------------------------------------------------------------
+void TileStore::touch(const TileKey& key)
+{
+  auto tile = _tiles.find(key);
+  if( tile != _tiles.end() )
+    _lru.splice(_lru.begin(), _lru, tile->second.lru);
+}
+
+//------------------------------------------------------------------------------
+bool TileStore::load(const TileKey& key)
+{
+  auto tile = _tiles.find(key);
+  if( tile == _tiles.end() )
+    return false;
+
+  Entry& entry = tile->second;
+  _lru.splice(_lru.begin(), _lru, entry.lru);
+
+  if( entry.data || entry.pending )
+    return true;
+
+  entry.pending = true;
+
+  Job job = {key, entry.generation, false, nullptr, entry.compressed, entry.size};
+  queue(job);
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void TileStore::update()
+{
+  std::deque<Job> results;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    results.swap(_results);
+  }
+
+  if( results.empty() )
+    return;
+
+  for(auto job = results.begin(); job != results.end(); ++job)
+  {
+    auto tile = _tiles.find(job->key);
+    if( tile == _tiles.end() || tile->second.generation != job->generation )
+      continue;
+
+    Entry& entry = tile->second;
+    entry.pending = false;
+
+    if( job->compress )
+    {
+      if( job->compressed )
+      {
+        entry.compressed = job->compressed;
+        _size += entry.compressed->size();
+      }
+      else
+        entry.keep_hot = true;
+    }
+    else if( job->data )
+    {
+      entry.data = job->data;
+      _size += entry.size;
+      _hot_size += entry.size;
+      setPointer(job->key, entry.data.get());
+    }
+    else
+    {
+      // Corrupted data can not be recovered, so request the tile again
+      remove(tile);
+      release(job->key);
+    }
+  }
+
+  evict(0);
+  cool();
+}
+
+//------------------------------------------------------------------------------
+void TileStore::removeTiles(unsigned int map_id)
+{
+  for(auto tile = _tiles.begin(); tile != _tiles.end();)
+  {
+    if( tile->first.map_id == map_id )
+      remove(tile++);
+    else
+      ++tile;
+  }
+}
+
+//------------------------------------------------------------------------------
+void TileStore::evict(size_t size)
+{
+  while( !_lru.empty() && _size + size > _budget )
+  {
+    auto tile = _tiles.find(_lru.back());
+    const TileKey key = tile->first;
+
+    remove(tile);
+    release(key);
+    ++_num_evicted;
+  }
+}
+
+//------------------------------------------------------------------------------
+void TileStore::cool()
+{
+  if( !_level || _hot_size <= _hot_budget )
+    return;
+
+  size_t hot_size = 0;
+  for(auto key = _lru.begin(); key != _lru.end(); ++key)
+  {
+    Entry& entry = _tiles.find(*key)->second;
+    if( !entry.data || entry.keep_hot )
+      continue;
+
+    if( key == _lru.begin() || hot_size + entry.size <= _hot_budget )
+    {
+      hot_size += entry.size;
+      continue;
+    }
+
+    if( entry.compressed )
+    {
+      // Already compressed before, so just drop the uncompressed copy
+      _size -= entry.size;
+      _hot_size -= entry.size;
+      entry.data.reset();
+      setPointer(*key, nullptr);
+    }
+    else if( !entry.pending )
+    {
+      entry.pending = true;
+
+      Job job = {*key, entry.generation, true, entry.data, nullptr, entry.size};
+      queue(job);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void TileStore::remove(Entries::iterator tile)
+{
+  const Entry& entry = tile->second;
+  if( entry.data )
+  {
+    _size -= entry.size;
+    _hot_size -= entry.size;
+  }
+  if( entry.compressed )
+    _size -= entry.compressed->size();
+
+  _lru.erase(entry.lru);
+  _tiles.erase(tile);
+}
+
+//------------------------------------------------------------------------------
+void TileStore::release(const TileKey& key)
+{
+  auto map = _maps.find(key.map_id);
+  if( map != _maps.end() )
+    map->second->releaseTile(key.layer, key.x, key.y);
+}
+
+//------------------------------------------------------------------------------
+void TileStore::setPointer(const TileKey& key, uint8_t* data)
+{
+  auto map = _maps.find(key.map_id);
+  if( map != _maps.end() )
+    map->second->setTilePointer(key.layer, key.x, key.y, data);
+}
+
+//------------------------------------------------------------------------------
+void TileStore::queue(const Job& job)
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _jobs.push_back(job);
+  }
+  _cond_work.notify_one();
+}
+
+//------------------------------------------------------------------------------
+void TileStore::workerLoop()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  for(;;)
+  {
+    _cond_work.wait(lock, [this]{ return _quit || !_jobs.empty(); });
+    if( _quit )
+      return;
+
+    Job job = _jobs.front();
+    _jobs.pop_front();
+    const int level = _level;
+
+    lock.unlock();
+
+    if( job.compress )
+    {
+      uLongf len = compressBound(job.size);
+      BufferPtr output = std::make_shared<Buffer>(len);
+      if( compress2( &output->front(), &len,
+                     job.data.get(), job.size,
+                     std::max(level, 1) ) == Z_OK )
+      {
+        output->resize(len);
+        output->shrink_to_fit();
+        job.compressed = output;
+      }
+      job.data.reset();
+    }
+    else
+    {
+      uLongf len = job.size;
+      TileDataPtr output( new uint8_t[len],
+                          std::default_delete<uint8_t[]>() );
+      if(    uncompress( output.get(), &len,
+                         &job.compressed->front(),
+                         job.compressed->size() ) == Z_OK
+          && len == job.size )
+        job.data = output;
+      job.compressed.reset();
+    }
+
+    lock.lock();
+    _results.push_back(job);
+
+    // Notify once for all queued jobs
+    if( _jobs.empty() && _result_callback )
+      _result_callback();
+  }
+}
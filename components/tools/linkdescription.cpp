@@ -32,7 +32,8 @@ namespace LinkDescription
   }
 
   //----------------------------------------------------------------------------
-  Node::Node()
+  Node::Node():
+    _revision( 0 )
   {
 
   }
@@ -41,7 +42,8 @@ namespace LinkDescription
   Node::Node( const points_t& points,
               const PropertyMap& props ):
     PropertyElement( props ),
-    _points( points )
+    _points( points ),
+    _revision( 0 )
   {
 
   }
@@ -52,7 +54,8 @@ namespace LinkDescription
               const PropertyMap& props ):
     PropertyElement( props ),
     _points( points ),
-    _link_points( link_points )
+    _link_points( link_points ),
+    _revision( 0 )
   {
 
   }
@@ -65,13 +68,15 @@ namespace LinkDescription
     PropertyElement( props ),
     _points( points ),
     _link_points( link_points ),
-    _link_points_children( link_points_children )
+    _link_points_children( link_points_children ),
+    _revision( 0 )
   {
 
   }
 
   //----------------------------------------------------------------------------
-  Node::Node(HyperEdgePtr hedge)
+  Node::Node(HyperEdgePtr hedge):
+    _revision( 0 )
   {
     _children.push_back(hedge);
     hedge->_parent = this;
@@ -84,15 +89,25 @@ namespace LinkDescription
   }
 
   //----------------------------------------------------------------------------
-  points_t& Node::getVertices()
+  const points_t& Node::getVertices() const
   {
     return _points;
   }
 
   //----------------------------------------------------------------------------
-  const points_t& Node::getVertices() const
+  void Node::setVertices(const points_t& points)
   {
-    return _points;
+    if( points == _points )
+      return;
+
+    _points = points;
+    ++_revision;
+  }
+
+  //----------------------------------------------------------------------------
+  uint32_t Node::getRevision() const
+  {
+    return _revision;
   }
 
   //----------------------------------------------------------------------------
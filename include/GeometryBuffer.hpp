@@ -0,0 +1,143 @@
+/*
+ * GeometryBuffer.hpp
+ *
+ *  Created on: 19.10.2026
+ */
+
+#ifndef LR_GEOMETRYBUFFER_HPP_
+#define LR_GEOMETRYBUFFER_HPP_
+
+#include "color.h"
+#include "float2.hpp"
+
+#include <vector>
+
+namespace LinksRouting
+{
+
+  /**
+   * Collects colored 2d geometry (converted to triangles) and draws it with as
+   * few draw calls as possible from a vertex buffer object. The buffer is only
+   * uploaded again if primitives have been added or removed since the last
+   * draw.
+   *
+   * Primitives are drawn in the order they have been added. Consecutive
+   * primitives are merged into a single draw call, unless they use a
+   * different stencil mode.
+   */
+  class GeometryBuffer
+  {
+    public:
+
+      enum StencilMode
+      {
+        STENCIL_KEEP,   ///< Don't touch stencil state
+        STENCIL_WRITE,  ///< Mark covered pixels
+        STENCIL_TEST    ///< Only draw where no pixels are marked
+      };
+
+      GeometryBuffer();
+      ~GeometryBuffer();
+
+      /** Remove all primitives */
+      void clear();
+      bool empty() const;
+
+      /**
+       * Add a triangle strip (eg. from calcLineBorders)
+       */
+      template<typename Collection>
+      void addStrip( const Collection& first,
+                     const Collection& second,
+                     const Color& color,
+                     StencilMode stencil = STENCIL_KEEP,
+                     const float2& offset = float2() );
+
+      /**
+       * Add a (convex) polygon
+       */
+      template<typename Collection>
+      void addPolygon( const Collection& points,
+                       const Color& color,
+                       StencilMode stencil = STENCIL_KEEP,
+                       const float2& offset = float2() );
+
+      /**
+       * Draw all primitives. Requires a current OpenGL context.
+       */
+      void draw();
+
+    protected:
+
+      struct Vertex
+      {
+        float pos[2];
+        float color[4];
+      };
+
+      struct Batch
+      {
+        StencilMode stencil;
+        size_t      first,
+                    count;
+      };
+
+      std::vector<Vertex> _vertices;
+      std::vector<Batch>  _batches;
+      unsigned int        _vbo;
+      bool                _modified;  ///< Not yet uploaded to _vbo
+
+      void addTriangle( const float2& a,
+                        const float2& b,
+                        const float2& c,
+                        const Color& color,
+                        StencilMode stencil );
+
+    private:
+      GeometryBuffer(const GeometryBuffer&); // = delete
+      GeometryBuffer& operator=(const GeometryBuffer&); // = delete
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename Collection>
+  void GeometryBuffer::addStrip( const Collection& first,
+                                 const Collection& second,
+                                 const Color& color,
+                                 StencilMode stencil,
+                                 const float2& offset )
+  {
+    // Interleave both borders like glBegin(GL_TRIANGLE_STRIP) would receive
+    std::vector<float2> strip;
+    strip.reserve(2 * first.size());
+    for( auto p1 = std::begin(first), p2 = std::begin(second);
+         p1 != std::end(first) && p2 != std::end(second);
+         ++p1, ++p2 )
+    {
+      strip.push_back(*p1 + offset);
+      strip.push_back(*p2 + offset);
+    }
+
+    for(size_t i = 2; i < strip.size(); ++i)
+      addTriangle(strip[i - 2], strip[i - 1], strip[i], color, stencil);
+  }
+
+  //----------------------------------------------------------------------------
+  template<typename Collection>
+  void GeometryBuffer::addPolygon( const Collection& points,
+                                   const Color& color,
+                                   StencilMode stencil,
+                                   const float2& offset )
+  {
+    auto begin = std::begin(points),
+         end = std::end(points);
+    if( begin == end )
+      return;
+
+    const float2 center = *begin + offset;
+    for(auto p = begin + 1; p != end && p + 1 != end; ++p)
+      addTriangle(center, *p + offset, *(p + 1) + offset, color, stencil);
+  }
+
+} // namespace LinksRouting
+
+#endif /* LR_GEOMETRYBUFFER_HPP_ */
@@ -6,6 +6,7 @@
 #include "PartitionHelper.hxx"
 
 #include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <functional>
 #include <map>
@@ -14,12 +15,58 @@
 
 #include <iostream>
 
-typedef std::map<unsigned char*, unsigned int> GLImageCache;
+class TileAtlas;
+
+/**
+ * Identifies a tile position across all tile maps.
+ */
+struct TileKey
+{
+  unsigned int map_id;
+  size_t       layer,
+               x,
+               y;
+
+  bool operator==(const TileKey& rhs) const
+  {
+    return map_id == rhs.map_id
+        && layer == rhs.layer
+        && x == rhs.x
+        && y == rhs.y;
+  }
+
+  struct Hash
+  {
+    size_t operator()(const TileKey& key) const
+    {
+      size_t h = key.map_id;
+      h = h * 31 + key.layer;
+      h = h * 31 + key.x;
+      h = h * 31 + key.y;
+      return h;
+    }
+  };
+};
+
+/**
+ * Image data of a tile. The deleter can be used to keep the actual owner of
+ * the memory (eg. a received message) alive, to avoid copying the data.
+ */
+typedef std::shared_ptr<uint8_t> TileDataPtr;
 
 struct Tile:
   public LinksRouting::SlotType::Image
 {
+  /// Change id of the map when the image data has been set (0 = no data)
+  unsigned int change_id;
 
+  /// Image data has been generated from the next finer layer
+  bool downsampled;
+
+  Tile():
+    change_id(0),
+    downsampled(false)
+  {}
 };
 
 class HierarchicTileMap;
@@ -56,6 +103,7 @@ struct MapRect
 
   struct Quads
   {
+    size_t _x, _y; //!< Tile index
     std::vector<float2> _coords;
     std::vector<float2> _tex_coords;
   };
@@ -81,16 +129,44 @@ class HierarchicTileMap
                        unsigned int height,
                        unsigned int tile_width,
                        unsigned int tile_height );
+    ~HierarchicTileMap();
     
     void addTileChangeCallback(TileChangeCallback cb);
 
     MapRect requestRect( const Rect& rect,
                          size_t zoom = -1 );
 
+    /**
+     * Set image data of a tile. The data is copied to the global TileStore.
+     */
     void setTileData( size_t x, size_t y, size_t zoom,
                       const char* data,
                       size_t data_size );
 
+    /**
+     * Set image data of a tile. The global TileStore takes (shared) ownership
+     * of the data without copying it.
+     *
+     * Tiles of coarser layers which are not yet available are generated by
+     * downsampling, as soon as all of their tiles in the finer layer are
+     * available.
+     */
+    void setTileData( size_t x, size_t y, size_t zoom,
+                      const TileDataPtr& data,
+                      size_t data_size );
+
+    /**
+     * Reset a tile to Tile::NONE (called by the TileStore if the data has been
+     * evicted).
+     */
+    void releaseTile(size_t level, size_t x, size_t y);
+
+    /**
+     * Update the location of the image data of a tile (called by the
+     * TileStore, nullptr if the data is only available compressed).
+     */
+    void setTilePointer(size_t level, size_t x, size_t y, uint8_t* data);
+
     /**
      *
      * @param src_region    (Sub)region of the whole preview to render
@@ -98,14 +174,21 @@ class HierarchicTileMap
      * @param target_region Coordinates of region the preview should be rendered
      *                      to (The whole src_region will be fitted into the
      *                      target region).
+     * @param atlas         Cache for keeping the tiles on the GPU. All tiles
+     *                      are drawn with a single draw call per atlas page.
+     *                      TileAtlas::nextFrame() is not called, as the upload
+     *                      limit is shared by all maps rendered per frame.
+     * @return false if uploading some tiles has been deferred due to the
+     *         upload limit of the atlas and another render pass is required
+     *         to show them.
      */
     bool render( const Rect& src_region,
                  const float2& src_size,
                  const Rect& target_region,
+                 TileAtlas& atlas,
                  size_t zoom = -1,
                  bool auto_center = false,
-                 double alpha = 1.,
-                 GLImageCache* cache = nullptr );
+                 double alpha = 1. );
 
     float getLayerScale(size_t level) const;
 
@@ -120,14 +203,25 @@ class HierarchicTileMap
 
     unsigned int getChangeId() const { return _change_id; }
 
+    /** Unique id (eg. for caching tiles of multiple maps) */
+    unsigned int getId() const { return _id; }
+
+    /** Layer index of the given zoom level (as used in TileKey::layer) */
+    static size_t getLevel(size_t zoom);
+
     Partitions partitions_src,
                partitions_dest;
 
     unsigned int margin_left,
                  margin_right;
 
+    /** Identifies the content across sessions (eg. for the disk cache),
+     *  0 if unknown */
+    uint64_t persistent_id;
+
   private:
-    unsigned int _width,
+    unsigned int _id,
+                 _width,
                  _height,
                  _tile_width,
                  _tile_height,
@@ -137,7 +231,27 @@ class HierarchicTileMap
     std::vector<Layer> _layers;
     std::vector<TileChangeCallback> _change_callbacks;
     
-    Layer& getLayer(size_t level);
+    Layer& getLayer(size_t zoom);
+
+    void storeTile( Tile& tile,
+                    size_t x, size_t y, size_t zoom,
+                    const TileDataPtr& data,
+                    size_t data_size );
+
+    /**
+     * Generate the tile covering the given tile in the next coarser layer (if
+     * all its tiles are available).
+     */
+    void updateCoarserTile(size_t x, size_t y, size_t zoom);
+
+    bool renderTiles( MapRect::QuadList const& quads,
+                      size_t level,
+                      float2 const& offset,
+                      double alpha,
+                      TileAtlas& atlas );
+
+    HierarchicTileMap(const HierarchicTileMap&); // = delete
+    HierarchicTileMap& operator=(const HierarchicTileMap&); // = delete
 };
 
 typedef std::shared_ptr<HierarchicTileMap> HierarchicTileMapPtr;
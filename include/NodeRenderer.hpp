@@ -8,6 +8,7 @@
 #ifndef LR_NODERENDERER_HPP_
 #define LR_NODERENDERER_HPP_
 
+#include "GeometryBuffer.hpp"
 #include "PartitionHelper.hxx"
 #include "linkdescription.h"
 
@@ -32,6 +33,13 @@ namespace LinksRouting
                      Color const& color_covered );
       void setLineWidth(float w);
 
+      /**
+       * Collect nodes into the given buffer instead of drawing them
+       * immediately (only for pass > 0). The buffer has to be drawn
+       * afterwards.
+       */
+      void setGeometryBuffer(GeometryBuffer* buffer);
+
       bool renderNodes( const LinkDescription::nodes_t& nodes,
                         HyperEdgeQueue* hedges_open = nullptr,
                         HyperEdgeSet* hedges_done = nullptr,
@@ -47,6 +55,9 @@ namespace LinksRouting
 
       float2 glVertex2f(float x, float y);
 
+      /** Apply partition mapping (if set) */
+      float2 mapVertex(float x, float y) const;
+
     protected:
       Partitions  *_partitions_src,
                   *_partitions_dest;
@@ -55,6 +66,7 @@ namespace LinksRouting
       Color        _color,
                    _color_covered;
       float        _line_width;
+      GeometryBuffer *_geometry;
   };
 
   typedef std::pair<std::vector<float2>, std::vector<float2>> line_borders_t;
@@ -155,6 +167,40 @@ namespace LinksRouting
     return ret;
   }
 
+  /**
+   * Same as calcLineBorders, but reuses the result stored in @a cache if the
+   * revision of the line and all parameters are unchanged.
+   *
+   * @param revision  Changes whenever @a points change (eg. Node::getRevision)
+   */
+  inline
+  const line_borders_t&
+  calcLineBordersCached( LinkDescription::LineBordersCache& cache,
+                         uint32_t revision,
+                         const LinkDescription::points_t& points,
+                         float width,
+                         bool closed = false,
+                         float widen_end = 0.f )
+  {
+    if(    !cache.valid
+        || cache.revision != revision
+        || cache.num_points != points.size()
+        || cache.width != width
+        || cache.closed != closed
+        || cache.widen_end != widen_end )
+    {
+      cache.borders = calcLineBorders(points, width, closed, widen_end);
+      cache.revision = revision;
+      cache.num_points = points.size();
+      cache.width = width;
+      cache.closed = closed;
+      cache.widen_end = widen_end;
+      cache.valid = true;
+    }
+
+    return cache.borders;
+  }
+
 } // namespace LinksRouting
 
 #endif /* LR_NODERENDERER_HPP_ */
@@ -0,0 +1,164 @@
+/*
+ * TileAtlas.hpp
+ *
+ *  Created on: 19.10.2026
+ */
+
+#ifndef TILE_ATLAS_HPP_
+#define TILE_ATLAS_HPP_
+
+#include "float2.hpp"
+#include "HierarchicTileMap.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * GPU cache for tile images, packed into a few large textures (pages), so
+ * that all visible tiles can be drawn with a single texture bind and draw
+ * call. Every page is split into equally sized slots (one per tile) and new
+ * tiles are streamed into free or least recently used slots with
+ * glTexSubImage2D from a ring of pixel unpack buffers. The number of uploads
+ * per frame is limited to avoid stalling the rendering if lots of tiles arrive
+ * at once.
+ *
+ * The texture memory is limited to a given budget. If it is exceeded, the
+ * least recently used tiles (or whole pages of other tile sizes) are evicted.
+ *
+ * Only textures and buffer objects are used, so a single atlas can be used by
+ * all contexts sharing resources. All methods (including the destructor)
+ * require one of these contexts to be current.
+ */
+class TileAtlas
+{
+  public:
+
+    struct Entry
+    {
+      unsigned int texture; ///< Texture of the page containing the tile
+      Rect         region;  ///< Location of the tile (in texture coordinates)
+    };
+
+    struct Stats
+    {
+      size_t hits,      ///< Tiles already on the GPU
+             misses,    ///< Tiles which had to be uploaded (or deferred)
+             evictions, ///< Tiles removed to make room for other tiles
+             bytes;     ///< Texture memory currently allocated
+    };
+
+    /**
+     * @param budget        Maximum texture memory (in bytes). At least one
+     *                      page per tile size is always allocated.
+     * @param page_size     Width and height of atlas textures (limited by
+     *                      GL_MAX_TEXTURE_SIZE)
+     * @param max_uploads   Maximum number of tile uploads per frame
+     */
+    explicit TileAtlas( size_t budget = 256 * 1024 * 1024,
+                        size_t page_size = 2048,
+                        size_t max_uploads = 4 );
+    ~TileAtlas();
+
+    /**
+     * Start a new frame (resets the upload limit). Tiles used during the
+     * current frame are never evicted. Call it once per application frame
+     * (not per rendered tile map), so that the upload limit is shared by all
+     * windows using the atlas.
+     */
+    void nextFrame();
+
+    /**
+     * Get the location of a tile inside the atlas and upload it if it is not
+     * yet available on the GPU (or its change id has changed).
+     *
+     * @param key           Position of the tile
+     * @param tile          Tile (with a valid change id, and ImageRGBA8 data
+     *                      if it has to be uploaded)
+     * @param slot_width    Maximum width of tiles sharing the same pages
+     * @param slot_height   Maximum height of tiles sharing the same pages
+     * @return Location of the tile, or nullptr if it can not be uploaded
+     *         during this frame
+     */
+    const Entry* get( const TileKey& key,
+                      const Tile& tile,
+                      size_t slot_width,
+                      size_t slot_height );
+
+    /**
+     * Number of tiles which could not be uploaded during this frame due to the
+     * upload limit (and will be uploaded during one of the next frames)
+     */
+    size_t numDeferred() const { return _num_deferred; }
+
+    size_t getBudget() const { return _budget; }
+    const Stats& getStats() const { return _stats; }
+
+  protected:
+
+    struct Slot
+    {
+      bool    used;
+      TileKey key;        ///< Tile currently stored (if @a used)
+      size_t  last_used;  ///< Frame of last access
+    };
+
+    struct Page
+    {
+      unsigned int      texture;
+      size_t            slot_width,
+                        slot_height,
+                        cols,
+                        rows;
+      std::vector<Slot> slots;
+
+      size_t bytes() const
+      {
+        return 4 * cols * slot_width * rows * slot_height;
+      }
+      size_t lastUsed() const;
+    };
+    typedef std::unique_ptr<Page> PagePtr;
+
+    struct Location
+    {
+      Page*        page;
+      size_t       slot;
+      unsigned int change_id;
+      Entry        entry;
+    };
+    typedef std::unordered_map<TileKey, Location, TileKey::Hash> Locations;
+
+    size_t  _budget,
+            _page_size,
+            _max_uploads,
+            _frame,
+            _num_uploads,
+            _num_deferred;
+    Stats   _stats;
+
+    std::vector<PagePtr> _pages;
+    Locations            _locations;
+
+    std::vector<unsigned int> _pbos;
+    size_t                    _next_pbo;
+
+    /** Find a free or the least recently used slot for the given size */
+    bool allocSlot( size_t slot_width,
+                    size_t slot_height,
+                    Page*& page,
+                    size_t& slot );
+    Page* addPage(size_t slot_width, size_t slot_height);
+
+    /** Free least recently used pages of other sizes to fit @a bytes */
+    void freePages(size_t bytes, size_t slot_width, size_t slot_height);
+
+    void upload(const Tile& tile, const Page& page, size_t slot);
+
+  private:
+    TileAtlas(const TileAtlas&); // = delete
+    TileAtlas& operator=(const TileAtlas&); // = delete
+};
+
+#endif /* TILE_ATLAS_HPP_ */
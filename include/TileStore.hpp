@@ -0,0 +1,177 @@
+/*
+ * TileStore.hpp
+ *
+ *  Created on: 19.10.2026
+ */
+
+#ifndef TILE_STORE_HPP_
+#define TILE_STORE_HPP_
+
+#include "HierarchicTileMap.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Process-wide storage for the image data of all tiles of all tile maps.
+ *
+ * The memory used for tiles is limited to a given budget. If storing a tile
+ * would exceed the budget, the least recently used tiles (across all maps and
+ * layers) are released. Released tiles are reset to Tile::NONE, so they are
+ * requested again (eg. by the TileHandler) once they are needed.
+ *
+ * Optionally only the most recently used tiles (the hot set) are kept
+ * uncompressed. Other tiles are deflate compressed on a worker thread and
+ * keep their type (Tile::ImageRGBA8) but have no data pointer until they are
+ * decompressed again with load().
+ */
+class TileStore
+{
+  public:
+
+    typedef std::function<void()> ResultCallback;
+
+    static TileStore& getInstance();
+    ~TileStore();
+
+    /** Set maximum memory for tiles (in bytes) */
+    void setBudget(size_t bytes);
+    size_t getBudget() const { return _budget; }
+
+    /**
+     * Configure compression of tiles which have not been used recently.
+     *
+     * @param level     zlib compression level (1-9, 0 = no compression)
+     * @param hot_size  Memory for uncompressed tiles (in bytes)
+     */
+    void setCompression(int level, size_t hot_size);
+
+    /**
+     * Set callback to be notified (from the worker thread) once (de)compressed
+     * tiles are ready to be applied with update().
+     */
+    void setResultCallback(const ResultCallback& cb);
+
+    /** Memory currently used for tiles (in bytes) */
+    size_t getSize() const { return _size; }
+
+    /** Memory currently used for uncompressed tiles (in bytes) */
+    size_t getHotSize() const { return _hot_size; }
+
+    /** Total number of tiles released to stay within the budget */
+    size_t getNumEvicted() const { return _num_evicted; }
+
+    /** Register map for updating tiles on eviction and (de)compression */
+    void addMap(HierarchicTileMap* map);
+
+    /** Release all tiles of the given map and unregister it */
+    void removeMap(HierarchicTileMap* map);
+
+    /**
+     * Store the given tile data (replacing previous data of the same tile)
+     * and evict other tiles if required. The data is not copied, but kept
+     * alive until the tile is removed, evicted or compressed.
+     *
+     * @return Pointer to the stored data (valid until the tile is removed,
+     *         evicted or compressed)
+     */
+    uint8_t* store(const TileKey& key, const TileDataPtr& data, size_t size);
+
+    /** Mark tile as recently used */
+    void touch(const TileKey& key);
+
+    /**
+     * Request the uncompressed data of a tile. Decompression is done
+     * asynchronously and the map is notified once it has finished.
+     *
+     * @return false if the tile is not available
+     */
+    bool load(const TileKey& key);
+
+    /**
+     * Apply finished (de)compressions. Needs to be called regularly from the
+     * thread using the tile maps. Tiles which could not be decompressed are
+     * released (to request them again).
+     */
+    void update();
+
+    /** Release the data of all tiles of the given map */
+    void removeTiles(unsigned int map_id);
+
+  protected:
+
+    typedef std::list<TileKey> LRUList;
+    typedef std::vector<uint8_t> Buffer;
+    typedef std::shared_ptr<Buffer> BufferPtr;
+
+    struct Entry
+    {
+      TileDataPtr       data;       ///< Uncompressed (if hot)
+      BufferPtr         compressed; ///< Compressed (if already cold once)
+      size_t            size;       ///< Uncompressed size
+      LRUList::iterator lru;
+      unsigned int      generation; ///< To detect outdated jobs
+      bool              pending;    ///< Waiting for worker
+      bool              keep_hot;   ///< Compression failed, don't retry
+    };
+    typedef std::unordered_map<TileKey, Entry, TileKey::Hash> Entries;
+    typedef std::unordered_map<unsigned int, HierarchicTileMap*> Maps;
+
+    struct Job
+    {
+      TileKey       key;
+      unsigned int  generation;
+      bool          compress;
+      TileDataPtr   data;       ///< Input for compression, or result
+      BufferPtr     compressed; ///< Input for decompression, or result
+      size_t        size;       ///< Uncompressed size
+    };
+
+    size_t  _budget,
+            _hot_budget,
+            _size,
+            _hot_size,
+            _num_evicted;
+    int     _level;
+    unsigned int _generation;
+    Entries _tiles;
+    LRUList _lru; ///< Most recently used first
+    Maps    _maps;
+
+    std::thread             _worker;
+    std::mutex              _mutex;
+    std::condition_variable _cond_work;
+    std::deque<Job>         _jobs,
+                            _results;
+    bool                    _quit;
+    ResultCallback          _result_callback;
+
+    TileStore();
+
+    /** Evict least recently used tiles until @a size additional bytes fit */
+    void evict(size_t size);
+
+    /** Compress least recently used tiles exceeding the hot set */
+    void cool();
+
+    void remove(Entries::iterator tile);
+    void release(const TileKey& key);
+    void setPointer(const TileKey& key, uint8_t* data);
+
+    void queue(const Job& job);
+    void workerLoop();
+
+  private:
+    TileStore(const TileStore&); // = delete
+    TileStore& operator=(const TileStore&); // = delete
+};
+
+#endif /* TILE_STORE_HPP_ */
@@ -29,7 +29,9 @@ namespace LinksRouting
       {
         LINKS_DIRTY = 1,
         RENDER_DIRTY = LINKS_DIRTY << 1,
-        MASK_DIRTY = RENDER_DIRTY << 1
+        MASK_DIRTY = RENDER_DIRTY << 1,
+        /** Needs to be processed again (eg. pending requests) */
+        PROCESS_DIRTY = MASK_DIRTY << 1
       };
 
       static std::string TypeToString(Type t)
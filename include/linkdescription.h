@@ -36,6 +36,31 @@ namespace LinkDescription
   typedef std::map<std::string, std::string> props_t;
   typedef std::vector<HyperEdgePtr> hedges_t;
 
+  /**
+   * Last tessellation of a line with the revision of the line and the
+   * parameters used to create it (see calcLineBordersCached in
+   * NodeRenderer.hpp).
+   */
+  struct LineBordersCache
+  {
+    uint32_t revision;
+    size_t num_points;
+    float width,
+          widen_end;
+    bool closed,
+         valid;
+    std::pair<points_t, points_t> borders;
+
+    LineBordersCache():
+      revision(0),
+      num_points(0),
+      width(0),
+      widen_end(0),
+      closed(false),
+      valid(false)
+    {}
+  };
+
   class PropertyMap
   {
     public:
@@ -186,8 +211,11 @@ namespace LinkDescription
       explicit Node(HyperEdgePtr hedge);
       ~Node();
 
-      points_t& getVertices();
       const points_t& getVertices() const;
+      void setVertices(const points_t& points);
+
+      /** Incremented on every change of the vertices */
+      uint32_t getRevision() const;
 
       void setLinkPoints(const points_t& points);
       points_t& getLinkPoints();
@@ -204,6 +232,9 @@ namespace LinkDescription
       HyperEdgePtr getParent();
       const HyperEdgePtr getParent() const;
 
+      /** Tessellated outline (only used by renderers) */
+      LineBordersCache& getLineBordersCache() const { return _line_borders; }
+
       const hedges_t& getChildren() const;
       hedges_t& getChildren();
 
@@ -216,8 +247,10 @@ namespace LinkDescription
       points_t _points;
       points_t _link_points;
       points_t _link_points_children;
+      uint32_t _revision;
       HyperEdgeWeakPtr _parent;
       hedges_t _children;
+      mutable LineBordersCache _line_borders;
 
       virtual std::string getImpl(const std::string& key) const override;
   };
@@ -291,6 +324,13 @@ namespace LinkDescription
   {
       nodes_t nodes;
       points_t trail;
+
+      /**
+       * Tessellated trail (only used by renderers). Trails are only written
+       * while routing, which always creates new segments, so the cache does
+       * not need a revision.
+       */
+      mutable LineBordersCache trail_borders;
   };
   typedef std::list<HyperEdgeDescriptionSegment> HedgeSegmentList;
 
@@ -0,0 +1,53 @@
+/*!
+ * @file color_costmap.hpp
+ * @brief
+ * @details
+ */
+
+#ifndef _SLOTDATA_COLOR_COSTMAP_HPP_
+#define _SLOTDATA_COLOR_COSTMAP_HPP_
+
+#include "color.h"
+#include "image.hpp"
+
+#include <vector>
+
+namespace LinksRouting
+{
+namespace SlotType
+{
+
+  /**
+   * Additional costs for routing a link of a given color, which are high
+   * where the desktop has a similar color (links would be hard to see there).
+   * Layers have the same size as "/costmap" and are meant to be added to it
+   * (eg. by Dijkstra::CPURouting).
+   * Four layers are packed into the channels of each image.
+   */
+  struct ColorCostMaps
+  {
+    struct Layer
+    {
+      Color         color;
+      Image         image;    ///< Shared by up to four layers
+      unsigned int  channel;  ///< Channel of @a image holding the costs
+    };
+
+    std::vector<Layer> layers;
+
+    /**
+     * Get the layer for the given link color (or NULL if not available)
+     */
+    const Layer* find(const Color& color) const
+    {
+      for(size_t i = 0; i < layers.size(); ++i)
+        if( layers[i].color == color )
+          return &layers[i];
+      return 0;
+    }
+  };
+
+} // namespace SlotType
+} // namespace LinksRouting
+
+#endif /* _SLOTDATA_COLOR_COSTMAP_HPP_ */
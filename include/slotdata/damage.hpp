@@ -0,0 +1,105 @@
+/*!
+ * @file damage.hpp
+ * @brief
+ * @details
+ */
+
+#ifndef _SLOTDATA_DAMAGE_HPP_
+#define _SLOTDATA_DAMAGE_HPP_
+
+#include "float2.hpp"
+
+#include <mutex>
+#include <vector>
+
+namespace LinksRouting
+{
+namespace SlotType
+{
+
+  /**
+   * Regions of the desktop image which have changed since the last frame (eg.
+   * moved or resized windows). Can be filled from any thread and is consumed
+   * by a single component (the cost analysis).
+   *
+   * Unless a producer also reports changes of the window contents (see
+   * setTracksContent), consumers can not rely on the damage alone and need to
+   * compare frames themselves or update everything.
+   */
+  class Damage
+  {
+    public:
+
+      Damage():
+        _all(true),
+        _tracks_content(false)
+      {}
+
+      /**
+       * Set whether all content changes (eg. scrolling or videos) are reported
+       * and not only changes of the window geometry.
+       */
+      void setTracksContent(bool tracks_content)
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tracks_content = tracks_content;
+      }
+
+      bool tracksContent()
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _tracks_content;
+      }
+
+      /**
+       * Add damaged region (in desktop image coordinates)
+       */
+      void add(const Rect& rect)
+      {
+        if( rect.size.x <= 0 || rect.size.y <= 0 )
+          return;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if( !_all )
+          _rects.push_back(rect);
+      }
+
+      /**
+       * Mark the whole desktop as damaged
+       */
+      void addAll()
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _all = true;
+        _rects.clear();
+      }
+
+      /**
+       * Get and reset all damaged regions.
+       *
+       * @return Whether the whole desktop is damaged (@a rects is empty then)
+       */
+      bool take(std::vector<Rect>& rects)
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        bool all = _all;
+
+        rects.clear();
+        rects.swap(_rects);
+        _all = false;
+
+        return all;
+      }
+
+    private:
+
+      std::mutex        _mutex;
+      std::vector<Rect> _rects;
+      bool              _all,
+                        _tracks_content;
+  };
+
+} // namespace SlotType
+} // namespace LinksRouting
+
+#endif /* _SLOTDATA_DAMAGE_HPP_ */
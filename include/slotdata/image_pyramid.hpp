@@ -0,0 +1,74 @@
+/*!
+ * @file image_pyramid.hpp
+ * @brief
+ * @details
+ */
+
+#ifndef _SLOTDATA_IMAGE_PYRAMID_HPP_
+#define _SLOTDATA_IMAGE_PYRAMID_HPP_
+
+#include "image.hpp"
+
+#include <string>
+#include <vector>
+
+namespace LinksRouting
+{
+namespace SlotType
+{
+
+  /**
+   * Image at multiple resolutions, each level reduced by a factor of two (eg.
+   * the costmap for routers working on coarser cells). Level 0 is the full
+   * resolution image.
+   */
+  struct ImagePyramid
+  {
+    enum Reduction
+    {
+      Max,  ///< Keep the highest value (obstacles are not lost)
+      Mean
+    };
+
+    Reduction reduction;
+
+    /** Number of desktop pixels per pixel of level 0 */
+    unsigned int base_scale;
+
+    std::vector<Image> levels;
+
+    ImagePyramid():
+      reduction(Max),
+      base_scale(1)
+    {}
+
+    /**
+     * Number of desktop pixels per pixel of the given level
+     */
+    unsigned int scale(size_t level) const
+    {
+      return base_scale << level;
+    }
+
+    /**
+     * Get the coarsest level with pixels not larger than @a cell_size
+     * (desktop pixels).
+     */
+    size_t levelForCellSize(unsigned int cell_size) const
+    {
+      size_t level = 0;
+      while( level + 1 < levels.size() && scale(level + 1) <= cell_size )
+        ++level;
+      return level;
+    }
+
+    static Reduction reductionFromString(const std::string& str)
+    {
+      return str == "mean" ? Mean : Max;
+    }
+  };
+
+} // namespace SlotType
+} // namespace LinksRouting
+
+#endif /* _SLOTDATA_IMAGE_PYRAMID_HPP_ */
@@ -0,0 +1,75 @@
+/*!
+ * @file metrics.hpp
+ * @brief
+ * @details
+ */
+
+#ifndef _SLOTDATA_METRICS_HPP_
+#define _SLOTDATA_METRICS_HPP_
+
+#include <functional>
+#include <map>
+#include <string>
+
+namespace LinksRouting
+{
+namespace SlotType
+{
+
+  /**
+   * Runtime statistics of components (eg. profiling information). Components
+   * register a provider which serializes its current state as JSON value, so
+   * it can be queried by clients with a GET request for "/metrics" or
+   * "/metrics/<name>".
+   */
+  struct Metrics
+  {
+    typedef std::function<std::string ()> Provider;
+
+    /** name -> provider */
+    std::map<std::string, Provider> providers;
+
+    void add(const std::string& name, const Provider& provider)
+    {
+      providers[name] = provider;
+    }
+
+    void remove(const std::string& name)
+    {
+      providers.erase(name);
+    }
+
+    /**
+     * Get the JSON representation of the metrics with the given name, or of
+     * all metrics if @a name is empty.
+     */
+    std::string toJSON(const std::string& name = std::string()) const
+    {
+      if( !name.empty() )
+      {
+        auto provider = providers.find(name);
+        if( provider == providers.end() || !provider->second )
+          return "null";
+        return provider->second();
+      }
+
+      std::string json = "{";
+      for( auto provider = providers.begin();
+                provider != providers.end();
+              ++provider )
+      {
+        if( !provider->second )
+          continue;
+
+        if( json.size() > 1 )
+          json += ",";
+        json += "\"" + provider->first + "\":" + provider->second();
+      }
+      return json + "}";
+    }
+  };
+
+} // namespace SlotType
+} // namespace LinksRouting
+
+#endif /* _SLOTDATA_METRICS_HPP_ */
@@ -0,0 +1,72 @@
+/*
+ * FramebufferReader.hpp
+ *
+ *  Created on: 19.10.2026
+ */
+
+#ifndef QTF_FRAMEBUFFERREADER_HPP_
+#define QTF_FRAMEBUFFERREADER_HPP_
+
+#include <QImage>
+#include <QOpenGLBuffer>
+#include <QRegion>
+#include <vector>
+
+namespace qtfullscreensystem
+{
+
+  /**
+   * Asynchronous readback of a framebuffer into a QImage using multiple pixel
+   * buffer objects. Reading a frame only queues the transfer, which is copied
+   * to the image once the buffer is reused (@a num_buffers - 1 frames later),
+   * so the GPU is never stalled by waiting for the current frame.
+   */
+  class FramebufferReader
+  {
+    public:
+
+      /**
+       * Requires a current OpenGL context.
+       *
+       * @param size          Size of the framebuffer
+       * @param num_buffers   Number of frames in flight (1 = synchronous)
+       */
+      FramebufferReader(const QSize& size, size_t num_buffers = 2);
+      ~FramebufferReader();
+
+      /**
+       * Queue reading @a region (image coordinates, y pointing downwards)
+       * from the currently bound framebuffer.
+       */
+      void read(QRegion region);
+
+      /**
+       * Copy the oldest queued frame to @a img (same size as the framebuffer)
+       *
+       * @return Region of @a img which has been updated
+       */
+      QRegion update(QImage& img);
+
+      /** Whether there are queued frames not yet copied by update() */
+      bool pending() const;
+
+    protected:
+
+      struct Buffer
+      {
+        QOpenGLBuffer pbo;
+        QRegion       region; ///< Queued but not yet copied
+      };
+
+      QSize               _size;
+      std::vector<Buffer> _buffers;
+      size_t              _next;
+
+    private:
+      FramebufferReader(const FramebufferReader&); // = delete
+      FramebufferReader& operator=(const FramebufferReader&); // = delete
+  };
+
+} // namespace qtfullscreensystem
+
+#endif /* QTF_FRAMEBUFFERREADER_HPP_ */
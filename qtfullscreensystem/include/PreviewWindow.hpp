@@ -13,11 +13,15 @@
 #include <slotdata/mouse_event.hpp>
 #include <slotdata/text_popup.hpp>
 #include <slotdata/TileHandler.hpp>
+#include <TileAtlas.hpp>
 
 #include <QWindow>
 #include <QOpenGLFunctions>
 #include <QOpenGLPaintDevice>
 
+#include <functional>
+#include <memory>
+
 namespace qtfullscreensystem
 {
   namespace LR = LinksRouting;
@@ -30,9 +34,18 @@ namespace qtfullscreensystem
     public:
       QtPreviewWindow(Popup *popup);
       QtPreviewWindow(SeeThrough *see_through);
+      virtual ~QtPreviewWindow();
 
       void subscribeSlots(LR::SlotSubscriber& slot_subscriber);
 
+      /// Share textures with the given context and use the shared tile cache
+      /// (before the first render). @a schedule_frame is used to request an
+      /// application frame (which resets the upload limit of the tile cache)
+      /// if uploading tiles has been deferred.
+      void setShareResources( QOpenGLContext* share_context,
+                              TileAtlas* tile_cache,
+                              const std::function<void()>& schedule_frame );
+
       virtual void initialize();
 
       /// Send geometry for preview (excluding space for margin/border)
@@ -55,8 +68,9 @@ namespace qtfullscreensystem
       bool    _do_drag;
       float2  _last_mouse_pos;
 
-      GLImageCache _image_cache;
+      TileAtlas   *_tile_cache;
       unsigned int _tile_map_change_id;
+      bool         _tiles_deferred;
 
       LR::slot_t<LR::SlotType::MouseEvent>::type  _subscribe_mouse;
       LR::slot_t<LR::SlotType::TextPopup>::type   _subscribe_popups;
@@ -71,13 +85,20 @@ namespace qtfullscreensystem
 
       void renderPopup();
       void renderSeeThrough();
+      void onTilesDeferred();
 
     private:
       bool _update_pending;
 
-      QOpenGLContext     *_context;
+      QOpenGLContext     *_context,
+                         *_share_context;
       QOpenGLPaintDevice *_device;
 
+      /// Only used if the context can not share resources with the
+      /// application context
+      std::unique_ptr<TileAtlas>  _private_tile_cache;
+      std::function<void()>       _schedule_frame;
+
       void init();
       void updateGeometry();
 
@@ -12,6 +12,7 @@
 #include <slotdata/mouse_event.hpp>
 #include <slotdata/text_popup.hpp>
 
+#include <QRegion>
 #include <QWidget>
 #include <memory>
 
@@ -29,6 +30,17 @@ namespace qtfullscreensystem
 
       void setImage(QImage const* img);
 
+      /**
+       * Repaint the parts of the window showing the given region of the image
+       * (image coordinates)
+       */
+      void updateImageRegion(const QRegion& region);
+
+      /**
+       * Region of the image shown by this window
+       */
+      QRect imageRect() const;
+
     protected:
       QRect     _geometry;
       QImage const *_img;
@@ -9,6 +9,7 @@
 #ifndef _APPLICATION_HPP_
 #define _APPLICATION_HPP_
 
+#include "FramebufferReader.hpp"
 #include "Shader.hpp"
 #include "Window.hpp"
 
@@ -18,13 +19,16 @@
 #include "cpurouting.h"
 #include "cpurouting-dijkstra.h"
 #include "dummyrouting.h"
+#include "cpucostanalysis.h"
 #if USE_GPU_ROUTING
 # include "glcostanalysis.h"
 # include "gpurouting.h"
 #endif
 #include "glrenderer.h"
+#include "TileAtlas.hpp"
 
 #include <QApplication>
+#include <QElapsedTimer>
 #include <QOffscreenSurface>
 #include <QOpenGLContext>
 #include <QOpenGLFramebufferObject>
@@ -52,6 +56,18 @@ namespace qtfullscreensystem
       LR::SlotCollector getSlotCollector();
       LR::SlotSubscriber getSlotSubscriber();
 
+      /**
+       * Context sharing textures and buffers with the render context. Use it
+       * as share context for all other contexts (eg. preview windows).
+       */
+      QOpenGLContext* getShareContext();
+
+      /**
+       * Tile cache shared by all contexts of the share group. Requires a
+       * context of the group to be current while using the cache.
+       */
+      TileAtlas* getTileCache();
+
     signals:
       void frame();
 
@@ -59,14 +75,28 @@ namespace qtfullscreensystem
 
       void update();
 
+      /**
+       * Request a new frame processing the given flags (LINKS_DIRTY, ...).
+       * Multiple requests are merged into a single frame and frames are
+       * limited to the display refresh rate.
+       */
+      void scheduleFrame(uint32_t flags = 0);
+
     protected:
 
+      /**
+       * Update "/desktop" in main memory (for CPUCostAnalysis) from a
+       * screenshot or the DebugDesktopImage.
+       */
+      void updateDesktopImage();
+
       // ----------
       // Slots
       // ----------
 
       LR::slot_t<LR::SlotType::Image>::type             _slot_desktop;
       LR::slot_t<Rect>::type                            _slot_desktop_rect;
+      LR::slot_t<LR::SlotType::Damage>::type            _slot_desktop_damage;
       LR::slot_t<LR::SlotType::MouseEvent>::type        _slot_mouse;
       LR::slot_t<LR::SlotType::TextPopup>::type         _slot_popups;
       LR::slot_t<LR::SlotType::Preview>::type           _slot_previews;
@@ -74,6 +104,7 @@ namespace qtfullscreensystem
       // TODO make readonly
       LR::slot_t<LR::SlotType::Image>::type             _subscribe_links,
                                                         _subscribe_xray_fbo;
+      LR::slot_t<std::vector<Rect>>::type               _subscribe_links_damage;
       LR::slot_t<LR::SlotType::Image>::type             _subscribe_costmap;
       LR::slot_t<LR::LinkDescription::LinkList>::type   _subscribe_routed_links;
       LR::slot_t<LR::SlotType::CoveredOutline>::type    _subscribe_outlines;
@@ -93,17 +124,31 @@ namespace qtfullscreensystem
       LR::GlCostAnalysis        _cost_analysis;
       LR::GPURouting            _routing_gpu;
 #endif
+      LR::CPUCostAnalysis       _cost_analysis_cpu;
+      std::string               _cost_analysis_type;
+      bool                      _use_cpu_cost_analysis;
+      std::string               _debug_desktop_image;
+      QImage                    _desktop_image;
       LR::GlRenderer            _renderer;
 
       // ----------
       // Rendering
       // ----------
 
+      QTimer                                    _frame_timer;
+      QElapsedTimer                             _frame_time;
+      uint32_t                                  _dirty_flags;
+      int                                       _max_fps;
+
       QOffscreenSurface                         _offscreen_surface;
       QOpenGLContext                            _gl_ctx;
       std::unique_ptr<QOpenGLFramebufferObject> _fbo;
+      std::unique_ptr<FramebufferReader>        _fbo_reader;
+      int                                       _num_readback_buffers;
       QImage                                    _fbo_image;
       ShaderPtr                                 _shader_blend;
+      std::unique_ptr<TileAtlas>                _tile_cache;
+      int                                       _tile_cache_size;
 
       std::vector<WindowRef>    _windows;
       std::vector<WindowRef>    _mask_windows;
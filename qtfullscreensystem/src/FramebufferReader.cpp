@@ -0,0 +1,137 @@
+/*
+ * FramebufferReader.cpp
+ *
+ *  Created on: 19.10.2026
+ */
+
+#include "FramebufferReader.hpp"
+
+#include <QDebug>
+#include <QOpenGLContext>
+
+#include <algorithm>
+#include <cstring>
+
+namespace qtfullscreensystem
+{
+  /** Merge into bounding box if there are more (small) regions */
+  static const int MAX_READ_RECTS = 32;
+
+  //----------------------------------------------------------------------------
+  FramebufferReader::FramebufferReader(const QSize& size, size_t num_buffers):
+    _size(size),
+    _buffers(std::max<size_t>(num_buffers, 1)),
+    _next(0)
+  {
+    for(auto& buffer: _buffers)
+    {
+      buffer.pbo = QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+      buffer.pbo.setUsagePattern(QOpenGLBuffer::StreamRead);
+      if( !buffer.pbo.create() )
+        qFatal("Failed to create pixel buffer object.");
+
+      buffer.pbo.bind();
+      buffer.pbo.allocate(4 * _size.width() * _size.height());
+      buffer.pbo.release();
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  FramebufferReader::~FramebufferReader()
+  {
+    for(auto& buffer: _buffers)
+      buffer.pbo.destroy();
+  }
+
+  //----------------------------------------------------------------------------
+  void FramebufferReader::read(QRegion region)
+  {
+    // Always advance to the next buffer, as otherwise the last queued frame
+    // would never be copied if nothing changes.
+    Buffer& buffer = _buffers[_next];
+    _next = (_next + 1) % _buffers.size();
+
+    region &= QRect(QPoint(0, 0), _size);
+    if( region.isEmpty() )
+      return;
+
+    if( region.rectCount() > MAX_READ_RECTS )
+      region = region.boundingRect();
+
+    // Every buffer uses the layout of the whole framebuffer, so regions of
+    // multiple reads can be combined if a buffer has not been copied yet.
+    buffer.region += region;
+    buffer.pbo.bind();
+
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glPixelStorei(GL_PACK_ROW_LENGTH, _size.width());
+
+    for(const QRect& rect: region.rects())
+    {
+      // OpenGL starts at the bottom row
+      const int y = _size.height() - rect.bottom() - 1;
+      const size_t offset = 4 * (y * _size.width() + rect.x());
+      glReadPixels( rect.x(), y, rect.width(), rect.height(),
+                    GL_BGRA, GL_UNSIGNED_BYTE,
+                    reinterpret_cast<GLvoid*>(offset) );
+    }
+
+    glPopClientAttrib();
+    buffer.pbo.release();
+  }
+
+  //----------------------------------------------------------------------------
+  QRegion FramebufferReader::update(QImage& img)
+  {
+    // The next buffer to be written holds the oldest frame
+    Buffer& buffer = _buffers[_next];
+    if( buffer.region.isEmpty() )
+      return QRegion();
+
+    if(    img.size() != _size
+        || img.format() != QImage::Format_ARGB32_Premultiplied )
+    {
+      img = QImage(_size, QImage::Format_ARGB32_Premultiplied);
+      img.fill(0);
+    }
+
+    buffer.pbo.bind();
+    const uchar* data =
+      static_cast<const uchar*>(buffer.pbo.map(QOpenGLBuffer::ReadOnly));
+    if( !data )
+    {
+      qWarning() << "FramebufferReader: Failed to map pixel buffer object.";
+      buffer.pbo.release();
+      return QRegion();
+    }
+
+    const size_t stride = 4 * _size.width();
+    for(const QRect& rect: buffer.region.rects())
+    {
+      const size_t num_bytes = 4 * rect.width();
+      for(int row = rect.top(); row <= rect.bottom(); ++row)
+        std::memcpy( img.scanLine(row) + 4 * rect.x(),
+                     data + (_size.height() - row - 1) * stride
+                          + 4 * rect.x(),
+                     num_bytes );
+    }
+
+    buffer.pbo.unmap();
+    buffer.pbo.release();
+
+    QRegion updated = buffer.region;
+    buffer.region = QRegion();
+    return updated;
+  }
+
+  //----------------------------------------------------------------------------
+  bool FramebufferReader::pending() const
+  {
+    for(auto const& buffer: _buffers)
+      if( !buffer.region.isEmpty() )
+        return true;
+    return false;
+  }
+
+} // namespace qtfullscreensystem
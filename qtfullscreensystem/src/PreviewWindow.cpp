@@ -43,6 +43,17 @@ namespace qtfullscreensystem
     init();
   }
 
+  //----------------------------------------------------------------------------
+  QtPreviewWindow::~QtPreviewWindow()
+  {
+    // Textures of the private cache need to be released with its context
+    if( _private_tile_cache && _context && _context->makeCurrent(this) )
+    {
+      _private_tile_cache.reset();
+      _context->doneCurrent();
+    }
+  }
+
   //----------------------------------------------------------------------------
   void QtPreviewWindow::subscribeSlots(LR::SlotSubscriber& slot_subscriber)
   {
@@ -54,6 +65,17 @@ namespace qtfullscreensystem
       slot_subscriber.getSlot<LR::SlotType::TileHandler>("/tile-handler");
   }
 
+  //----------------------------------------------------------------------------
+  void QtPreviewWindow::setShareResources(
+    QOpenGLContext* share_context,
+    TileAtlas* tile_cache,
+    const std::function<void()>& schedule_frame )
+  {
+    _share_context = share_context;
+    _tile_cache = tile_cache;
+    _schedule_frame = schedule_frame;
+  }
+
   //----------------------------------------------------------------------------
   void QtPreviewWindow::initialize()
   {
@@ -105,6 +127,16 @@ namespace qtfullscreensystem
   //----------------------------------------------------------------------------
   void QtPreviewWindow::update(double)
   {
+    // Called once per application frame, so uploading deferred tiles can
+    // continue
+    if( _private_tile_cache )
+      _private_tile_cache->nextFrame();
+    if( _tiles_deferred )
+    {
+      _tiles_deferred = false;
+      renderLater();
+    }
+
     if( !_popup )
       return;
 
@@ -146,9 +178,13 @@ namespace qtfullscreensystem
 
     if( !_context )
     {
+      // Sharing resources requires a compatible format
       _context = new QOpenGLContext(this);
-      _context->setFormat(requestedFormat());
-      _context->create();
+      _context->setFormat( _share_context ? _share_context->format()
+                                          : requestedFormat() );
+      _context->setShareContext(_share_context);
+      if( !_context->create() )
+        qWarning() << "Failed to create preview context.";
 
       needs_init = true;
     }
@@ -159,6 +195,16 @@ namespace qtfullscreensystem
     {
       initializeOpenGLFunctions();
       initialize();
+
+      // Textures of the shared cache can not be used without sharing, so
+      // fall back to a cache only used by this window
+      if( _tile_cache && !_context->shareContext() )
+      {
+        qWarning() << "Preview context does not share resources,"
+                      " using private tile cache.";
+        _private_tile_cache.reset( new TileAtlas(_tile_cache->getBudget()) );
+        _tile_cache = _private_tile_cache.get();
+      }
     }
 
     render();
@@ -277,14 +323,16 @@ namespace qtfullscreensystem
 
     std::cout << "render preview:" << std::endl;
     auto tile_map = preview.tile_map.lock();
-    if( tile_map )
-      tile_map->render( preview.src_region,
-                        preview.scroll_region.size,
-                        Rect(float2(0, 0), size()),
-                        _popup->hover_region.zoom,
-                        _popup->auto_resize,
-                        _popup->hover_region.getAlpha(),
-                        &_image_cache );
+    // Tiles exceeding the upload limit of a frame are shown in a later frame
+    if(    tile_map && _tile_cache
+        && !tile_map->render( preview.src_region,
+                              preview.scroll_region.size,
+                              Rect(float2(0, 0), size()),
+                              *_tile_cache,
+                              _popup->hover_region.zoom,
+                              _popup->auto_resize,
+                              _popup->hover_region.getAlpha() ) )
+      onTilesDeferred();
 
 //    glMatrixMode(GL_PROJECTION);
 //    glPushMatrix();
@@ -358,16 +406,27 @@ namespace qtfullscreensystem
       return;
     }
 
+    if( !_tile_cache )
+      return;
+
     std::cout << "render tilemap: " << _see_through->source_region << std::endl;
 
     //      renderRect( preview.preview_region );
-    tile_map->render( _see_through->source_region,
-                      _see_through->source_region.size,
-                      Rect(float2(0, 0), _see_through->preview_region.size),
-                      -1,
-                      false,
-                      1,
-                      &_image_cache );
+    if( !tile_map->render( _see_through->source_region,
+                           _see_through->source_region.size,
+                           Rect(float2(0, 0), _see_through->preview_region.size),
+                           *_tile_cache ) )
+      onTilesDeferred();
+  }
+
+  //----------------------------------------------------------------------------
+  void QtPreviewWindow::onTilesDeferred()
+  {
+    // Rendering again only helps after the upload limit has been reset with
+    // the next application frame (see update)
+    _tiles_deferred = true;
+    if( _schedule_frame )
+      _schedule_frame();
   }
 
   //----------------------------------------------------------------------------
@@ -377,6 +436,9 @@ namespace qtfullscreensystem
     _do_drag = false;
     _last_mouse_pos = float2(0,0);
     _tile_map_change_id = 0;
+    _tiles_deferred = false;
+    _share_context = nullptr;
+    _tile_cache = nullptr;
     _update_pending = false;
     _context = nullptr;
     _device = nullptr;
@@ -11,7 +11,6 @@
 #include <QSize>
 
 #include "Window.hpp"
-#include <QBitmap>
 #include <QDebug>
 #include <QGuiApplication>
 #include <QMouseEvent>
@@ -83,42 +82,22 @@ namespace qtfullscreensystem
   }
 
   //----------------------------------------------------------------------------
-  QBitmap createMaskFromColor( const QImage& img,
-                               QRgb color,
-                               const QRect& region )
+  void RenderWindow::updateImageRegion(const QRegion& region)
   {
-    QImage maskImage(region.size(), QImage::Format_MonoLSB);
-    maskImage.fill(0);
-    uchar *s = maskImage.bits();
+    const QRect img_rect = imageRect();
+    const QRegion local_region =
+      (region & img_rect).translated(-img_rect.topLeft());
 
-    for(int h = region.top(); h < region.bottom(); h++)
-    {
-      const uint *sl = (uint *)img.scanLine(h);
-      for(int w = region.left(); w < region.right(); w++)
-      {
-        if( sl[w] == color )
-          *(s + ((w - region.left()) >> 3)) |= (1 << ((w - region.left()) & 7));
-      }
-      s += maskImage.bytesPerLine();
-    }
-
-    return QBitmap::fromImage(maskImage);
+    if( !local_region.isEmpty() )
+      update(local_region);
   }
 
-  void maskFillRect( QImage& mask_img,
-                     const QRect& rect )
+  //----------------------------------------------------------------------------
+  QRect RenderWindow::imageRect() const
   {
-    int b = std::min(rect.bottom(), mask_img.height()),
-        r = std::min(rect.right(), mask_img.width());
-
-    uchar *s = mask_img.scanLine(rect.top());
-    for(int h = rect.top(); h < b; ++h)
-    {
-      for(int w = rect.left(); w < r; w++)
-        // TODO optimize: fill contiguous regions at once...
-        *(s + (w >> 3)) &= ~(1 << (w & 7));
-      s += mask_img.bytesPerLine();
-    }
+    return _geometry.translated(
+      -QGuiApplication::primaryScreen()->availableVirtualGeometry().topLeft()
+    );
   }
 
   //----------------------------------------------------------------------------
@@ -159,13 +138,13 @@ namespace qtfullscreensystem
   //----------------------------------------------------------------------------
   void RenderWindow::paintEvent(QPaintEvent* e)
   {
-    QRect reg = _geometry.translated(
-      -QGuiApplication::primaryScreen()->availableVirtualGeometry().topLeft()
-    );
+    QRect reg = imageRect();
     QRect local_reg(QPoint(0,0), size());
 
-    QImage mask_img;
-    bool mask_empty = true;
+    // Windows without image are only visible (and receive input) where
+    // popups are shown
+    const bool build_mask = !_img;
+    QRegion mask;
     if( _img )
     {
       if( _img->isNull() )
@@ -175,23 +154,16 @@ namespace qtfullscreensystem
       assert( _img->height() >= reg.bottom() );
       assert( _img->width()  >= reg.right()  );
     }
-    else // TODO add switch to create full window mask?
-    {
-      mask_img = QImage(reg.size(), QImage::Format_MonoLSB);
-      mask_img.fill(1);
-    }
 
     QPainter painter(this);
 //    qDebug() << "paint" << geometry() << _geometry << reg;
 
-    // TODO const QBitmap& mask = createMaskFromColor(*_img, qRgba(0,0,0, 0), reg);
-    //mask.save(QString("mask-%1-%2.png").arg((uint64_t)this).arg(counter++));
-
-    //setMask(mask);
     if( _img )
-      painter.drawImage( QRectF(0, 0, -1, -1),
-                         *_img,
-                         QRectF(reg) );
+    {
+      // Only copy the damaged parts (see updateImageRegion)
+      for(const QRect& rect: e->region().rects())
+        painter.drawImage(rect, *_img, rect.translated(reg.topLeft()));
+    }
 
     for( auto popup = _subscribe_popups->_data->popups.begin();
               popup != _subscribe_popups->_data->popups.end();
@@ -214,12 +186,8 @@ namespace qtfullscreensystem
         QString::fromStdString(popup->text)
       );
 
-      if(    !mask_img.isNull()
-          && !text_rect.isNull() )
-      {
-        maskFillRect(mask_img, text_rect);
-        mask_empty = false;
-      }
+      if( build_mask && !text_rect.isNull() )
+        mask += text_rect;
     }
 
     painter.setPen(Qt::white);
@@ -248,16 +216,13 @@ namespace qtfullscreensystem
         title
       );
 
-      if(    !mask_img.isNull()
+      if(    build_mask
           && !text_rect.isEmpty()
           &&  text_rect.intersects(local_reg) )
-      {
-        maskFillRect(mask_img, text_rect);
-        mask_empty = false;
-      }
+        mask += text_rect;
     }
 
-    if( !mask_img.isNull() )
+    if( build_mask )
     {
       for( auto const& popup: _subscribe_popups->_data->popups )
       {
@@ -272,8 +237,7 @@ namespace qtfullscreensystem
             || !popup_rect.intersects(local_reg) )
           continue;
 
-        maskFillRect(mask_img, popup_rect);
-        mask_empty = false;
+        mask += popup_rect;
       }
 
       for(auto const& preview: _subscribe_xray->_data->popups)
@@ -287,16 +251,14 @@ namespace qtfullscreensystem
             || !reg.intersects(local_reg) )
           continue;
 
-        maskFillRect(mask_img, reg);
-        mask_empty = false;
+        mask += reg;
       }
 
-      if( mask_empty )
+      mask &= local_reg;
+      if( mask.isEmpty() )
         setMask(QRegion(width() - 2, height() - 2, 1, 1));
-      else
-        setMask(QBitmap::fromImage(mask_img));
-//      static size_t counter = 0;
-//      QBitmap::fromImage(mask_img).save(QString("mask-%1-%2.png").arg((uint64_t)this).arg(counter++));
+      else if( mask != this->mask() )
+        setMask(mask);
     }
   }
 
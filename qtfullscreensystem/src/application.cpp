@@ -15,6 +15,8 @@
 #include <QElapsedTimer>
 #include <QScreen>
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 namespace qtfullscreensystem
@@ -40,6 +42,9 @@ namespace qtfullscreensystem
 
         QtPreviewWindow* w = new QtPreviewWindow(popup);
         w->subscribeSlots(slot_subscriber);
+        w->setShareResources( app->getShareContext(),
+                              app->getTileCache(),
+                              [app](){ app->scheduleFrame(); } );
 
         return w;
       }
@@ -60,6 +65,9 @@ namespace qtfullscreensystem
 
         QtPreviewWindow* w = new QtPreviewWindow(see_through);
         w->subscribeSlots(slot_subscriber);
+        w->setShareResources( app->getShareContext(),
+                              app->getTileCache(),
+                              [app](){ app->scheduleFrame(); } );
 
         return w;
       }
@@ -69,7 +77,8 @@ namespace qtfullscreensystem
   Application::Application(int& argc, char *argv[]):
     Configurable("Application"),
     QApplication(argc, argv),
-    _server(&_mutex_slot_links, &_cond_render)
+    _server(&_mutex_slot_links, &_cond_render),
+    _dirty_flags(0)
   {
 //    _cur_fbo(0),
 //    _do_drag(false),
@@ -114,21 +123,49 @@ namespace qtfullscreensystem
       qFatal("Failed to read config");
     _user_config.initFrom( to_string(user_config) );
 
+    // Config values are only applied by _core.init, but the cost analysis
+    // needs to be known before attaching the components.
+#ifdef USE_GPU_ROUTING
+    _cost_analysis_type = "gl";
+#else
+    _cost_analysis_type = "none";
+#endif
+    _config.getString("Application:CostAnalysis", _cost_analysis_type);
+    _use_cpu_cost_analysis = (_cost_analysis_type == "cpu");
+
     _core.startup();
     _core.attachComponent(&_config);
     _core.attachComponent(&_user_config);
     _core.attachComponent(&_server);
+
+    // Components are processed in order of attaching, so the cost analysis
+    // needs to be attached before routing to use the current costmap
+#ifdef USE_GPU_ROUTING
+    if( _cost_analysis_type == "gl" )
+    {
+      _core.attachComponent(&_cost_analysis);
+
+      // Dijkstra routing avoids content with a color similar to the link
+      _cost_analysis.connect(&_routing_cpu_dijkstra);
+    }
+#endif
+    if( _use_cpu_cost_analysis )
+      _core.attachComponent(&_cost_analysis_cpu);
+
     _core.attachComponent(&_routing_cpu);
     _core.attachComponent(&_routing_cpu_dijkstra);
     _core.attachComponent(&_routing_dummy);
 #ifdef USE_GPU_ROUTING
-    _core.attachComponent(&_cost_analysis);
     _core.attachComponent(&_routing_gpu);
 #endif
     _core.attachComponent(&_renderer);
 
     _core.attachComponent(this);
-//    registerArg("DebugDesktopImage", _debug_desktop_image);
+    registerArg("ReadbackBuffers", _num_readback_buffers = 2);
+    registerArg("MaxFPS", _max_fps = 0);
+    registerArg("TileCacheSize", _tile_cache_size = 256);
+    registerArg("CostAnalysis", _cost_analysis_type);
+    registerArg("DebugDesktopImage", _debug_desktop_image);
 //    registerArg("DumpScreenshot", _dump_screenshot = 0);
 
     QSurfaceFormat fmt;
@@ -160,15 +197,37 @@ namespace qtfullscreensystem
 
     _core.init();
 
-    QTimer *timer = new QTimer(this);
-    connect(timer, SIGNAL(timeout()), this, SLOT(update()));
-    timer->start(200);
+    // Needs the config (for the size) and is shared by all preview windows
+    if( !_gl_ctx.makeCurrent(&_offscreen_surface) )
+      qFatal("Could not activate OpenGL context.");
+    _tile_cache.reset(
+      new TileAtlas(static_cast<size_t>(std::max(_tile_cache_size, 1)) << 20)
+    );
+    _gl_ctx.doneCurrent();
+
+    // Only render if something has changed
+    _frame_timer.setSingleShot(true);
+    _frame_timer.setTimerType(Qt::PreciseTimer);
+    connect(&_frame_timer, SIGNAL(timeout()), this, SLOT(update()));
+    connect( &_server, SIGNAL(dirty(uint32_t)),
+             this, SLOT(scheduleFrame(uint32_t)) );
+
+    scheduleFrame(LINKS_DIRTY | RENDER_DIRTY | MASK_DIRTY);
   }
 
   //----------------------------------------------------------------------------
   Application::~Application()
   {
-
+    if( _tile_cache && _gl_ctx.makeCurrent(&_offscreen_surface) )
+    {
+      const TileAtlas::Stats& stats = _tile_cache->getStats();
+      LOG_INFO( "Tile cache: " << stats.hits << " hits, "
+                               << stats.misses << " misses, "
+                               << stats.evictions << " evictions, "
+                               << (stats.bytes >> 20) << " MiB" );
+      _tile_cache.reset();
+      _gl_ctx.doneCurrent();
+    }
   }
 
   //----------------------------------------------------------------------------
@@ -176,7 +235,9 @@ namespace qtfullscreensystem
   {
     _slot_desktop =
       slot_collector.create<LR::SlotType::Image>("/desktop");
-    _slot_desktop->_data->type = LR::SlotType::Image::OpenGLTexture;
+    _slot_desktop->_data->type = _use_cpu_cost_analysis
+                               ? LR::SlotType::Image::ImageRGBA8
+                               : LR::SlotType::Image::OpenGLTexture;
 
     _slot_desktop_rect =
       slot_collector.create<Rect>("/desktop/rect");
@@ -184,6 +245,10 @@ namespace qtfullscreensystem
       QGuiApplication::primaryScreen()->availableVirtualGeometry();
     _slot_desktop_rect->setValid(true);
 
+    _slot_desktop_damage =
+      slot_collector.create<LR::SlotType::Damage>("/desktop/damage");
+    _slot_desktop_damage->setValid(true);
+
     _slot_mouse =
       slot_collector.create<LR::SlotType::MouseEvent>("/mouse");
     _slot_popups =
@@ -199,6 +264,8 @@ namespace qtfullscreensystem
       slot_subscriber.getSlot<LR::SlotType::Image>("/rendered-links");
     _subscribe_xray_fbo =
       slot_subscriber.getSlot<LR::SlotType::Image>("/rendered-xray");
+    _subscribe_links_damage =
+      slot_subscriber.getSlot<std::vector<Rect>>("/rendered-links/damage");
 #ifdef USE_GPU_ROUTING
     _subscribe_costmap =
       slot_subscriber.getSlot<LR::SlotType::Image>("/costmap");
@@ -226,20 +293,43 @@ namespace qtfullscreensystem
     return _core.getSlotSubscriber();
   }
 
+  //----------------------------------------------------------------------------
+  QOpenGLContext* Application::getShareContext()
+  {
+    return &_gl_ctx;
+  }
+
+  //----------------------------------------------------------------------------
+  TileAtlas* Application::getTileCache()
+  {
+    return _tile_cache.get();
+  }
+
   //----------------------------------------------------------------------------
   void Application::update()
   {
     int pass = 1;
-    uint32_t _flags = LINKS_DIRTY | RENDER_DIRTY;
+    _frame_time.start();
+
+    uint32_t flags = _dirty_flags;
+    _dirty_flags = 0;
+    if( flags & LINKS_DIRTY )
+      flags |= RENDER_DIRTY;
 
     if( !_gl_ctx.makeCurrent(&_offscreen_surface) )
       qFatal("Could not activate OpenGL context.");
 
+    // Upload limit is shared by all preview windows rendered until the next
+    // frame
+    if( _tile_cache )
+      _tile_cache->nextFrame();
+
     if( !_fbo )
     {
       QSize size = QGuiApplication::primaryScreen()->availableVirtualSize();
       qDebug() << "initFBO" << size;
       _fbo.reset(new QOpenGLFramebufferObject(size));
+      _fbo_reader.reset(new FramebufferReader(size, _num_readback_buffers));
 
       _shader_blend = Shader::loadFromFiles("simple.vert", "blend.frag");
       if( !_shader_blend )
@@ -258,21 +348,29 @@ namespace qtfullscreensystem
     glMatrixMode(GL_PROJECTION);
     glOrtho(desktop.l(), desktop.r(), desktop.t(), desktop.b(), -1.0, 1.0);
 
-    uint32_t old_flags = _flags;
+    // The cost map is only required for routing
+    if( _use_cpu_cost_analysis && (flags & LINKS_DIRTY) )
+      updateDesktopImage();
+
+    uint32_t types = 0;
     {
       QMutexLocker lock_links(&_mutex_slot_links);
-      uint32_t types = pass == 0
-                     ? (Component::Renderer | 64)
-                     :   Component::Config
-                       | Component::DataServer
-                       | ((_flags & LINKS_DIRTY) ? Component::Routing : 0)
-                       | ((_flags & RENDER_DIRTY) ? Component::Renderer : 0);
+      types = pass == 0
+            ? (Component::Renderer | 64)
+            :   Component::Config
+              | Component::DataServer
+              | ((flags & LINKS_DIRTY)
+                  ? (Component::Costanalysis | Component::Routing)
+                  : 0)
+              | ((flags & RENDER_DIRTY) ? Component::Renderer : 0);
 
 //      std::cout << "types: " << (types & Component::Routing ? "routing " : "")
 //                             << (types & Component::Renderer ? "render " : "")
 //                             << std::endl;
 
-      _flags = _core.process(types);
+      // Changes detected while processing (eg. running animations) are
+      // handled with the next frame
+      _dirty_flags |= _core.process(types);
     }
 
     static int counter = 0;
@@ -295,7 +393,6 @@ namespace qtfullscreensystem
       image.save(name);
     };
 
-    glFinish();
     //writeTexture(_subscribe_links, QString("links%1.png").arg(counter));
 
     if( !_fbo->bind() )
@@ -354,26 +451,116 @@ namespace qtfullscreensystem
     glBindTexture(GL_TEXTURE_2D, 0);
 
 #endif
+
+    // Only read back regions changed by the renderer. Without desktop blending
+    // the desktop is part of the composited frame, so everything needs to be
+    // read.
+    QRegion read_region;
+    if( _fbo_image.isNull() )
+      read_region = QRect(QPoint(0, 0), _fbo->size());
+    else if( types & Component::Renderer )
+    {
+#ifdef USE_DESKTOP_BLEND
+      if( _subscribe_links_damage->isValid() )
+      {
+        for(auto const& rect: *_subscribe_links_damage->_data)
+        {
+          const int l = std::floor(rect.l() - desktop.l()),
+                    t = std::floor(rect.t() - desktop.t()),
+                    r = std::ceil(rect.r() - desktop.l()),
+                    b = std::ceil(rect.b() - desktop.t());
+          read_region += QRect(l, t, r - l, b - t);
+        }
+      }
+      else
+#endif
+        read_region = QRect(QPoint(0, 0), _fbo->size());
+    }
+
+    _fbo_reader->read(read_region);
+
     if( !_fbo->release() )
       qFatal("Failed to release FBO.");
 
-    glFinish();
-
-    _fbo_image = _fbo->toImage();
+    // Copy the frame(s) read back while previous frames have been rendered
+    const QRegion image_damage = _fbo_reader->update(_fbo_image);
     //_fbo_image.save(QString("fbo%1.png").arg(counter));
 
-    int timeout = 5;
+    // Repaint all screens with the same frame (only changed parts of the image)
     for(size_t i = 0; i < _windows.size(); ++i)
     {
-      //w->update();
-      QTimer::singleShot(timeout, _windows[i].get(), SLOT(update()));
-      QTimer::singleShot(timeout, _mask_windows[i].get(), SLOT(update()));
-
-      // Waiting a bit between updates seems to reduce artifacts...
-      timeout += 30;
+      _windows[i]->updateImageRegion(image_damage);
+      if( flags & (RENDER_DIRTY | MASK_DIRTY) )
+        _mask_windows[i]->update();
     }
 
     _gl_ctx.doneCurrent();
+
+    // Keep going while something is still changing (or not yet shown)
+    if( _dirty_flags || _fbo_reader->pending() )
+      scheduleFrame();
+  }
+
+  //----------------------------------------------------------------------------
+  void Application::updateDesktopImage()
+  {
+    QImage img;
+    if( !_debug_desktop_image.empty() )
+    {
+      // Static image (eg. for testing without a screen)
+      if( !_desktop_image.isNull() )
+        return;
+
+      if( !img.load(QString::fromStdString(_debug_desktop_image)) )
+        LOG_WARN("Failed to load desktop image: " << _debug_desktop_image);
+    }
+    else
+    {
+      const Rect& desktop = *_slot_desktop_rect->_data;
+      img = QGuiApplication::primaryScreen()->grabWindow( 0,
+                                                          desktop.l(),
+                                                          desktop.t(),
+                                                          desktop.size.x,
+                                                          desktop.size.y )
+                                             .toImage();
+    }
+
+    if( img.isNull() )
+    {
+      _slot_desktop->setValid(false);
+      return;
+    }
+
+    // Screenshots are ARGB32 (B, G, R, A in memory on little endian), but
+    // the cost analysis expects R, G, B, A
+    _desktop_image = img.convertToFormat(QImage::Format_RGBA8888);
+
+    LR::SlotType::Image& slot = *_slot_desktop->_data;
+    slot.pdata = _desktop_image.bits();
+    slot.width = _desktop_image.width();
+    slot.height = _desktop_image.height();
+    _slot_desktop->setValid(true);
+  }
+
+  //----------------------------------------------------------------------------
+  void Application::scheduleFrame(uint32_t flags)
+  {
+    _dirty_flags |= flags;
+    if( _frame_timer.isActive() )
+      return;
+
+    double fps = _max_fps;
+    if( fps <= 0 )
+      fps = QGuiApplication::primaryScreen()->refreshRate();
+    if( fps <= 0 )
+      fps = 60;
+
+    // Start immediately if the last frame is already long enough ago
+    qint64 delay = 0;
+    if( _frame_time.isValid() )
+      delay = std::max<qint64>(0, 1000 / fps - _frame_time.elapsed());
+
+    _frame_timer.start(delay);
   }
 
 } // namespace qtfullscreensystem